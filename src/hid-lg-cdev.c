@@ -0,0 +1,824 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/fs.h>
+#include <linux/hid.h>
+#include <linux/hid-lg-extended.h>
+#include <linux/idr.h>
+#include <linux/jiffies.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#include "hid-lg-device.h"
+#include "hid-lg-cdev.h"
+
+/*
+ * A character device per HID device, /dev/lg-hidpp<n>, to read and write the
+ * registers of the device and of the devices behind it in one batch, see
+ * LG_HIDPP_IOC_BATCH. The requests go through the queues of the driver, for
+ * a receiver through the queue of the slot, so they are paced like the ones
+ * of the driver itself.
+ *
+ * Replies are matched to the oldest operation waiting for the same devnum,
+ * action and register, an error reply to the operation it names. The driver
+ * still handles every reply as well.
+ *
+ * Every open file can also write raw reports, which are queued like the
+ * requests of a batch. A reply not taken by the batch goes to the file with
+ * the oldest report waiting for it and is read back from that file. The
+ * number of reports waiting per file is limited and writes are refused while
+ * the queue is more than half full, so the requests of the driver itself
+ * always find room.
+ *
+ * The events the drivers post are written to a ring shared with userspace
+ * through mmap, see struct lg_hidpp_ring. They are all posted from the
+ * receive worker, so there is a single producer. Head and tail in the ring
+ * can be written by userspace, so the driver keeps its own head and only
+ * reads tail to see whether there is room.
+ */
+
+#define LG_CDEV_DEFAULT_TIMEOUT_MS 1000
+#define LG_CDEV_MAX_TIMEOUT_MS 10000
+
+#define LG_CDEV_SHORT_SIZE 7
+#define LG_CDEV_LONG_SIZE 20
+
+#define LG_CDEV_RAW_TIMEOUT_MS 1000
+#define LG_CDEV_RAW_REPLIES 16
+
+/* A raw report waiting for its reply */
+struct lg_cdev_request {
+	bool used;
+	u8 devnum;
+	u8 action;
+	u8 reg;
+	u32 seq;
+	unsigned long deadline;
+};
+
+struct lg_cdev_reply {
+	u8 data[LG_CDEV_LONG_SIZE];
+	u8 size;
+};
+
+/* An open file, the requests and replies are protected by pending_lock */
+struct lg_cdev_client {
+	struct lg_cdev *cdev;
+	struct list_head list;
+	wait_queue_head_t wait;
+	bool mapped;
+
+	struct lg_cdev_request requests[LG_HIDPP_RAW_MAX_PENDING];
+
+	struct lg_cdev_reply replies[LG_CDEV_RAW_REPLIES];
+	u8 reply_head;
+	u8 reply_tail;
+};
+
+struct lg_cdev {
+	struct kref ref;
+	struct miscdevice misc;
+	/* lg-hidpp and the id, which never has more than 10 digits */
+	char name[sizeof("lg-hidpp") + 10];
+	int id;
+
+	/* Serializes the batches */
+	struct mutex batch_lock;
+
+	/* Protects device, which is cleared when the device goes away */
+	struct mutex device_lock;
+	struct lg_device *device;
+
+	/* The batch waiting for its replies */
+	spinlock_t pending_lock;
+	wait_queue_head_t wait;
+	struct lg_hidpp_op *ops;
+	u32 count;
+	u32 remaining;
+	bool dead;
+
+	/* The open files and the order of their raw reports */
+	struct list_head clients;
+	u32 raw_seq;
+
+	/* The events, protected by event_lock */
+	spinlock_t event_lock;
+	wait_queue_head_t event_wait;
+	struct lg_hidpp_ring *ring;
+	u32 event_head;
+	u32 event_count;
+	u32 dropped;
+};
+
+static DEFINE_IDA(lg_cdev_ida);
+
+static void lg_cdev_release(struct kref *ref)
+{
+	struct lg_cdev *cdev = container_of(ref, struct lg_cdev, ref);
+
+	ida_free(&lg_cdev_ida, cdev->id);
+	vfree(cdev->ring);
+	kfree(cdev);
+}
+
+static bool lg_cdev_matches(u8 devnum, u8 action, u8 reg, const u8 *buffer,
+			    size_t count)
+{
+	if (devnum != buffer[1])
+		return false;
+
+	if (buffer[2] == LG_DEVICE_ACTION_ERROR)
+		return count >= 6 && buffer[3] == action && buffer[4] == reg;
+
+	return buffer[2] == action && buffer[3] == reg;
+}
+
+static bool lg_cdev_op_matches(const struct lg_hidpp_op *op, const u8 *buffer,
+			       size_t count)
+{
+	return op->status == -ETIMEDOUT &&
+		lg_cdev_matches(op->devnum, op->action, op->reg, buffer, count);
+}
+
+/*
+ * Hands the reply to the file with the oldest raw report waiting for it.
+ * Called with pending_lock held, returns the file to wake up.
+ */
+static struct lg_cdev_client *lg_cdev_raw_receive(struct lg_cdev *cdev,
+						  const u8 *buffer,
+						  size_t count)
+{
+	struct lg_cdev_client *client, *found = NULL;
+	struct lg_cdev_request *request, *oldest = NULL;
+	struct lg_cdev_reply *reply;
+	u8 next;
+	int i;
+
+	list_for_each_entry(client, &cdev->clients, list) {
+		for (i = 0; i < LG_HIDPP_RAW_MAX_PENDING; i++) {
+			request = &client->requests[i];
+			if (!request->used ||
+					time_after(jiffies, request->deadline) ||
+					!lg_cdev_matches(request->devnum,
+							 request->action,
+							 request->reg, buffer,
+							 count))
+				continue;
+
+			if (!oldest || (s32)(request->seq - oldest->seq) < 0) {
+				oldest = request;
+				found = client;
+			}
+		}
+	}
+
+	if (!found)
+		return NULL;
+
+	oldest->used = false;
+
+	next = (found->reply_head + 1) % LG_CDEV_RAW_REPLIES;
+	if (next == found->reply_tail)
+		return found;
+
+	reply = &found->replies[found->reply_head];
+	reply->size = min_t(size_t, count, sizeof(reply->data));
+	memcpy(reply->data, buffer, reply->size);
+	found->reply_head = next;
+
+	return found;
+}
+
+/* Completes the operation the report is a reply to, if any */
+void lg_cdev_receive(struct lg_device *device, const u8 *buffer, size_t count)
+{
+	struct lg_cdev *cdev = device->cdev;
+	struct lg_cdev_client *client = NULL;
+	struct lg_hidpp_op *op;
+	unsigned long flags;
+	bool matched = false;
+	bool done = false;
+	u32 i;
+
+	if (!cdev || count < 4)
+		return;
+
+	spin_lock_irqsave(&cdev->pending_lock, flags);
+
+	for (i = 0; cdev->ops && i < cdev->count; i++) {
+		op = &cdev->ops[i];
+		if (!lg_cdev_op_matches(op, buffer, count))
+			continue;
+
+		if (buffer[2] == LG_DEVICE_ACTION_ERROR) {
+			op->status = -EIO;
+			op->error = buffer[5];
+			op->size = 0;
+		} else {
+			op->status = 0;
+			op->size = min_t(size_t, count - 4, LG_HIDPP_DATA_SIZE);
+			memcpy(op->data, &buffer[4], op->size);
+		}
+
+		matched = true;
+		done = !--cdev->remaining;
+		break;
+	}
+
+	if (!matched)
+		client = lg_cdev_raw_receive(cdev, buffer, count);
+
+	spin_unlock_irqrestore(&cdev->pending_lock, flags);
+
+	if (done)
+		wake_up_interruptible(&cdev->wait);
+	if (client)
+		wake_up_interruptible(&client->wait);
+}
+
+/* Writes an event to the ring of the device which owns the in_queue */
+void lg_cdev_event(struct lg_device *owner, u16 type, u32 value,
+		   const u8 *buffer, size_t count)
+{
+	struct lg_cdev *cdev = owner->cdev;
+	struct lg_hidpp_event *event;
+	unsigned long flags;
+	u32 next;
+
+	if (!cdev)
+		return;
+
+	spin_lock_irqsave(&cdev->event_lock, flags);
+
+	next = (cdev->event_head + 1) % cdev->event_count;
+	if (next == READ_ONCE(cdev->ring->tail)) {
+		WRITE_ONCE(cdev->ring->dropped, ++cdev->dropped);
+		spin_unlock_irqrestore(&cdev->event_lock, flags);
+		return;
+	}
+
+	event = &cdev->ring->events[cdev->event_head];
+	event->time_ns = ktime_get_ns();
+	event->type = type;
+	event->devnum = buffer[1];
+	event->size = min_t(size_t, count, sizeof(event->data));
+	event->value = value;
+	memcpy(event->data, buffer, event->size);
+
+	/* The event must be complete before the reader can see it */
+	smp_wmb();
+	cdev->event_head = next;
+	WRITE_ONCE(cdev->ring->head, next);
+
+	spin_unlock_irqrestore(&cdev->event_lock, flags);
+
+	wake_up_interruptible(&cdev->event_wait);
+}
+
+static struct lg_device_queue *lg_cdev_out_queue(struct lg_device *device,
+						 u8 devnum)
+{
+	if (device->driver->find_out_queue)
+		return device->driver->find_out_queue(device, devnum);
+
+	return device->out_queue;
+}
+
+static void lg_cdev_send(struct lg_device *device, const struct lg_hidpp_op *op)
+{
+	u8 buffer[LG_CDEV_LONG_SIZE] = { 0 };
+	size_t count = LG_CDEV_SHORT_SIZE;
+
+	buffer[0] = 0x10;
+	if (op->size > 3) {
+		buffer[0] = 0x11;
+		count = LG_CDEV_LONG_SIZE;
+	}
+
+	buffer[1] = op->devnum;
+	buffer[2] = op->action;
+	buffer[3] = op->reg;
+	memcpy(&buffer[4], op->data, count - 4);
+
+	lg_device_queue(device, lg_cdev_out_queue(device, op->devnum), buffer,
+			count);
+}
+
+static bool lg_cdev_batch_done(struct lg_cdev *cdev)
+{
+	unsigned long flags;
+	bool done;
+
+	spin_lock_irqsave(&cdev->pending_lock, flags);
+	done = !cdev->remaining || cdev->dead;
+	spin_unlock_irqrestore(&cdev->pending_lock, flags);
+
+	return done;
+}
+
+static long lg_cdev_batch(struct lg_cdev *cdev,
+			  struct lg_hidpp_batch __user *arg)
+{
+	struct lg_hidpp_batch batch;
+	struct lg_hidpp_op *ops;
+	unsigned long flags;
+	long ret = 0;
+	u32 i;
+
+	if (copy_from_user(&batch, arg, sizeof(batch)))
+		return -EFAULT;
+
+	if (!batch.count || batch.count > LG_HIDPP_MAX_OPS ||
+			batch.timeout_ms > LG_CDEV_MAX_TIMEOUT_MS)
+		return -EINVAL;
+
+	if (!batch.timeout_ms)
+		batch.timeout_ms = LG_CDEV_DEFAULT_TIMEOUT_MS;
+
+	ops = kcalloc(batch.count, sizeof(*ops), GFP_KERNEL);
+	if (!ops)
+		return -ENOMEM;
+
+	if (copy_from_user(ops, u64_to_user_ptr(batch.ops),
+			   batch.count * sizeof(*ops))) {
+		ret = -EFAULT;
+		goto out_free;
+	}
+
+	for (i = 0; i < batch.count; i++) {
+		if (ops[i].size > LG_HIDPP_DATA_SIZE) {
+			ret = -EINVAL;
+			goto out_free;
+		}
+
+		ops[i].status = -ETIMEDOUT;
+		ops[i].error = 0;
+	}
+
+	if (mutex_lock_interruptible(&cdev->batch_lock)) {
+		ret = -EINTR;
+		goto out_free;
+	}
+
+	spin_lock_irqsave(&cdev->pending_lock, flags);
+	cdev->ops = ops;
+	cdev->count = batch.count;
+	cdev->remaining = batch.count;
+	spin_unlock_irqrestore(&cdev->pending_lock, flags);
+
+	mutex_lock(&cdev->device_lock);
+	if (cdev->device) {
+		for (i = 0; i < batch.count; i++)
+			lg_cdev_send(cdev->device, &ops[i]);
+	}
+	mutex_unlock(&cdev->device_lock);
+
+	if (wait_event_interruptible_timeout(cdev->wait,
+				lg_cdev_batch_done(cdev),
+				msecs_to_jiffies(batch.timeout_ms)) < 0)
+		ret = -EINTR;
+
+	spin_lock_irqsave(&cdev->pending_lock, flags);
+	cdev->ops = NULL;
+	cdev->count = 0;
+	cdev->remaining = 0;
+	if (cdev->dead)
+		ret = -ENODEV;
+	spin_unlock_irqrestore(&cdev->pending_lock, flags);
+
+	mutex_lock(&cdev->device_lock);
+	for (i = 0; cdev->device && i < batch.count; i++) {
+		if (ops[i].status == -ETIMEDOUT)
+			lg_device_stats_inc(cdev->device->stats, timeouts);
+	}
+	mutex_unlock(&cdev->device_lock);
+
+	mutex_unlock(&cdev->batch_lock);
+
+	if (!ret && copy_to_user(u64_to_user_ptr(batch.ops), ops,
+				 batch.count * sizeof(*ops)))
+		ret = -EFAULT;
+
+out_free:
+	kfree(ops);
+	return ret;
+}
+
+/*
+ * Takes a free request of the file for the report, one which is waiting
+ * longer than LG_CDEV_RAW_TIMEOUT_MS is free again.
+ */
+static int lg_cdev_raw_reserve(struct lg_cdev_client *client,
+			       const u8 *buffer)
+{
+	struct lg_cdev *cdev = client->cdev;
+	struct lg_cdev_request *request;
+	unsigned long flags;
+	int ret = -EAGAIN;
+	int i;
+
+	spin_lock_irqsave(&cdev->pending_lock, flags);
+
+	if (cdev->dead) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	for (i = 0; i < LG_HIDPP_RAW_MAX_PENDING; i++) {
+		request = &client->requests[i];
+		if (request->used && !time_after(jiffies, request->deadline))
+			continue;
+
+		request->used = true;
+		request->devnum = buffer[1];
+		request->action = buffer[2];
+		request->reg = buffer[3];
+		request->seq = cdev->raw_seq++;
+		request->deadline = jiffies +
+			msecs_to_jiffies(LG_CDEV_RAW_TIMEOUT_MS);
+		ret = i;
+		break;
+	}
+
+out_unlock:
+	spin_unlock_irqrestore(&cdev->pending_lock, flags);
+
+	return ret;
+}
+
+static void lg_cdev_raw_unreserve(struct lg_cdev_client *client, int index)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&client->cdev->pending_lock, flags);
+	client->requests[index].used = false;
+	spin_unlock_irqrestore(&client->cdev->pending_lock, flags);
+}
+
+static bool lg_cdev_raw_writable(struct lg_cdev_client *client)
+{
+	struct lg_cdev_request *request;
+	unsigned long flags;
+	bool writable;
+	int i;
+
+	spin_lock_irqsave(&client->cdev->pending_lock, flags);
+
+	writable = client->cdev->dead;
+	for (i = 0; !writable && i < LG_HIDPP_RAW_MAX_PENDING; i++) {
+		request = &client->requests[i];
+		writable = !request->used ||
+			time_after(jiffies, request->deadline);
+	}
+
+	spin_unlock_irqrestore(&client->cdev->pending_lock, flags);
+
+	return writable;
+}
+
+static ssize_t lg_cdev_write(struct file *file, const char __user *data,
+			     size_t count, loff_t *ppos)
+{
+	struct lg_cdev_client *client = file->private_data;
+	struct lg_cdev *cdev = client->cdev;
+	struct lg_device_queue *queue;
+	u8 buffer[LG_CDEV_LONG_SIZE];
+	ssize_t ret;
+	int index;
+
+	if (count != LG_CDEV_SHORT_SIZE && count != LG_CDEV_LONG_SIZE)
+		return -EINVAL;
+
+	if (copy_from_user(buffer, data, count))
+		return -EFAULT;
+
+	if (buffer[0] != (count == LG_CDEV_SHORT_SIZE ? 0x10 : 0x11))
+		return -EINVAL;
+
+	/* A request is free again after LG_CDEV_RAW_TIMEOUT_MS at the latest */
+	while ((index = lg_cdev_raw_reserve(client, buffer)) == -EAGAIN) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		if (wait_event_interruptible_timeout(client->wait,
+				lg_cdev_raw_writable(client),
+				msecs_to_jiffies(LG_CDEV_RAW_TIMEOUT_MS)) < 0)
+			return -EINTR;
+	}
+
+	if (index < 0)
+		return index;
+
+	mutex_lock(&cdev->device_lock);
+
+	ret = -ENODEV;
+	if (cdev->device) {
+		queue = lg_cdev_out_queue(cdev->device, buffer[1]);
+
+		/* Leave the other half of the queue to the driver */
+		ret = -EAGAIN;
+		if (lg_device_queue_free(queue) > LG_DEVICE_BUFSIZE / 2) {
+			lg_device_queue(cdev->device, queue, buffer, count);
+			ret = count;
+		}
+	}
+
+	mutex_unlock(&cdev->device_lock);
+
+	if (ret < 0)
+		lg_cdev_raw_unreserve(client, index);
+
+	return ret;
+}
+
+/* Takes the oldest reply of the file, -EAGAIN if there is none yet */
+static int lg_cdev_raw_pop(struct lg_cdev_client *client,
+			   struct lg_cdev_reply *reply)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	spin_lock_irqsave(&client->cdev->pending_lock, flags);
+
+	if (client->reply_tail != client->reply_head) {
+		*reply = client->replies[client->reply_tail];
+		client->reply_tail = (client->reply_tail + 1) %
+					LG_CDEV_RAW_REPLIES;
+	} else {
+		ret = client->cdev->dead ? -ENODEV : -EAGAIN;
+	}
+
+	spin_unlock_irqrestore(&client->cdev->pending_lock, flags);
+
+	return ret;
+}
+
+static bool lg_cdev_raw_readable(struct lg_cdev_client *client)
+{
+	unsigned long flags;
+	bool readable;
+
+	spin_lock_irqsave(&client->cdev->pending_lock, flags);
+	readable = client->reply_tail != client->reply_head ||
+		client->cdev->dead;
+	spin_unlock_irqrestore(&client->cdev->pending_lock, flags);
+
+	return readable;
+}
+
+static ssize_t lg_cdev_read(struct file *file, char __user *data,
+			    size_t count, loff_t *ppos)
+{
+	struct lg_cdev_client *client = file->private_data;
+	struct lg_cdev_reply reply;
+	int ret;
+
+	while ((ret = lg_cdev_raw_pop(client, &reply)) == -EAGAIN) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		if (wait_event_interruptible(client->wait,
+					     lg_cdev_raw_readable(client)))
+			return -EINTR;
+	}
+
+	if (ret)
+		return ret;
+
+	count = min_t(size_t, count, reply.size);
+	if (copy_to_user(data, reply.data, count))
+		return -EFAULT;
+
+	return count;
+}
+
+static long lg_cdev_ioctl(struct file *file, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct lg_cdev_client *client = file->private_data;
+
+	switch (cmd) {
+	case LG_HIDPP_IOC_BATCH:
+		return lg_cdev_batch(client->cdev, (void __user *)arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int lg_cdev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct lg_cdev_client *client = file->private_data;
+	int ret;
+
+	if (vma->vm_pgoff ||
+			vma_pages(vma) != PAGE_ALIGN(LG_HIDPP_RING_SIZE) >> PAGE_SHIFT)
+		return -EINVAL;
+
+	ret = remap_vmalloc_range(vma, client->cdev->ring, 0);
+	if (!ret)
+		client->mapped = true;
+
+	return ret;
+}
+
+/*
+ * Readable when the file has a raw reply or, once it mapped the ring, the
+ * ring has events. Writable while a raw report can wait for its reply.
+ */
+static __poll_t lg_cdev_poll(struct file *file, poll_table *wait)
+{
+	struct lg_cdev_client *client = file->private_data;
+	struct lg_cdev *cdev = client->cdev;
+	unsigned long flags;
+	__poll_t mask = 0;
+	int i;
+
+	poll_wait(file, &client->wait, wait);
+
+	if (client->mapped) {
+		poll_wait(file, &cdev->event_wait, wait);
+
+		spin_lock_irqsave(&cdev->event_lock, flags);
+		if (READ_ONCE(cdev->ring->tail) != cdev->event_head)
+			mask |= EPOLLIN | EPOLLRDNORM;
+		spin_unlock_irqrestore(&cdev->event_lock, flags);
+	}
+
+	spin_lock_irqsave(&cdev->pending_lock, flags);
+
+	if (client->reply_tail != client->reply_head)
+		mask |= EPOLLIN | EPOLLRDNORM;
+
+	for (i = 0; i < LG_HIDPP_RAW_MAX_PENDING; i++) {
+		if (!client->requests[i].used ||
+				time_after(jiffies, client->requests[i].deadline)) {
+			mask |= EPOLLOUT | EPOLLWRNORM;
+			break;
+		}
+	}
+
+	if (cdev->dead)
+		mask |= EPOLLHUP;
+
+	spin_unlock_irqrestore(&cdev->pending_lock, flags);
+
+	return mask;
+}
+
+static int lg_cdev_open(struct inode *inode, struct file *file)
+{
+	struct lg_cdev *cdev = container_of(file->private_data,
+					    struct lg_cdev, misc);
+	struct lg_cdev_client *client;
+	unsigned long flags;
+
+	client = kzalloc(sizeof(*client), GFP_KERNEL);
+	if (!client)
+		return -ENOMEM;
+
+	client->cdev = cdev;
+	init_waitqueue_head(&client->wait);
+
+	kref_get(&cdev->ref);
+
+	spin_lock_irqsave(&cdev->pending_lock, flags);
+	list_add_tail(&client->list, &cdev->clients);
+	spin_unlock_irqrestore(&cdev->pending_lock, flags);
+
+	file->private_data = client;
+
+	return 0;
+}
+
+static int lg_cdev_file_release(struct inode *inode, struct file *file)
+{
+	struct lg_cdev_client *client = file->private_data;
+	struct lg_cdev *cdev = client->cdev;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cdev->pending_lock, flags);
+	list_del(&client->list);
+	spin_unlock_irqrestore(&cdev->pending_lock, flags);
+
+	kfree(client);
+	kref_put(&cdev->ref, lg_cdev_release);
+
+	return 0;
+}
+
+static const struct file_operations lg_cdev_fops = {
+	.owner = THIS_MODULE,
+	.open = lg_cdev_open,
+	.release = lg_cdev_file_release,
+	.read = lg_cdev_read,
+	.write = lg_cdev_write,
+	.unlocked_ioctl = lg_cdev_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.mmap = lg_cdev_mmap,
+	.poll = lg_cdev_poll,
+};
+
+int lg_cdev_create(struct lg_device *device)
+{
+	struct lg_cdev *cdev;
+	int ret;
+
+	cdev = kzalloc(sizeof(*cdev), GFP_KERNEL);
+	if (!cdev)
+		return -ENOMEM;
+
+	kref_init(&cdev->ref);
+	mutex_init(&cdev->batch_lock);
+	mutex_init(&cdev->device_lock);
+	spin_lock_init(&cdev->pending_lock);
+	init_waitqueue_head(&cdev->wait);
+	INIT_LIST_HEAD(&cdev->clients);
+	spin_lock_init(&cdev->event_lock);
+	init_waitqueue_head(&cdev->event_wait);
+	cdev->device = device;
+
+	cdev->ring = vmalloc_user(PAGE_ALIGN(LG_HIDPP_RING_SIZE));
+	if (!cdev->ring) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+
+	cdev->event_count = (LG_HIDPP_RING_SIZE - sizeof(*cdev->ring)) /
+				sizeof(cdev->ring->events[0]);
+	cdev->ring->size = cdev->event_count;
+
+	cdev->id = ida_alloc(&lg_cdev_ida, GFP_KERNEL);
+	if (cdev->id < 0) {
+		ret = cdev->id;
+		goto err_vfree;
+	}
+
+	snprintf(cdev->name, sizeof(cdev->name), "lg-hidpp%d", cdev->id);
+	cdev->misc.minor = MISC_DYNAMIC_MINOR;
+	cdev->misc.name = cdev->name;
+	cdev->misc.fops = &lg_cdev_fops;
+	cdev->misc.parent = &device->hdev->dev;
+
+	ret = misc_register(&cdev->misc);
+	if (ret)
+		goto err_ida;
+
+	device->cdev = cdev;
+
+	return 0;
+err_ida:
+	ida_free(&lg_cdev_ida, cdev->id);
+err_vfree:
+	vfree(cdev->ring);
+err_free:
+	kfree(cdev);
+	return ret;
+}
+
+/*
+ * Removes the device node and wakes up everyone still waiting. Open files keep
+ * the lg_cdev around, but can't reach the device anymore. The in_queue must
+ * be shut down already, so lg_cdev_receive can't run anymore.
+ */
+void lg_cdev_destroy(struct lg_device *device)
+{
+	struct lg_cdev *cdev = device->cdev;
+	struct lg_cdev_client *client;
+	unsigned long flags;
+
+	if (!cdev)
+		return;
+
+	device->cdev = NULL;
+	misc_deregister(&cdev->misc);
+
+	mutex_lock(&cdev->device_lock);
+	cdev->device = NULL;
+	mutex_unlock(&cdev->device_lock);
+
+	spin_lock_irqsave(&cdev->pending_lock, flags);
+	cdev->dead = true;
+	list_for_each_entry(client, &cdev->clients, list)
+		wake_up_interruptible(&client->wait);
+	spin_unlock_irqrestore(&cdev->pending_lock, flags);
+
+	wake_up_interruptible(&cdev->wait);
+	wake_up_interruptible(&cdev->event_wait);
+
+	kref_put(&cdev->ref, lg_cdev_release);
+}
@@ -0,0 +1,22 @@
+#ifndef __HID_LG_CDEV
+#define __HID_LG_CDEV
+
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/hid-lg-extended.h>
+
+int lg_cdev_create(struct lg_device *device);
+
+void lg_cdev_destroy(struct lg_device *device);
+
+void lg_cdev_receive(struct lg_device *device, const u8 *buffer, size_t count);
+
+void lg_cdev_event(struct lg_device *owner, u16 type, u32 value,
+		   const u8 *buffer, size_t count);
+
+#endif
@@ -5,14 +5,31 @@
  * any later version.
  */
 
+#include <linux/debugfs.h>
+#include <linux/device.h>
 #include <linux/module.h>
 #include <linux/hid-lg-extended.h>
 
+#include "hid-lg-fault.h"
+#include "hid-lg-netlink.h"
+#include "hid-lg-stats.h"
+#include "hid-lg-unknown.h"
+
 static struct lg_driver drivers;
 
+static struct dentry *lg_debugfs_root;
+
+static bool claim_devices = true;
+module_param(claim_devices, bool, 0644);
+MODULE_PARM_DESC(claim_devices, "Take over supported devices which are bound "
+		"to hid-generic when a driver is registered");
+
 int lg_probe(struct hid_device *hdev,
 				const struct hid_device_id *id);
 
+static int lg_set_probe(struct hid_device *hdev,
+				const struct hid_device_id *id);
+
 void lg_remove(struct hid_device *hdev);
 
 struct lg_device *lg_find_device_on_lg_device(struct lg_device *device,
@@ -47,7 +64,7 @@ struct lg_device *lg_create_on_receiver(struct lg_device *receiver,
 					const u8 *buffer, size_t count)
 {
 	struct lg_driver *driver;
-	u8 found;
+	u8 found = 0;
 
 	list_for_each_entry(driver, &drivers.list, list)
 	{
@@ -70,6 +87,53 @@ struct lg_device *lg_create_on_receiver(struct lg_device *receiver,
 }
 EXPORT_SYMBOL_GPL(lg_create_on_receiver);
 
+static int lg_claim_device(struct device *dev, void *data)
+{
+	struct hid_driver *hid_driver = data;
+	struct hid_device *hdev = container_of(dev, struct hid_device, dev);
+	const struct hid_device_id *id;
+
+	/* A specific driver, like hid-logitech-dj, is left alone */
+	if (!dev->driver || strcmp(dev->driver->name, "hid-generic"))
+		return 0;
+
+	for (id = hid_driver->id_table; id->bus; id++) {
+		if (hdev->bus == id->bus &&
+			hdev->vendor == id->vendor &&
+			hdev->product == id->product) {
+			hid_info(hdev, "Taking over device from %s\n",
+				 dev->driver->name);
+			device_release_driver(dev);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Devices which are already bound to hid-generic aren't probed again when our
+ * driver registers. Release them and attach them to the new driver right
+ * away, so the device is only without a driver for the duration of the
+ * probe. Devices bound to any other driver have to be rebound by hand, with
+ * lg-bind.
+ */
+static void lg_claim_devices(struct hid_driver *hid_driver)
+{
+	int ret;
+
+	if (!claim_devices)
+		return;
+
+	bus_for_each_dev(hid_driver->driver.bus, NULL, hid_driver,
+			 lg_claim_device);
+
+	ret = driver_attach(&hid_driver->driver);
+	if (ret)
+		pr_err("Can't attach devices to %s hid driver\n",
+		       hid_driver->name);
+}
+
 int lg_register_driver(struct lg_driver *driver)
 {
 	int ret;
@@ -82,6 +146,7 @@ int lg_register_driver(struct lg_driver *driver)
 	}
 
 	memcpy(device_ids, &driver->device_id, sizeof(driver->device_id));
+	device_ids[0].driver_data = (kernel_ulong_t)driver;
 	memset(&device_ids[1], 0, sizeof(struct hid_device_id));
 	driver->hid_driver.name = driver->name;
 	driver->hid_driver.id_table = device_ids;
@@ -97,6 +162,8 @@ int lg_register_driver(struct lg_driver *driver)
 		goto error_free;
 	}
 
+	lg_claim_devices(&driver->hid_driver);
+
 	return 0;
 error_free:
 	kfree(device_ids);
@@ -115,27 +182,90 @@ void lg_unregister_driver(struct lg_driver *driver)
 }
 EXPORT_SYMBOL_GPL(lg_unregister_driver);
 
-static struct lg_driver *lg_find_driver(struct hid_device *hdev)
+int lg_register_driver_set(struct lg_driver_set *set)
 {
-	struct lg_driver *driver;
-	u8 found;
+	int ret;
+	int i, count;
+	struct hid_device_id *device_ids;
 
-	list_for_each_entry(driver, &drivers.list, list)
-	{
+	for (count = 0; set->drivers[count]; count++)
+		;
+
+	device_ids = kcalloc(count + 1, sizeof(*device_ids), GFP_KERNEL);
+	if (!device_ids) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	for (i = 0; i < count; i++) {
+		device_ids[i] = set->drivers[i]->device_id;
+		device_ids[i].driver_data = (kernel_ulong_t)set->drivers[i];
+		list_add(&set->drivers[i]->list, &drivers.list);
+	}
+
+	set->hid_driver.name = set->name;
+	set->hid_driver.id_table = device_ids;
+	set->hid_driver.probe = lg_set_probe;
+	set->hid_driver.remove = lg_remove;
+	set->hid_driver.raw_event = lg_device_event;
+
+	ret = hid_register_driver(&set->hid_driver);
+	if (ret) {
+		pr_err("Can't register %s hid driver\n", set->name);
+		goto error_free;
+	}
+
+	lg_claim_devices(&set->hid_driver);
+
+	return 0;
+error_free:
+	for (i = 0; i < count; i++)
+		list_del(&set->drivers[i]->list);
+	kfree(device_ids);
+error:
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lg_register_driver_set);
+
+void lg_unregister_driver_set(struct lg_driver_set *set)
+{
+	int i;
+
+	hid_unregister_driver(&set->hid_driver);
+
+	for (i = 0; set->drivers[i]; i++)
+		list_del(&set->drivers[i]->list);
+
+	kfree(set->hid_driver.id_table);
+}
+EXPORT_SYMBOL_GPL(lg_unregister_driver_set);
+
+static struct lg_driver *lg_find_driver_in_set(struct lg_driver_set *set,
+				struct hid_device *hdev,
+				const struct hid_device_id *id)
+{
+	struct lg_driver *driver = (struct lg_driver *)id->driver_data;
+	int i;
+
+	/*
+	 * The driver_data of dynamic ids (new_id) comes from userspace, so
+	 * only use it when it really is one of the drivers of the set.
+	 */
+	for (i = 0; set->drivers[i]; i++) {
+		if (set->drivers[i] == driver)
+			return driver;
+	}
+
+	for (i = 0; set->drivers[i]; i++) {
+		driver = set->drivers[i];
 		if (hdev->bus == driver->device_id.bus &&
 			hdev->vendor == driver->device_id.vendor &&
-			hdev->product == driver->device_id.product) {
-			found = 1;
-			break;
-		}
+			hdev->product == driver->device_id.product)
+			return driver;
 	}
 
-	if (!found)
-		return NULL;
-
-	return driver;
+	return NULL;
 }
-EXPORT_SYMBOL_GPL(lg_find_driver);
 
 void lg_destroy(struct lg_device *device)
 {
@@ -143,19 +273,11 @@ void lg_destroy(struct lg_device *device)
 		device->driver->exit(device);
 }
 
-int lg_probe(struct hid_device *hdev,
-				const struct hid_device_id *id)
+static int lg_probe_driver(struct hid_device *hdev, struct lg_driver *driver)
 {
-	struct lg_driver *driver;
 	unsigned int connect_mask = HID_CONNECT_DEFAULT;
 	int ret;
 
-	driver = lg_find_driver(hdev);
-	if (!driver) {
-		ret = -EINVAL;
-		goto err;
-	}
-
 	ret = hid_parse(hdev);
 	if (ret) {
 		hid_err(hdev, "parse failed\n");
@@ -179,6 +301,29 @@ err:
 	return ret;
 }
 
+int lg_probe(struct hid_device *hdev,
+				const struct hid_device_id *id)
+{
+	struct lg_driver *driver = container_of(hdev->driver,
+					struct lg_driver, hid_driver);
+
+	return lg_probe_driver(hdev, driver);
+}
+
+static int lg_set_probe(struct hid_device *hdev,
+				const struct hid_device_id *id)
+{
+	struct lg_driver_set *set = container_of(hdev->driver,
+					struct lg_driver_set, hid_driver);
+	struct lg_driver *driver;
+
+	driver = lg_find_driver_in_set(set, hdev, id);
+	if (!driver)
+		return -EINVAL;
+
+	return lg_probe_driver(hdev, driver);
+}
+
 void lg_remove(struct hid_device *hdev)
 {
 	struct lg_device *device = hid_get_drvdata(hdev);
@@ -195,6 +340,15 @@ static int __init lg_init(void)
 {
 	INIT_LIST_HEAD(&drivers.list);
 
+	lg_debugfs_root = debugfs_create_dir("hid-logitech", NULL);
+	lg_fault_init(lg_debugfs_root);
+	lg_unknown_init(lg_debugfs_root);
+	lg_stats_init(lg_debugfs_root);
+
+	/* The events are still available through the character devices */
+	if (lg_netlink_init())
+		pr_warn("Can't register the generic netlink family\n");
+
 	return 0;
 }
 
@@ -205,6 +359,11 @@ static void __exit lg_exit(void)
 	list_for_each_safe(cur, next, &drivers.list) {
 		lg_unregister_driver(list_entry(cur, struct lg_driver, list));
 	}
+
+	lg_netlink_exit();
+	debugfs_remove_recursive(lg_debugfs_root);
+	lg_unknown_exit();
+	lg_fault_exit();
 }
 
 module_init(lg_init);
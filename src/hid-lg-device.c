@@ -7,26 +7,20 @@
 
 #include <linux/hid.h>
 #include <linux/hid-lg-extended.h>
+#include <linux/kobject.h>
+#include <linux/kref.h>
 #include <linux/module.h>
+#include <linux/slab.h>
 #include <linux/spinlock.h>
+#include <linux/sysfs.h>
 #include <linux/workqueue.h>
 
-#define LG_DEVICE_BUFSIZE 32
-
-struct lg_device_buf {
-	u8 data[HID_MAX_BUFFER_SIZE];
-	size_t size;
-};
-
-struct lg_device_queue {
-	spinlock_t qlock;
-	u8 head;
-	u8 tail;
-	struct lg_device_buf queue[LG_DEVICE_BUFSIZE];
-	struct work_struct worker;
-
-	struct lg_device *main_device;
-};
+#include "hid-lg-cdev.h"
+#include "hid-lg-device.h"
+#include "hid-lg-fault.h"
+#include "hid-lg-netlink.h"
+#include "hid-lg-stats.h"
+#include "hid-lg-unknown.h"
 
 void lg_device_queue(struct lg_device *device, struct lg_device_queue *queue, const u8 *buffer,
 								size_t count)
@@ -41,24 +35,131 @@ void lg_device_queue(struct lg_device *device, struct lg_device_queue *queue, co
 
 	spin_lock_irqsave(&queue->qlock, flags);
 
+	if (queue->dead)
+		goto out_unlock;
+
 	memcpy(queue->queue[queue->head].data, buffer, count);
 	queue->queue[queue->head].size = count;
 	newhead = (queue->head + 1) % LG_DEVICE_BUFSIZE;
 
-	if (queue->head == queue->tail) {
+	if (queue != device->in_queue && lg_fault_queue_full()) {
+		hid_warn(device->hdev, "Queue is full");
+		lg_device_stats_inc(device->stats, queue_drops);
+	} else if (queue->head == queue->tail) {
 		queue->head = newhead;
 		schedule_work(&queue->worker);
 	} else if (newhead != queue->tail) {
 		queue->head = newhead;
 	} else {
 		hid_warn(device->hdev, "Queue is full");
+		lg_device_stats_inc(device->stats, queue_drops);
 	}
 
+out_unlock:
 	spin_unlock_irqrestore(&queue->qlock, flags);
 }
 EXPORT_SYMBOL_GPL(lg_device_queue);
 
-static ssize_t lg_device_hid_send(struct hid_device *hdev, u8 *buffer,
+struct lg_device_queue *lg_device_queue_create(struct lg_device *owner,
+						work_func_t worker)
+{
+	struct lg_device_queue *queue;
+
+	queue = kzalloc(sizeof(*queue), GFP_KERNEL);
+	if (!queue)
+		return NULL;
+
+	kref_init(&queue->ref);
+	queue->owner = owner;
+	spin_lock_init(&queue->qlock);
+	INIT_WORK(&queue->worker, worker);
+
+	return queue;
+}
+
+struct lg_device_queue *lg_device_queue_get(struct lg_device_queue *queue)
+{
+	kref_get(&queue->ref);
+
+	return queue;
+}
+
+static void lg_device_queue_release(struct kref *ref)
+{
+	kfree(container_of(ref, struct lg_device_queue, ref));
+}
+
+void lg_device_queue_put(struct lg_device_queue *queue)
+{
+	kref_put(&queue->ref, lg_device_queue_release);
+}
+
+/*
+ * Stops the queue for good: refuse new entries, wait for a running worker
+ * and drop whatever is still queued. Calling it more than once is harmless.
+ */
+void lg_device_queue_shutdown(struct lg_device_queue *queue)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&queue->qlock, flags);
+	queue->dead = 1;
+	spin_unlock_irqrestore(&queue->qlock, flags);
+
+	cancel_work_sync(&queue->worker);
+
+	spin_lock_irqsave(&queue->qlock, flags);
+	queue->tail = queue->head;
+	spin_unlock_irqrestore(&queue->qlock, flags);
+}
+
+/*
+ * Returns the oldest entry of the queue without removing it, or NULL when the
+ * queue is empty. Only the consumer of the queue may call this, the entry
+ * stays valid until lg_device_queue_pop is called.
+ */
+struct lg_device_buf *lg_device_queue_peek(struct lg_device_queue *queue)
+{
+	struct lg_device_buf *buf = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&queue->qlock, flags);
+
+	if (queue->head != queue->tail)
+		buf = &queue->queue[queue->tail];
+
+	spin_unlock_irqrestore(&queue->qlock, flags);
+
+	return buf;
+}
+
+void lg_device_queue_pop(struct lg_device_queue *queue)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&queue->qlock, flags);
+
+	if (queue->head != queue->tail)
+		queue->tail = (queue->tail + 1) % LG_DEVICE_BUFSIZE;
+
+	spin_unlock_irqrestore(&queue->qlock, flags);
+}
+
+/* The number of entries which can still be queued */
+unsigned int lg_device_queue_free(struct lg_device_queue *queue)
+{
+	unsigned long flags;
+	unsigned int free;
+
+	spin_lock_irqsave(&queue->qlock, flags);
+	free = (queue->tail + LG_DEVICE_BUFSIZE - queue->head - 1) %
+		LG_DEVICE_BUFSIZE;
+	spin_unlock_irqrestore(&queue->qlock, flags);
+
+	return free;
+}
+
+ssize_t lg_device_hid_send(struct hid_device *hdev, u8 *buffer,
 								size_t count)
 {
 	u8 *buf;
@@ -87,15 +188,21 @@ void lg_device_send_worker(struct work_struct *work)
 {
 	struct lg_device_queue *queue = container_of(work, struct lg_device_queue,
 								worker);
-	struct lg_device *device= queue->main_device;
+	struct lg_device *device= queue->owner;
+	struct lg_device_buf *buf;
 	unsigned long flags;
 
+	lg_device_stats_inc(device->stats, worker_runs);
+
 	spin_lock_irqsave(&queue->qlock, flags);
 
-	while (queue->head != queue->tail) {
+	while (queue->head != queue->tail && !queue->dead) {
 		spin_unlock_irqrestore(&queue->qlock, flags);
-		lg_device_hid_send(device->hdev, queue->queue[queue->tail].data,
-						queue->queue[queue->tail].size);
+		buf = &queue->queue[queue->tail];
+		if (lg_device_hid_send(device->hdev, buf->data, buf->size) >= 0) {
+			lg_device_stats_inc(device->stats, sent);
+			lg_device_stats_add(device->stats, bytes_sent, buf->size);
+		}
 		spin_lock_irqsave(&queue->qlock, flags);
 
 		queue->tail = (queue->tail + 1) % LG_DEVICE_BUFSIZE;
@@ -104,20 +211,75 @@ void lg_device_send_worker(struct work_struct *work)
 	spin_unlock_irqrestore(&queue->qlock, flags);
 }
 
+/* The HID++ 1.0 error codes, by the errno of the failed request */
+static const int lg_device_errors[] = {
+	[0x01] = -EIO,		/* Invalid sub id */
+	[0x02] = -EIO,		/* Invalid address, the register */
+	[0x03] = -EINVAL,	/* Invalid value */
+	[0x04] = -ENODEV,	/* Connection failed */
+	[0x05] = -EBUSY,	/* Too many devices */
+	[0x06] = -EBUSY,	/* Already exists */
+	[0x07] = -EBUSY,	/* Busy */
+	[0x08] = -ENODEV,	/* Unknown device */
+	[0x09] = -EBUSY,	/* Resource error */
+	[0x0a] = -EBUSY,	/* Request unavailable */
+	[0x0b] = -EINVAL,	/* Invalid parameter value */
+	[0x0c] = -EACCES,	/* Wrong PIN code */
+};
+
+/* Returns the errno for an error reply, 0 if the report isn't one */
+int lg_device_error_reply(const u8 *buffer, size_t count)
+{
+	if (count < 6 || buffer[2] != LG_DEVICE_ACTION_ERROR)
+		return 0;
+
+	if (buffer[5] < ARRAY_SIZE(lg_device_errors) &&
+			lg_device_errors[buffer[5]])
+		return lg_device_errors[buffer[5]];
+
+	return -EIO;
+}
+EXPORT_SYMBOL_GPL(lg_device_error_reply);
+
+/*
+ * Hands a report to the driver of the device, error replies to its
+ * error_handler when it has one.
+ */
+void lg_device_dispatch(struct lg_device *device, const u8 *buffer,
+			size_t count)
+{
+	int error = lg_device_error_reply(buffer, count);
+
+	if (error && device->driver->error_handler) {
+		device->driver->error_handler(device, buffer[3], buffer[4],
+					      error);
+		return;
+	}
+
+	if (device->driver->receive_handler)
+		device->driver->receive_handler(device, buffer, count);
+}
+EXPORT_SYMBOL_GPL(lg_device_dispatch);
+
 void lg_device_receive_worker(struct work_struct *work)
 {
 	struct lg_device_queue *queue = container_of(work, struct lg_device_queue,
 								worker);
-	struct lg_device *device= queue->main_device;
+	struct lg_device *device= queue->owner;
+	struct lg_device_buf *buf;
 	unsigned long flags;
 
+	lg_device_stats_inc(device->stats, worker_runs);
+
 	spin_lock_irqsave(&queue->qlock, flags);
 
-	while (queue->head != queue->tail) {
+	while (queue->head != queue->tail && !queue->dead) {
 		spin_unlock_irqrestore(&queue->qlock, flags);
-		if (device->driver->receive_handler)
-			device->driver->receive_handler(device, queue->queue[queue->tail].data,
-						queue->queue[queue->tail].size);
+		buf = &queue->queue[queue->tail];
+		if (lg_device_is_reply(buf->data, buf->size))
+			lg_device_stats_inc(device->stats, replies);
+		lg_cdev_receive(device, buf->data, buf->size);
+		lg_device_dispatch(device, buf->data, buf->size);
 		spin_lock_irqsave(&queue->qlock, flags);
 
 		queue->tail = (queue->tail + 1) % LG_DEVICE_BUFSIZE;
@@ -141,6 +303,12 @@ int lg_device_event(struct hid_device *hdev, struct hid_report *report,
 		return 0;
 	}
 
+	lg_device_stats_inc(device->stats, received);
+	lg_device_stats_add(device->stats, bytes_received, size);
+
+	if (lg_fault_event(device, raw_data, size))
+		return 0;
+
 	lg_device_queue(device, device->in_queue, raw_data, size);
 
 	return 0;
@@ -151,35 +319,51 @@ int lg_device_init(struct lg_device *device,
 					struct lg_driver *driver)
 {
 	int ret;
-	device->out_queue = kzalloc(sizeof(*device->out_queue), GFP_KERNEL);
+
+	device->stats = kzalloc(sizeof(*device->stats), GFP_KERNEL);
+	if (!device->stats) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	device->stats->hdev = hdev;
+
+	device->out_queue = lg_device_queue_create(device,
+						lg_device_send_worker);
 	if (!device->out_queue) {
 		ret = -ENOMEM;
-		goto err_free_dev;
+		goto err_free_stats;
 	}
 
-	device->in_queue = kzalloc(sizeof(*device->in_queue), GFP_KERNEL);
+	device->in_queue = lg_device_queue_create(device,
+						lg_device_receive_worker);
 	if (!device->in_queue) {
 		ret = -ENOMEM;
-		goto err_free_out;
+		goto err_put_out;
 	}
 
 	device->hdev = hdev;
 	device->driver = driver;
+	device->cdev = NULL;
+	device->unknown = NULL;
 	hid_set_drvdata(hdev, device);
 
-	device->out_queue->main_device = device;
-	spin_lock_init(&device->out_queue->qlock);
-	INIT_WORK(&device->out_queue->worker, lg_device_send_worker);
+	if (lg_cdev_create(device))
+		hid_warn(hdev, "Can't create the HID++ character device\n");
+
+	if (lg_unknown_create(device))
+		hid_warn(hdev, "Can't keep the unhandled reports\n");
 
-	device->in_queue->main_device = device;
-	spin_lock_init(&device->in_queue->qlock);
-	INIT_WORK(&device->in_queue->worker, lg_device_receive_worker);
+	lg_stats_register(device->stats);
 
 	return 0;
-err_free_out:
-	kfree(device->out_queue);
-err_free_dev:
-	kfree(device);
+err_put_out:
+	lg_device_queue_put(device->out_queue);
+	device->out_queue = NULL;
+err_free_stats:
+	kfree(device->stats);
+	device->stats = NULL;
+err:
 	return ret;
 }
 EXPORT_SYMBOL_GPL(lg_device_init);
@@ -188,34 +372,269 @@ int lg_device_init_copy(struct lg_device *device,
 					struct lg_device *from,
 					struct lg_driver *driver)
 {
-	device->out_queue = from->out_queue;
-	device->in_queue = from->in_queue;
+	device->out_queue = lg_device_queue_get(from->out_queue);
+	device->in_queue = lg_device_queue_get(from->in_queue);
 	device->hdev = from->hdev;
 	device->driver = driver;
+	device->cdev = NULL;
+	device->unknown = NULL;
+	device->stats = from->stats;
 
 	return 0;
 }
 EXPORT_SYMBOL_GPL(lg_device_init_copy);
 
+/*
+ * Teardown happens in a fixed order: the owner of a queue first stops it,
+ * which cancels the worker and drains it, and only then the reference is
+ * dropped. A copied device only drops its references.
+ */
 void lg_device_destroy(struct lg_device *device)
 {
-	if (device->in_queue) {
-		if (device != device->in_queue->main_device)
-			return;
-	} else if (device->out_queue) {
-		if (device != device->out_queue->main_device)
-			return;
+	bool owner = device->in_queue && device->in_queue->owner == device;
+
+	if (owner) {
+		hid_set_drvdata(device->hdev, NULL);
+		lg_device_queue_shutdown(device->in_queue);
+		lg_cdev_destroy(device);
+		lg_unknown_destroy(device);
 	}
-	if (device->in_queue && device->out_queue) {
-		cancel_work_sync(&device->in_queue->worker);
-		cancel_work_sync(&device->out_queue->worker);
+
+	if (device->out_queue && device->out_queue->owner == device)
+		lg_device_queue_shutdown(device->out_queue);
+
+	if (device->in_queue) {
+		lg_device_queue_put(device->in_queue);
+		device->in_queue = NULL;
 	}
 
-	if (device->in_queue)
-		kfree(device->in_queue);
-	if (device->out_queue)
-		kfree(device->out_queue);
+	if (device->out_queue) {
+		lg_device_queue_put(device->out_queue);
+		device->out_queue = NULL;
+	}
 
-	hid_set_drvdata(device->hdev, NULL);
+	/* The workers are stopped, nothing counts anymore */
+	if (owner) {
+		lg_stats_unregister(device->stats);
+		kfree(device->stats);
+	}
+	device->stats = NULL;
 }
 EXPORT_SYMBOL_GPL(lg_device_destroy);
+
+#define to_lg_device_attr(_attr) container_of(_attr,			\
+				struct lg_device_attribute, attr)
+
+ssize_t lg_device_attr_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct lg_device *device = dev_get_drvdata(dev);
+	struct lg_device_attribute *lg_attr = to_lg_device_attr(attr);
+
+	if (!device)
+		return -ENODEV;
+
+	if (!lg_attr->show)
+		return -EIO;
+
+	return lg_attr->show(device, buf);
+}
+EXPORT_SYMBOL_GPL(lg_device_attr_show);
+
+ssize_t lg_device_attr_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct lg_device *device = dev_get_drvdata(dev);
+	struct lg_device_attribute *lg_attr = to_lg_device_attr(attr);
+
+	if (!device)
+		return -ENODEV;
+
+	if (!lg_attr->store)
+		return -EIO;
+
+	return lg_attr->store(device, buf, count);
+}
+EXPORT_SYMBOL_GPL(lg_device_attr_store);
+
+/*
+ * The kobject of a device on a receiver. Sysfs and uevent users can hold a
+ * reference after the device itself is freed, so it is allocated on its own
+ * and freed by its release. The device is only used by show and store, which
+ * aren't called anymore once kobject_del returned.
+ */
+struct lg_device_kobj {
+	struct kobject kobj;
+	struct lg_device *device;
+};
+
+#define to_lg_device_kobj(_kobj) container_of(_kobj,			\
+				struct lg_device_kobj, kobj)
+
+static ssize_t lg_device_kobj_show(struct kobject *kobj,
+				struct attribute *attr, char *buf)
+{
+	struct lg_device *device = to_lg_device_kobj(kobj)->device;
+	struct lg_device_attribute *lg_attr = to_lg_device_attr(
+			container_of(attr, struct device_attribute, attr));
+
+	if (!lg_attr->show)
+		return -EIO;
+
+	return lg_attr->show(device, buf);
+}
+
+static ssize_t lg_device_kobj_store(struct kobject *kobj,
+				struct attribute *attr,
+				const char *buf, size_t count)
+{
+	struct lg_device *device = to_lg_device_kobj(kobj)->device;
+	struct lg_device_attribute *lg_attr = to_lg_device_attr(
+			container_of(attr, struct device_attribute, attr));
+
+	if (!lg_attr->store)
+		return -EIO;
+
+	return lg_attr->store(device, buf, count);
+}
+
+static const struct sysfs_ops lg_device_sysfs_ops = {
+	.show = lg_device_kobj_show,
+	.store = lg_device_kobj_store,
+};
+
+static void lg_device_kobj_release(struct kobject *kobj)
+{
+	kfree(to_lg_device_kobj(kobj));
+}
+
+static struct kobj_type lg_device_ktype = {
+	.release = lg_device_kobj_release,
+	.sysfs_ops = &lg_device_sysfs_ops,
+};
+
+static void lg_device_sysfs_uevent(struct lg_device *device,
+				const char *action)
+{
+	char name_env[64];
+	char action_env[32];
+	char *envp[] = { name_env, action_env, NULL };
+
+	snprintf(name_env, sizeof(name_env), "LG_SUBDEVICE=%s",
+				kobject_name(device->kobj));
+	snprintf(action_env, sizeof(action_env), "LG_SUBDEVICE_ACTION=%s",
+				action);
+
+	kobject_uevent_env(&device->hdev->dev.kobj, KOBJ_CHANGE, envp);
+}
+
+/*
+ * Creates the attributes of the device. Without a name they are placed on the
+ * hid_device itself, with a name they get their own kobject below it. The
+ * latter is used for devices connected through a receiver.
+ */
+int lg_device_sysfs_create(struct lg_device *device, const char *name,
+				const struct attribute_group *group)
+{
+	struct lg_device_kobj *device_kobj;
+	int ret;
+
+	if (!name)
+		return sysfs_create_group(&device->hdev->dev.kobj, group);
+
+	device_kobj = kzalloc(sizeof(*device_kobj), GFP_KERNEL);
+	if (!device_kobj)
+		return -ENOMEM;
+
+	device_kobj->device = device;
+
+	ret = kobject_init_and_add(&device_kobj->kobj, &lg_device_ktype,
+				&device->hdev->dev.kobj, "%s", name);
+	if (ret)
+		goto err_put;
+
+	ret = sysfs_create_group(&device_kobj->kobj, group);
+	if (ret)
+		goto err_del;
+
+	device->kobj = &device_kobj->kobj;
+	lg_device_sysfs_uevent(device, "add");
+
+	return 0;
+err_del:
+	kobject_del(&device_kobj->kobj);
+err_put:
+	/* Frees device_kobj through the release */
+	kobject_put(&device_kobj->kobj);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lg_device_sysfs_create);
+
+void lg_device_sysfs_remove(struct lg_device *device,
+				const struct attribute_group *group)
+{
+	if (!device->kobj) {
+		sysfs_remove_group(&device->hdev->dev.kobj, group);
+		return;
+	}
+
+	lg_device_sysfs_uevent(device, "remove");
+
+	sysfs_remove_group(device->kobj, group);
+	kobject_del(device->kobj);
+	kobject_put(device->kobj);
+	device->kobj = NULL;
+}
+EXPORT_SYMBOL_GPL(lg_device_sysfs_remove);
+
+/* Wakes up the pollers of an attribute, after its value changed */
+void lg_device_sysfs_notify(struct lg_device *device, const char *attr)
+{
+	if (device->kobj)
+		sysfs_notify(device->kobj, NULL, attr);
+	else
+		sysfs_notify(&device->hdev->dev.kobj, NULL, attr);
+}
+EXPORT_SYMBOL_GPL(lg_device_sysfs_notify);
+
+/*
+ * Posts an event of a device, which can be a device behind a receiver, to the
+ * event ring of the character device and to netlink. The devnum is taken
+ * from the report.
+ */
+void lg_device_post_event(struct lg_device *device, u16 type, u32 value,
+			  const u8 *buffer, size_t count)
+{
+	struct lg_device *owner = hid_get_drvdata(device->hdev);
+
+	if (!owner || count < 2)
+		return;
+
+	lg_cdev_event(owner, type, value, buffer, count);
+	lg_netlink_event(device, type, value, buffer, count);
+}
+EXPORT_SYMBOL_GPL(lg_device_post_event);
+
+/*
+ * For the reports no handler of the driver knows. They are counted and kept
+ * in debugfs, posted as an event and only logged ratelimited, so a chatty
+ * device can't flood the log.
+ */
+void lg_device_unhandled(struct lg_device *device, const char *kind,
+			 const u8 *buffer, size_t count)
+{
+	struct lg_device *owner = hid_get_drvdata(device->hdev);
+
+	if (owner)
+		lg_unknown_record(owner, buffer, count);
+
+	if (lg_device_is_reply(buffer, count))
+		lg_device_stats_inc(device->stats, replies_unmatched);
+
+	dev_warn_ratelimited(&device->hdev->dev,
+			     "Unhandled %s message %02x %02x\n", kind,
+			     buffer[2], buffer[3]);
+	lg_device_post_event(device, LG_HIDPP_EVENT_UNKNOWN, 0, buffer, count);
+}
+EXPORT_SYMBOL_GPL(lg_device_unhandled);
@@ -0,0 +1,64 @@
+#ifndef __HID_LG_DEVICE
+#define __HID_LG_DEVICE
+
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/hid.h>
+#include <linux/hid-lg-extended.h>
+#include <linux/kref.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+#define LG_DEVICE_BUFSIZE 32
+
+/* HID++ replies have the msb of the sub id set, notifications don't */
+#define lg_device_is_reply(buffer, count) ((count) > 2 && ((buffer)[2] & 0x80))
+
+struct lg_device_buf {
+	u8 data[HID_MAX_BUFFER_SIZE];
+	size_t size;
+};
+
+/*
+ * Queues are shared between a device and the devices created on top of it
+ * using lg_device_init_copy, so they are reference counted. Only the owner,
+ * the device which created the queue, shuts it down. After the shutdown
+ * nothing can be queued anymore and the worker won't run again, the memory
+ * is freed when the last reference is dropped.
+ */
+struct lg_device_queue {
+	struct kref ref;
+	spinlock_t qlock;
+	u8 head;
+	u8 tail;
+	u8 dead;
+	struct lg_device_buf queue[LG_DEVICE_BUFSIZE];
+	struct work_struct worker;
+
+	struct lg_device *owner;
+};
+
+struct lg_device_queue *lg_device_queue_create(struct lg_device *owner,
+						work_func_t worker);
+
+struct lg_device_queue *lg_device_queue_get(struct lg_device_queue *queue);
+
+void lg_device_queue_put(struct lg_device_queue *queue);
+
+void lg_device_queue_shutdown(struct lg_device_queue *queue);
+
+struct lg_device_buf *lg_device_queue_peek(struct lg_device_queue *queue);
+
+void lg_device_queue_pop(struct lg_device_queue *queue);
+
+unsigned int lg_device_queue_free(struct lg_device_queue *queue);
+
+ssize_t lg_device_hid_send(struct hid_device *hdev, u8 *buffer,
+								size_t count);
+
+#endif
@@ -0,0 +1,230 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <asm/atomic.h>
+#include <linux/debugfs.h>
+#include <linux/hid.h>
+#include <linux/hid-lg-extended.h>
+#include <linux/list.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+#include "hid-lg-device.h"
+#include "hid-lg-fault.h"
+
+/*
+ * Fault injection for the replies of the devices, controlled through the
+ * fault directory in debugfs (hid-logitech/fault):
+ *
+ *   drop_every       drop every Nth reply
+ *   delay_ms         hold every reply back for this long
+ *   duplicate_every  handle every Nth reply twice
+ *   out_queue_full   refuse everything queued for sending
+ *
+ * Zero disables a fault. Only replies (set, get and error reports) are
+ * affected, notifications and logons pass untouched. The counters dropped,
+ * delayed, duplicated and rejected tell how often every fault was applied.
+ */
+
+#define LG_FAULT_MAX_DELAYED 256
+
+#define LG_FAULT_ACTION_ERROR 0x8F
+
+struct lg_fault_delayed {
+	struct list_head list;
+	struct lg_device_queue *queue;
+	unsigned long due;
+	size_t count;
+	u8 data[];
+};
+
+static u32 drop_every;
+static u32 delay_ms;
+static u32 duplicate_every;
+static bool out_queue_full;
+
+static atomic_t replies;
+static atomic_t dropped;
+static atomic_t delayed;
+static atomic_t duplicated;
+static atomic_t rejected;
+
+static LIST_HEAD(delayed_list);
+static DEFINE_SPINLOCK(delayed_lock);
+static unsigned int delayed_count;
+
+static void lg_fault_delay_worker(struct work_struct *work);
+static DECLARE_DELAYED_WORK(delay_worker, lg_fault_delay_worker);
+
+static bool lg_fault_is_reply(const u8 *buffer, size_t count)
+{
+	if (count < 3 || (buffer[0] != 0x10 && buffer[0] != 0x11))
+		return false;
+
+	return buffer[2] == LG_DEVICE_ACTION_SET ||
+		buffer[2] == LG_DEVICE_ACTION_GET ||
+		buffer[2] == LG_FAULT_ACTION_ERROR;
+}
+
+/* Hands the due replies to the in_queue they were meant for */
+static void lg_fault_delay_worker(struct work_struct *work)
+{
+	struct lg_fault_delayed *entry;
+	unsigned long flags;
+
+	spin_lock_irqsave(&delayed_lock, flags);
+
+	while (!list_empty(&delayed_list)) {
+		entry = list_first_entry(&delayed_list,
+					 struct lg_fault_delayed, list);
+		if (time_before(jiffies, entry->due)) {
+			schedule_delayed_work(&delay_worker,
+					      entry->due - jiffies);
+			break;
+		}
+
+		list_del(&entry->list);
+		delayed_count--;
+		spin_unlock_irqrestore(&delayed_lock, flags);
+
+		/* A dead queue refuses the entry without touching its owner */
+		lg_device_queue(entry->queue->owner, entry->queue, entry->data,
+				entry->count);
+		lg_device_queue_put(entry->queue);
+		kfree(entry);
+
+		spin_lock_irqsave(&delayed_lock, flags);
+	}
+
+	spin_unlock_irqrestore(&delayed_lock, flags);
+}
+
+static int lg_fault_delay(struct lg_device *device, const u8 *buffer,
+			  size_t count)
+{
+	struct lg_fault_delayed *entry;
+	unsigned long flags;
+	int first;
+
+	entry = kmalloc(sizeof(*entry) + count, GFP_ATOMIC);
+	if (!entry)
+		return -ENOMEM;
+
+	entry->queue = lg_device_queue_get(device->in_queue);
+	entry->due = jiffies + msecs_to_jiffies(delay_ms);
+	entry->count = count;
+	memcpy(entry->data, buffer, count);
+
+	spin_lock_irqsave(&delayed_lock, flags);
+
+	if (delayed_count == LG_FAULT_MAX_DELAYED) {
+		spin_unlock_irqrestore(&delayed_lock, flags);
+		lg_device_queue_put(entry->queue);
+		kfree(entry);
+		return -ENOSPC;
+	}
+
+	first = list_empty(&delayed_list);
+	list_add_tail(&entry->list, &delayed_list);
+	delayed_count++;
+
+	spin_unlock_irqrestore(&delayed_lock, flags);
+
+	if (first)
+		schedule_delayed_work(&delay_worker, msecs_to_jiffies(delay_ms));
+
+	return 0;
+}
+
+/*
+ * Called for every report received from a device. Returns 1 when the report
+ * shouldn't be queued by the caller, because it is dropped or delayed. A
+ * duplicate is queued here, the original is left to the caller.
+ */
+int lg_fault_event(struct lg_device *device, const u8 *buffer, size_t count)
+{
+	unsigned int n;
+
+	if (!drop_every && !delay_ms && !duplicate_every)
+		return 0;
+
+	if (!lg_fault_is_reply(buffer, count))
+		return 0;
+
+	n = atomic_inc_return(&replies);
+
+	if (drop_every && !(n % drop_every)) {
+		atomic_inc(&dropped);
+		return 1;
+	}
+
+	if (duplicate_every && !(n % duplicate_every)) {
+		atomic_inc(&duplicated);
+		lg_device_queue(device, device->in_queue, buffer, count);
+	}
+
+	if (delay_ms) {
+		if (lg_fault_delay(device, buffer, count)) {
+			atomic_inc(&dropped);
+			return 1;
+		}
+
+		atomic_inc(&delayed);
+		return 1;
+	}
+
+	return 0;
+}
+
+bool lg_fault_queue_full(void)
+{
+	if (!out_queue_full)
+		return false;
+
+	atomic_inc(&rejected);
+	return true;
+}
+
+void lg_fault_init(struct dentry *root)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("fault", root);
+
+	debugfs_create_u32("drop_every", 0644, dir, &drop_every);
+	debugfs_create_u32("delay_ms", 0644, dir, &delay_ms);
+	debugfs_create_u32("duplicate_every", 0644, dir, &duplicate_every);
+	debugfs_create_bool("out_queue_full", 0644, dir, &out_queue_full);
+
+	debugfs_create_atomic_t("dropped", 0444, dir, &dropped);
+	debugfs_create_atomic_t("delayed", 0444, dir, &delayed);
+	debugfs_create_atomic_t("duplicated", 0444, dir, &duplicated);
+	debugfs_create_atomic_t("rejected", 0444, dir, &rejected);
+}
+
+/* The debugfs files have to be removed already */
+void lg_fault_exit(void)
+{
+	struct lg_fault_delayed *entry;
+	struct list_head *cur, *next;
+
+	drop_every = 0;
+	delay_ms = 0;
+	duplicate_every = 0;
+	out_queue_full = false;
+
+	cancel_delayed_work_sync(&delay_worker);
+
+	list_for_each_safe(cur, next, &delayed_list) {
+		entry = list_entry(cur, struct lg_fault_delayed, list);
+		list_del(&entry->list);
+		lg_device_queue_put(entry->queue);
+		kfree(entry);
+	}
+	delayed_count = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef __HID_LG_FAULT
+#define __HID_LG_FAULT
+
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/hid-lg-extended.h>
+
+#ifdef CONFIG_DEBUG_FS
+
+void lg_fault_init(struct dentry *root);
+
+void lg_fault_exit(void);
+
+int lg_fault_event(struct lg_device *device, const u8 *buffer, size_t count);
+
+bool lg_fault_queue_full(void);
+
+#else
+
+static inline void lg_fault_init(struct dentry *root)
+{
+}
+
+static inline void lg_fault_exit(void)
+{
+}
+
+static inline int lg_fault_event(struct lg_device *device, const u8 *buffer,
+				 size_t count)
+{
+	return 0;
+}
+
+static inline bool lg_fault_queue_full(void)
+{
+	return false;
+}
+
+#endif
+
+#endif
@@ -14,11 +14,13 @@
 struct lg_mx_revolution {
 	struct lg_device device;
 	wait_queue_head_t received;
+	int error;
 	u8 devnum;
 	u8 initialized;
-	struct attribute_group attr_group;
+	const char *name;
 
 	short battery_level;
+	short battery_notified;
 	u8 scrollmode_set;
 	u8 scrollmode[3];
 };
@@ -34,6 +36,9 @@ void lg_mx_revolution_exit(struct lg_device *device);
 void lg_mx_revolution_handle(struct lg_device *device, const u8 *buffer,
 								size_t count);
 
+void lg_mx_revolution_handle_error(struct lg_device *device, u8 action,
+				   u8 reg, int error);
+
 static struct lg_driver driver = {
 	.name = "logitech-mx-revolution",
 	.device_name = "Logitech MX Revolution",
@@ -45,79 +50,103 @@ static struct lg_driver driver = {
 	.init_on_receiver = lg_mx_revolution_init_on_receiver,
 	.exit = lg_mx_revolution_exit,
 	.receive_handler = lg_mx_revolution_handle,
+	.error_handler = lg_mx_revolution_handle_error,
 };
 
 #define get_on_lg_device(device) container_of( 				\
 			lg_find_device_on_lg_device(device, driver.device_id),\
 			struct lg_mx_revolution, device)
 
-#define get_on_device(device) container_of( 				\
-			lg_find_device_on_device(device, driver.device_id),\
+#define get_on_device(lg_device) container_of(lg_device,			\
 			struct lg_mx_revolution, device)
 
 struct lg_mx_revolution_handler {
 	u8 action;
 	u8 first;
+	u8 size;
 	void (*func)(struct lg_mx_revolution *mouse, const u8 *payload, size_t size);
 };
 
-static int lg_mx_revolution_request_battery(struct lg_mx_revolution *mouse)
+/*
+ * The send functions only queue the request, so several can be on their way
+ * at the same time. The request functions also wait for the reply.
+ */
+static void lg_mx_revolution_send_battery(struct lg_mx_revolution *mouse)
 {
 	u8 cmd[7] = { 0x10, 0x01, LG_DEVICE_ACTION_GET, 0x0d, 0x00, 0x00, 0x00 };
 
 	cmd[1] = mouse->devnum;
 	mouse->battery_level = -1;
 	lg_device_queue_out(mouse->device, cmd, sizeof(cmd));
-
-	return wait_event_interruptible(mouse->received,
-				 mouse->battery_level >= 0);
 }
 
-static int lg_mx_revolution_request_scrollmode(struct lg_mx_revolution *mouse)
+static void lg_mx_revolution_send_scrollmode(struct lg_mx_revolution *mouse)
 {
 	u8 cmd[7] = { 0x10, 0x01, LG_DEVICE_ACTION_GET, 0x56, 0x00, 0x00, 0x00 };
 
 	if (mouse->scrollmode_set)
-		return 0;
+		return;
 
 	cmd[1] = mouse->devnum;
 	lg_device_queue_out(mouse->device, cmd, sizeof(cmd));
+}
 
-	return wait_event_interruptible(mouse->received,
-				 mouse->scrollmode_set);
+static int lg_mx_revolution_request_battery(struct lg_mx_revolution *mouse)
+{
+	mouse->error = 0;
+	lg_mx_revolution_send_battery(mouse);
+
+	return lg_device_wait_reply(mouse->device, mouse->received,
+				 mouse->battery_level >= 0, mouse->error);
+}
+
+static int lg_mx_revolution_request_scrollmode(struct lg_mx_revolution *mouse)
+{
+	mouse->error = 0;
+	lg_mx_revolution_send_scrollmode(mouse);
+
+	return lg_device_wait_reply(mouse->device, mouse->received,
+				 mouse->scrollmode_set, mouse->error);
 }
 
-static ssize_t mouse_show_battery(struct device *device,
-			struct device_attribute *attr, char *buf)
+static int lg_mx_revolution_request_status(struct lg_mx_revolution *mouse)
+{
+	mouse->error = 0;
+	lg_mx_revolution_send_battery(mouse);
+	lg_mx_revolution_send_scrollmode(mouse);
+
+	return lg_device_wait_reply(mouse->device, mouse->received,
+				 mouse->battery_level >= 0 &&
+				 mouse->scrollmode_set, mouse->error);
+}
+
+static ssize_t mouse_show_battery(struct lg_device *device, char *buf)
 {
 	struct lg_mx_revolution *mouse = get_on_device(device);
+	int ret;
 
-	if (lg_mx_revolution_request_battery(mouse))
-		return 0;
+	ret = lg_mx_revolution_request_battery(mouse);
+	if (ret)
+		return ret;
 
 	return scnprintf(buf, PAGE_SIZE, "%d%%\n", mouse->battery_level);
 }
 
-static DEVICE_ATTR(battery, 0444, mouse_show_battery, NULL);
+static LG_DEVICE_ATTR(battery, 0444, mouse_show_battery, NULL);
 
-static ssize_t mouse_show_name(struct device *device,
-			struct device_attribute *attr, char *buf)
+static ssize_t mouse_show_name(struct lg_device *device, char *buf)
 {
 	return scnprintf(buf, PAGE_SIZE, "%s\n", driver.device_name);
 }
 
-static DEVICE_ATTR(name, 0444, mouse_show_name, NULL);
+static LG_DEVICE_ATTR(name, 0444, mouse_show_name, NULL);
 
-static ssize_t mouse_show_scrollmode(struct device *device,
-			struct device_attribute *attr, char *buf)
+static ssize_t mouse_format_scrollmode(struct lg_mx_revolution *mouse,
+		char *buf, ssize_t size)
 {
 	u8 mode;
 	ssize_t length, remaining;
 	char *startbuf;
-	struct lg_mx_revolution *mouse = get_on_device(device);
-
-	if (lg_mx_revolution_request_scrollmode(mouse))
-		return 0;
 
 	startbuf = buf;
 	mode = mouse->scrollmode[0];
@@ -125,10 +154,10 @@ static ssize_t mouse_show_scrollmode(struct device *device,
 	// msb determines if the setting is temp or default
 	// (0 is temp, 1 is deault)
 	if (mode < 0x80)
-		length = scnprintf(buf, PAGE_SIZE, "temp ");
+		length = scnprintf(buf, size, "temp ");
 	else
-		length = scnprintf(buf, PAGE_SIZE, "default ");
-	remaining = PAGE_SIZE - length;
+		length = scnprintf(buf, size, "default ");
+	remaining = size - length;
 	buf += length;
 
 	mode = (mode | 0xF0) - 0xF0;
@@ -170,7 +199,7 @@ static ssize_t mouse_show_scrollmode(struct device *device,
 				(mouse->scrollmode[1] | 0xF0) - 0xF0);
 	}
 
-	if (length < PAGE_SIZE) {
+	if (length < size) {
 		startbuf[length] = '\n';
 		length++;
 	}
@@ -178,8 +207,20 @@ static ssize_t mouse_show_scrollmode(struct device *device,
 	return length;
 }
 
-static ssize_t mouse_store_scrollmode(struct device *device,
-		struct device_attribute *attr, const char *buf, size_t count)
+static ssize_t mouse_show_scrollmode(struct lg_device *device, char *buf)
+{
+	struct lg_mx_revolution *mouse = get_on_device(device);
+	int ret;
+
+	ret = lg_mx_revolution_request_scrollmode(mouse);
+	if (ret)
+		return ret;
+
+	return mouse_format_scrollmode(mouse, buf, PAGE_SIZE);
+}
+
+static ssize_t mouse_store_scrollmode(struct lg_device *device,
+		const char *buf, size_t count)
 {
 	short int mode, set_default, first, second, param_count;
 	char cmd[7] = { 0x10, 0x01, LG_DEVICE_ACTION_SET, 0x56, 0x00, 0x00, 0x00 };
@@ -223,38 +264,76 @@ static ssize_t mouse_store_scrollmode(struct device *device,
 	return count;
 }
 
-static DEVICE_ATTR(scrollmode, 0644, mouse_show_scrollmode, mouse_store_scrollmode);
+static LG_DEVICE_ATTR(scrollmode, 0644, mouse_show_scrollmode, mouse_store_scrollmode);
+
+/* All the other attributes in one read, in the same format */
+static ssize_t mouse_show_status(struct lg_device *device, char *buf)
+{
+	struct lg_mx_revolution *mouse = get_on_device(device);
+	ssize_t length;
+	int ret;
+
+	ret = lg_mx_revolution_request_status(mouse);
+	if (ret)
+		return ret;
+
+	length = scnprintf(buf, PAGE_SIZE, "battery=%d%%\nname=%s\nscrollmode=",
+			   mouse->battery_level, driver.device_name);
+
+	return length + mouse_format_scrollmode(mouse, buf + length,
+						PAGE_SIZE - length);
+}
+
+static LG_DEVICE_ATTR(status, 0444, mouse_show_status, NULL);
 
 static struct attribute *mouse_attrs[] = {
-	&dev_attr_battery.attr,
-	&dev_attr_name.attr,
-	&dev_attr_scrollmode.attr,
+	&lg_dev_attr_battery.attr.attr,
+	&lg_dev_attr_name.attr.attr,
+	&lg_dev_attr_scrollmode.attr.attr,
+	&lg_dev_attr_status.attr.attr,
 	NULL,
 };
 
+static const struct attribute_group mouse_attr_group = {
+	.attrs = mouse_attrs,
+};
+
 static void mouse_handle_get_battery(
 		struct lg_mx_revolution *mouse, const u8 *buf,
 		size_t size)
 {
 	mouse->battery_level = buf[4];
+
+	if (mouse->battery_level != mouse->battery_notified) {
+		mouse->battery_notified = mouse->battery_level;
+		lg_device_sysfs_notify(&mouse->device, "battery");
+		lg_device_post_event(&mouse->device, LG_HIDPP_EVENT_BATTERY,
+				     mouse->battery_level, buf, size);
+	}
 }
 
 static void mouse_handle_scrollmode(
 		struct lg_mx_revolution *mouse, const u8 *buf,
 		size_t size)
 {
+	if (mouse->scrollmode_set && !memcmp(mouse->scrollmode, &buf[4], 3))
+		return;
+
 	mouse->scrollmode[0] = buf[4];
 	mouse->scrollmode[1] = buf[5];
 	mouse->scrollmode[2] = buf[6];
 	mouse->scrollmode_set = 1;
+
+	lg_device_post_event(&mouse->device, LG_HIDPP_EVENT_SCROLLMODE,
+			     buf[4] | buf[5] << 8 | buf[6] << 16, buf, size);
 }
 
 static struct lg_mx_revolution_handler lg_mx_revolution_handlers[] = {
-	{ .action = LG_DEVICE_ACTION_GET, .first = 0x0d,
+	{ .action = LG_DEVICE_ACTION_GET, .first = 0x0d, .size = 5,
 		.func = mouse_handle_get_battery },
-	{ .action = LG_DEVICE_ACTION_GET, .first = 0x56,
+	{ .action = LG_DEVICE_ACTION_GET, .first = 0x56, .size = 7,
 		.func = mouse_handle_scrollmode },
-	{ .action = LG_DEVICE_ACTION_SET, .first = 0x56,
+	{ .action = LG_DEVICE_ACTION_SET, .first = 0x56, .size = 7,
 		.func = mouse_handle_scrollmode },
 	{ }
 };
@@ -267,6 +346,11 @@ void lg_mx_revolution_handle(struct lg_device *device, const u8 *buffer,
 	struct lg_mx_revolution *mouse;
 	struct lg_mx_revolution_handler *handler;
 
+	if (count < 4) {
+		lg_device_err((*device), "Too few bytes to handle");
+		return;
+	}
+
 	mouse = get_on_lg_device(device);
 
 	for (i = 0; lg_mx_revolution_handlers[i].action ||
@@ -274,18 +358,42 @@ void lg_mx_revolution_handle(struct lg_device *device, const u8 *buffer,
 		handler = &lg_mx_revolution_handlers[i];
 		if (handler->action == buffer[2] &&
 				handler->first == buffer[3]) {
-			if (handler->func != LG_DEVICE_HANDLER_IGNORE)
+			if (count < handler->size)
+				lg_device_err((*device), "Too short mouse message %02x %02x", buffer[2], buffer[3]);
+			else if (handler->func != LG_DEVICE_HANDLER_IGNORE)
 				handler->func(mouse, buffer, count);
 			handeld = 1;
 		}
 	}
 
 	if (!handeld)
-		lg_device_err((*device), "Unhandeld mouse message %02x %02x", buffer[2], buffer[3]);
+		lg_device_unhandled(device, "mouse", buffer, count);
 
 	wake_up_interruptible(&mouse->received);
 }
 
+/* Fails the waiting request if the error is for one of the handled replies */
+void lg_mx_revolution_handle_error(struct lg_device *device, u8 action,
+				   u8 reg, int error)
+{
+	struct lg_mx_revolution *mouse;
+	struct lg_mx_revolution_handler *handler;
+
+	mouse = get_on_lg_device(device);
+
+	for (handler = lg_mx_revolution_handlers; handler->action ||
+			handler->first; handler++) {
+		if (handler->action == action && handler->first == reg) {
+			mouse->error = error;
+			wake_up_interruptible(&mouse->received);
+			return;
+		}
+	}
+
+	lg_device_dbg((*device), "Error %d for mouse request %02x %02x",
+		      error, action, reg);
+}
+
 struct lg_mx_revolution *lg_mx_revolution_create(char *name)
 {
 	struct lg_mx_revolution *mouse;
@@ -296,10 +404,10 @@ struct lg_mx_revolution *lg_mx_revolution_create(char *name)
 
 	mouse->devnum = 1;
 	mouse->battery_level = -1;
+	mouse->battery_notified = -1;
 	mouse->scrollmode_set = 0;
 	mouse->initialized = 0;
-	mouse->attr_group.name = name;
-	mouse->attr_group.attrs = mouse_attrs;
+	mouse->name = name;
 	init_waitqueue_head(&mouse->received);
 
 	return mouse;
@@ -329,12 +437,14 @@ int lg_mx_revolution_init_new(struct hid_device *hdev)
 	if (ret)
 		goto error_free;
 
-	ret = sysfs_create_group(&mouse->device.hdev->dev.kobj,
-		&mouse->attr_group);
+	ret = lg_device_sysfs_create(&mouse->device, mouse->name,
+		&mouse_attr_group);
 	if (ret)
-		goto error_free;
+		goto error_destroy;
 
 	return ret;
+error_destroy:
+	lg_device_destroy(&mouse->device);
 error_free:
 	kfree(mouse);
 error:
@@ -350,8 +460,7 @@ void lg_mx_revolution_exit(struct lg_device *device)
 	if (mouse == NULL)
 		return;
 
-	sysfs_remove_group(&device->hdev->dev.kobj,
-		&mouse->attr_group);
+	lg_device_sysfs_remove(&mouse->device, &mouse_attr_group);
 
 	lg_mx_revolution_destroy(mouse);
 }
@@ -371,8 +480,8 @@ struct lg_device *lg_mx_revolution_init_on_receiver(
 	if (lg_device_init_copy(&mouse->device, device, &driver))
 		goto error_free;
 
-	if (sysfs_create_group(&mouse->device.hdev->dev.kobj,
-		&mouse->attr_group))
+	if (lg_device_sysfs_create(&mouse->device, mouse->name,
+		&mouse_attr_group))
 		goto error_free;
 
 	return &mouse->device;
@@ -14,11 +14,13 @@
 struct lg_mx5500_keyboard {
 	struct lg_device device;
 	wait_queue_head_t received;
+	int error;
 	u8 devnum;
 	u8 initialized;
-	struct attribute_group attr_group;
+	const char *name;
 
 	short battery_level;
+	short battery_notified;
 	short lcd_page;
 	short time[3];
 	short date[3];
@@ -35,6 +37,9 @@ void lg_mx5500_keyboard_exit(struct lg_device *device);
 void lg_mx5500_keyboard_handle(struct lg_device *device, const u8 *buffer,
 								size_t count);
 
+void lg_mx5500_keyboard_handle_error(struct lg_device *device, u8 action,
+				     u8 reg, int error);
+
 static struct lg_driver driver = {
 	.name = "logitech-mx5500",
 	.device_name = "Logitech MX5500",
@@ -46,47 +51,46 @@ static struct lg_driver driver = {
 	.init_on_receiver = lg_mx5500_keyboard_init_on_receiver,
 	.exit = lg_mx5500_keyboard_exit,
 	.receive_handler = lg_mx5500_keyboard_handle,
+	.error_handler = lg_mx5500_keyboard_handle_error,
 };
 
 #define get_on_lg_device(device) container_of( 				\
 			lg_find_device_on_lg_device(device, driver.device_id),\
 			struct lg_mx5500_keyboard, device)
 
-#define get_on_device(device) container_of( 				\
-			lg_find_device_on_device(device, driver.device_id),\
+#define get_on_device(lg_device) container_of(lg_device,			\
 			struct lg_mx5500_keyboard, device)
 
 struct lg_mx5500_keyboard_handler {
 	u8 action;
 	u8 first;
+	u8 size;
 	void (*func)(struct lg_mx5500_keyboard *keyboard, const u8 *payload, size_t size);
 };
 
-static int lg_mx5500_keyboard_request_battery(struct lg_mx5500_keyboard *keyboard)
+/*
+ * The send functions only queue the request, so several can be on their way
+ * at the same time. The request functions also wait for the reply.
+ */
+static void lg_mx5500_keyboard_send_battery(struct lg_mx5500_keyboard *keyboard)
 {
 	u8 cmd[7] = { 0x10, 0x01, LG_DEVICE_ACTION_GET, 0x0d, 0x00, 0x00, 0x00 };
 
 	cmd[1] = keyboard->devnum;
 	keyboard->battery_level = -1;
 	lg_device_queue_out(keyboard->device, cmd, sizeof(cmd));
-
-	return wait_event_interruptible(keyboard->received,
-				 keyboard->battery_level >= 0);
 }
 
-static int lg_mx5500_keyboard_request_time(struct lg_mx5500_keyboard *keyboard)
+static void lg_mx5500_keyboard_send_time(struct lg_mx5500_keyboard *keyboard)
 {
 	u8 cmd[7] = { 0x10, 0x01, LG_DEVICE_ACTION_GET, 0x31, 0x00, 0x00, 0x00 };
 
 	cmd[1] = keyboard->devnum;
 	keyboard->time[0] = -1;
 	lg_device_queue_out(keyboard->device, cmd, sizeof(cmd));
-
-	return wait_event_interruptible(keyboard->received,
-				 keyboard->time[0] >= 0);
 }
 
-static int lg_mx5500_keyboard_request_date(struct lg_mx5500_keyboard *keyboard)
+static void lg_mx5500_keyboard_send_date(struct lg_mx5500_keyboard *keyboard)
 {
 	u8 cmd[7] = { 0x10, 0x01, LG_DEVICE_ACTION_GET, 0x32, 0x00, 0x00, 0x00 };
 
@@ -96,26 +100,65 @@ static int lg_mx5500_keyboard_request_date(struct lg_mx5500_keyboard *keyboard)
 	lg_device_queue_out(keyboard->device, cmd, sizeof(cmd));
 	cmd[3] = 0x33;
 	lg_device_queue_out(keyboard->device, cmd, sizeof(cmd));
+}
+
+static int lg_mx5500_keyboard_request_battery(struct lg_mx5500_keyboard *keyboard)
+{
+	keyboard->error = 0;
+	lg_mx5500_keyboard_send_battery(keyboard);
 
-	return wait_event_interruptible(keyboard->received,
-				 keyboard->date[0] >= 0 && keyboard->date[1] >= 0);
+	return lg_device_wait_reply(keyboard->device, keyboard->received,
+				 keyboard->battery_level >= 0, keyboard->error);
 }
 
-static ssize_t keyboard_show_battery(struct device *device,
-			struct device_attribute *attr, char *buf)
+static int lg_mx5500_keyboard_request_time(struct lg_mx5500_keyboard *keyboard)
+{
+	keyboard->error = 0;
+	lg_mx5500_keyboard_send_time(keyboard);
+
+	return lg_device_wait_reply(keyboard->device, keyboard->received,
+				 keyboard->time[0] >= 0, keyboard->error);
+}
+
+static int lg_mx5500_keyboard_request_date(struct lg_mx5500_keyboard *keyboard)
+{
+	keyboard->error = 0;
+	lg_mx5500_keyboard_send_date(keyboard);
+
+	return lg_device_wait_reply(keyboard->device, keyboard->received,
+				 keyboard->date[0] >= 0 && keyboard->date[1] >= 0,
+				 keyboard->error);
+}
+
+static int lg_mx5500_keyboard_request_status(struct lg_mx5500_keyboard *keyboard)
+{
+	keyboard->error = 0;
+	lg_mx5500_keyboard_send_battery(keyboard);
+	lg_mx5500_keyboard_send_time(keyboard);
+	lg_mx5500_keyboard_send_date(keyboard);
+
+	return lg_device_wait_reply(keyboard->device, keyboard->received,
+				 keyboard->battery_level >= 0 &&
+				 keyboard->time[0] >= 0 &&
+				 keyboard->date[0] >= 0 && keyboard->date[1] >= 0,
+				 keyboard->error);
+}
+
+static ssize_t keyboard_show_battery(struct lg_device *device, char *buf)
 {
 	struct lg_mx5500_keyboard *keyboard = get_on_device(device);
+	int ret;
 
-	if (lg_mx5500_keyboard_request_battery(keyboard))
-		return 0;
+	ret = lg_mx5500_keyboard_request_battery(keyboard);
+	if (ret)
+		return ret;
 
 	return scnprintf(buf, PAGE_SIZE, "%d%%\n", keyboard->battery_level);
 }
 
-static DEVICE_ATTR(battery, 0444, keyboard_show_battery, NULL);
+static LG_DEVICE_ATTR(battery, 0444, keyboard_show_battery, NULL);
 
-static ssize_t keyboard_show_lcd_page(struct device *device,
-			struct device_attribute *attr, char *buf)
+static ssize_t keyboard_show_lcd_page(struct lg_device *device, char *buf)
 {
 	struct lg_mx5500_keyboard *keyboard;
 
@@ -124,30 +167,30 @@ static ssize_t keyboard_show_lcd_page(struct device *device,
 	return scnprintf(buf, PAGE_SIZE, "%d\n", keyboard->lcd_page);
 }
 
-static DEVICE_ATTR(lcd_page, 0444, keyboard_show_lcd_page, NULL);
+static LG_DEVICE_ATTR(lcd_page, 0444, keyboard_show_lcd_page, NULL);
 
-static ssize_t keyboard_show_name(struct device *device,
-			struct device_attribute *attr, char *buf)
+static ssize_t keyboard_show_name(struct lg_device *device, char *buf)
 {
 	return scnprintf(buf, PAGE_SIZE, "%s\n", driver.device_name);
 }
 
-static DEVICE_ATTR(name, 0444, keyboard_show_name, NULL);
+static LG_DEVICE_ATTR(name, 0444, keyboard_show_name, NULL);
 
-static ssize_t keyboard_show_time(struct device *device,
-		struct device_attribute *attr, char *buf)
+static ssize_t keyboard_show_time(struct lg_device *device, char *buf)
 {
 	struct lg_mx5500_keyboard *keyboard = get_on_device(device);
+	int ret;
 
-	if (lg_mx5500_keyboard_request_time(keyboard))
-		return 0;
+	ret = lg_mx5500_keyboard_request_time(keyboard);
+	if (ret)
+		return ret;
 
 	return scnprintf(buf, PAGE_SIZE, "%02hi:%02hi:%02hi\n", keyboard->time[0],
 		keyboard->time[1], keyboard->time[2]);
 }
 
-static ssize_t keyboard_store_time(struct device *device,
-		struct device_attribute *attr, const char *buf, size_t count)
+static ssize_t keyboard_store_time(struct lg_device *device,
+		const char *buf, size_t count)
 {
 	struct lg_mx5500_keyboard *keyboard;
 	u8 cmd[7] = { 0x10, 0x01, LG_DEVICE_ACTION_SET, 0x31, 0x00, 0x00, 0x00 };
@@ -171,22 +214,23 @@ static ssize_t keyboard_store_time(struct device *device,
 	return count;
 }
 
-static DEVICE_ATTR(time, 0644, keyboard_show_time, keyboard_store_time);
+static LG_DEVICE_ATTR(time, 0644, keyboard_show_time, keyboard_store_time);
 
-static ssize_t keyboard_show_date(struct device *device,
-		struct device_attribute *attr, char *buf)
+static ssize_t keyboard_show_date(struct lg_device *device, char *buf)
 {
 	struct lg_mx5500_keyboard *keyboard = get_on_device(device);
+	int ret;
 
-	if (lg_mx5500_keyboard_request_date(keyboard))
-		return 0;
+	ret = lg_mx5500_keyboard_request_date(keyboard);
+	if (ret)
+		return ret;
 
 	return scnprintf(buf, PAGE_SIZE, "20%02hi %hi %hi\n", keyboard->date[0],
 		keyboard->date[1] + 1, keyboard->date[2]);
 }
 
-static ssize_t keyboard_store_date(struct device *device,
-		struct device_attribute *attr, const char *buf, size_t count)
+static ssize_t keyboard_store_date(struct lg_device *device,
+		const char *buf, size_t count)
 {
 	struct lg_mx5500_keyboard *keyboard;
 	u8 cmd_day[7] = { 0x10, 0x01, LG_DEVICE_ACTION_SET, 0x32, 0x06, 0x00, 0x00 };
@@ -218,22 +262,59 @@ static ssize_t keyboard_store_date(struct device *device,
 	return count;
 }
 
-static DEVICE_ATTR(date, 0644, keyboard_show_date, keyboard_store_date);
+static LG_DEVICE_ATTR(date, 0644, keyboard_show_date, keyboard_store_date);
+
+/* All the other attributes in one read, in the same format */
+static ssize_t keyboard_show_status(struct lg_device *device, char *buf)
+{
+	struct lg_mx5500_keyboard *keyboard = get_on_device(device);
+	int ret;
+
+	ret = lg_mx5500_keyboard_request_status(keyboard);
+	if (ret)
+		return ret;
+
+	return scnprintf(buf, PAGE_SIZE,
+		"battery=%d%%\n"
+		"date=20%02hi %hi %hi\n"
+		"lcd_page=%d\n"
+		"name=%s\n"
+		"time=%02hi:%02hi:%02hi\n",
+		keyboard->battery_level,
+		keyboard->date[0], keyboard->date[1] + 1, keyboard->date[2],
+		keyboard->lcd_page,
+		driver.device_name,
+		keyboard->time[0], keyboard->time[1], keyboard->time[2]);
+}
+
+static LG_DEVICE_ATTR(status, 0444, keyboard_show_status, NULL);
 
 static struct attribute *keyboard_attrs[] = {
-	&dev_attr_battery.attr,
-	&dev_attr_date.attr,
-	&dev_attr_lcd_page.attr,
-	&dev_attr_name.attr,
-	&dev_attr_time.attr,
+	&lg_dev_attr_battery.attr.attr,
+	&lg_dev_attr_date.attr.attr,
+	&lg_dev_attr_lcd_page.attr.attr,
+	&lg_dev_attr_name.attr.attr,
+	&lg_dev_attr_status.attr.attr,
+	&lg_dev_attr_time.attr.attr,
 	NULL,
 };
 
+static const struct attribute_group keyboard_attr_group = {
+	.attrs = keyboard_attrs,
+};
+
 static void keyboard_handle_get_battery(
 		struct lg_mx5500_keyboard *keyboard, const u8 *buf,
 		size_t size)
 {
 	keyboard->battery_level = buf[4];
+
+	if (keyboard->battery_level != keyboard->battery_notified) {
+		keyboard->battery_notified = keyboard->battery_level;
+		lg_device_sysfs_notify(&keyboard->device, "battery");
+		lg_device_post_event(&keyboard->device, LG_HIDPP_EVENT_BATTERY,
+				     keyboard->battery_level, buf, size);
+	}
 }
 
 static void keyboard_handle_get_time(
@@ -265,18 +346,21 @@ static void keyboard_handle_lcd_page_changed_event(
 		size_t size)
 {
 	keyboard->lcd_page = buf[4];
+
+	lg_device_post_event(&keyboard->device, LG_HIDPP_EVENT_LCD_PAGE,
+			     keyboard->lcd_page, buf, size);
 }
 
 static struct lg_mx5500_keyboard_handler lg_mx5500_keyboard_handlers[] = {
-	{ .action = 0x0b, .first = 0x00,
+	{ .action = 0x0b, .first = 0x00, .size = 5,
 		.func = keyboard_handle_lcd_page_changed_event },
-	{ .action = LG_DEVICE_ACTION_GET, .first = 0x0d,
+	{ .action = LG_DEVICE_ACTION_GET, .first = 0x0d, .size = 5,
 		.func = keyboard_handle_get_battery },
-	{ .action = LG_DEVICE_ACTION_GET, .first = 0x31,
+	{ .action = LG_DEVICE_ACTION_GET, .first = 0x31, .size = 8,
 		.func = keyboard_handle_get_time },
-	{ .action = LG_DEVICE_ACTION_GET, .first = 0x32,
+	{ .action = LG_DEVICE_ACTION_GET, .first = 0x32, .size = 7,
 		.func = keyboard_handle_get_date_day },
-	{ .action = LG_DEVICE_ACTION_GET, .first = 0x33,
+	{ .action = LG_DEVICE_ACTION_GET, .first = 0x33, .size = 5,
 		.func = keyboard_handle_get_date_year },
 	{ }
 };
@@ -289,6 +373,11 @@ void lg_mx5500_keyboard_handle(struct lg_device *device, const u8 *buffer,
 	struct lg_mx5500_keyboard *keyboard;
 	struct lg_mx5500_keyboard_handler *handler;
 
+	if (count < 4) {
+		lg_device_err((*device), "Too few bytes to handle");
+		return;
+	}
+
 	keyboard = get_on_lg_device(device);
 
 	for (i = 0; lg_mx5500_keyboard_handlers[i].action ||
@@ -296,18 +385,42 @@ void lg_mx5500_keyboard_handle(struct lg_device *device, const u8 *buffer,
 		handler = &lg_mx5500_keyboard_handlers[i];
 		if (handler->action == buffer[2] &&
 				handler->first == buffer[3]) {
-			if (handler->func != LG_DEVICE_HANDLER_IGNORE)
+			if (count < handler->size)
+				lg_device_err((*device), "Too short keyboard message %02x %02x", buffer[2], buffer[3]);
+			else if (handler->func != LG_DEVICE_HANDLER_IGNORE)
 				handler->func(keyboard, buffer, count);
 			handeld = 1;
 		}
 	}
 
 	if (!handeld)
-		lg_device_err((*device), "Unhandeld keyboard message %02x %02x", buffer[2], buffer[3]);
+		lg_device_unhandled(device, "keyboard", buffer, count);
 
 	wake_up_interruptible(&keyboard->received);
 }
 
+/* Fails the waiting request if the error is for one of the handled replies */
+void lg_mx5500_keyboard_handle_error(struct lg_device *device, u8 action,
+				     u8 reg, int error)
+{
+	struct lg_mx5500_keyboard *keyboard;
+	struct lg_mx5500_keyboard_handler *handler;
+
+	keyboard = get_on_lg_device(device);
+
+	for (handler = lg_mx5500_keyboard_handlers; handler->action ||
+			handler->first; handler++) {
+		if (handler->action == action && handler->first == reg) {
+			keyboard->error = error;
+			wake_up_interruptible(&keyboard->received);
+			return;
+		}
+	}
+
+	lg_device_dbg((*device), "Error %d for keyboard request %02x %02x",
+		      error, action, reg);
+}
+
 struct lg_mx5500_keyboard *lg_mx5500_keyboard_create(char *name)
 {
 	struct lg_mx5500_keyboard *keyboard;
@@ -319,9 +432,9 @@ struct lg_mx5500_keyboard *lg_mx5500_keyboard_create(char *name)
 	keyboard->devnum = 1;
 	keyboard->lcd_page = 0;
 	keyboard->battery_level = -1;
+	keyboard->battery_notified = -1;
 	keyboard->initialized = 0;
-	keyboard->attr_group.name = name;
-	keyboard->attr_group.attrs = keyboard_attrs;
+	keyboard->name = name;
 	init_waitqueue_head(&keyboard->received);
 
 	return keyboard;
@@ -342,13 +455,14 @@ int lg_mx5500_keyboard_init_new(struct hid_device *hdev)
 	if (ret)
 		goto error_free;
 
-	ret = sysfs_create_group(&keyboard->device.hdev->dev.kobj,
-		&keyboard->attr_group);
+	ret = lg_device_sysfs_create(&keyboard->device, keyboard->name,
+		&keyboard_attr_group);
 	if (ret)
-		goto error_free;
-
+		goto error_destroy;
 
 	return ret;
+error_destroy:
+	lg_device_destroy(&keyboard->device);
 error_free:
 	kfree(keyboard);
 error:
@@ -373,8 +487,7 @@ void lg_mx5500_keyboard_exit(struct lg_device *device)
 	if (keyboard == NULL)
 		return;
 
-	sysfs_remove_group(&device->hdev->dev.kobj,
-		&keyboard->attr_group);
+	lg_device_sysfs_remove(&keyboard->device, &keyboard_attr_group);
 
 	lg_mx5500_keyboard_destroy(keyboard);
 }
@@ -393,8 +506,8 @@ struct lg_device *lg_mx5500_keyboard_init_on_receiver(
 	if (lg_device_init_copy(&keyboard->device, device, &driver))
 		goto error_free;
 
-	if (sysfs_create_group(&keyboard->device.hdev->dev.kobj,
-		&keyboard->attr_group))
+	if (lg_device_sysfs_create(&keyboard->device, keyboard->name,
+		&keyboard_attr_group))
 		goto error_free;
 
 	return &keyboard->device;
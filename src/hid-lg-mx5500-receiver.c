@@ -15,9 +15,7 @@ struct lg_mx5500_receiver {
 	u8 initialized;
 	u8 max_devices;
 
-	struct lg_device device;
-
-	struct lg_device *connected_devices[LG_MX5500_RECEIVER_MAX_DEVICES];
+	struct lg_receiver receiver;
 };
 
 int lg_mx5500_receiver_init_new(struct hid_device *hdev);
@@ -27,9 +25,6 @@ void lg_mx5500_receiver_exit(struct lg_device *device);
 void lg_mx5500_receiver_hid_receive(struct lg_device *device, const u8 *buffer,
 								size_t count);
 
-struct lg_device *lg_mx5500_receiver_find_device(struct lg_device *device,
-						 struct hid_device_id device_id);
-
 static struct lg_driver driver = {
 	.name = "logitech-mx5500-receiver",
 	.device_name = "Logitech MX5500 Receiver",
@@ -40,16 +35,18 @@ static struct lg_driver driver = {
 	.init = lg_mx5500_receiver_init_new,
 	.exit = lg_mx5500_receiver_exit,
 	.receive_handler = lg_mx5500_receiver_hid_receive,
-	.find_device = lg_mx5500_receiver_find_device,
+	.find_device = lg_receiver_find_device,
+	.find_out_queue = lg_receiver_find_out_queue,
 };
 
 #define get_on_lg_device(device) container_of( 				\
 			lg_find_device_on_lg_device(device, driver.device_id),\
-			struct lg_mx5500_receiver, device)
+			struct lg_mx5500_receiver, receiver.device)
 
 struct lg_mx5500_receiver_handler {
 	u8 action;
 	u8 first;
+	u8 size;
 	void (*func)(struct lg_mx5500_receiver *receiver, const u8 *payload, size_t size);
 };
 
@@ -57,11 +54,11 @@ static int lg_mx5500_receiver_update_max_devices(struct lg_mx5500_receiver *rece
 							const u8 *buffer, size_t count)
 {
 	if (count < 6) {
-		lg_device_err(receiver->device, "Too few bytes to set maximum number of devices");
+		lg_device_err(receiver->receiver.device, "Too few bytes to set maximum number of devices");
 		return 1;
 	}
 	receiver->max_devices = buffer[5];
-	lg_device_dbg(receiver->device, "Maximum number of devices changed to 0x%02x",
+	lg_device_dbg(receiver->receiver.device, "Maximum number of devices changed to 0x%02x",
 			receiver->max_devices);
 
 	return 0;
@@ -73,7 +70,7 @@ static void lg_mx5500_receiver_set_max_devices(struct lg_mx5500_receiver *receiv
 	u8 cmd[7] = { 0x10, 0xFF, LG_DEVICE_ACTION_SET, 0x00, 0x00, 0x00, 0x00 };
 
 	cmd[5] = max_devices;
-	lg_device_queue_out(receiver->device, cmd, sizeof(cmd));
+	lg_device_queue_out(receiver->receiver.device, cmd, sizeof(cmd));
 
 	if (receiver->initialized)
 		return;
@@ -84,57 +81,46 @@ static void lg_mx5500_receiver_set_max_devices(struct lg_mx5500_receiver *receiv
 static void lg_mx5500_receiver_logon_device(struct lg_mx5500_receiver *receiver,
 						const u8 *buffer, size_t count)
 {
-	int pos;
 	int code;
 	struct lg_device *new_device;
 	if (count < 7)
 		return;
 
-	pos = buffer[1];
-	if (pos < 1 || pos > LG_MX5500_RECEIVER_MAX_DEVICES)
-		return;
-
-	if (receiver->connected_devices[pos])
-		receiver->connected_devices[pos]->driver->exit(
-			receiver->connected_devices[pos]);
-
 	code = buffer[6];
-	new_device = lg_create_on_receiver(&receiver->device, code,
-					   buffer, count);
-	if (!new_device)
-		lg_device_err(receiver->device, "Couldn't initialize new device "
-			"with code 0x%02x", code);
+	new_device = lg_receiver_logon(&receiver->receiver, buffer[1], code,
+				       buffer, count);
+	if (!new_device) {
+		lg_device_err(receiver->receiver.device, "Couldn't initialize "
+			"new device with code 0x%02x", code);
+		return;
+	}
 
-	receiver->connected_devices[pos] = new_device;
+	lg_device_post_event(new_device, LG_HIDPP_EVENT_LOGON, code, buffer,
+			     count);
 }
 
 static void lg_mx5500_receiver_logoff_device(struct lg_mx5500_receiver *receiver,
 						const u8 *buffer, size_t count)
 {
 	struct lg_device *device;
-	int pos;
 
 	if (count < 2)
 		return;
 
-	pos = buffer[1];
-	if (pos < 1 || pos > LG_MX5500_RECEIVER_MAX_DEVICES)
-		return;
-
-	device = receiver->connected_devices[pos];
-	if (!device)
-		return;
-
-	device->driver->exit(device);
+	/* Posted while the device, and so its ids, are still there */
+	device = lg_receiver_get_device(&receiver->receiver, buffer[1]);
+	if (device)
+		lg_device_post_event(device, LG_HIDPP_EVENT_LOGOFF, 0, buffer,
+				     count);
 
-	receiver->connected_devices[pos] = NULL;
+	lg_receiver_logoff(&receiver->receiver, buffer[1]);
 }
 
 static void lg_mx5500_receiver_devices_logon(struct lg_mx5500_receiver *receiver)
 {
 	u8 cmd[7] = { 0x10, 0xFF, LG_DEVICE_ACTION_SET, 0x02, 0x02, 0x00, 0x00 };
 
-	lg_device_queue_out(receiver->device, cmd, sizeof(cmd));
+	lg_device_queue_out(receiver->receiver.device, cmd, sizeof(cmd));
 }
 
 static void lg_mx5500_receiver_handle_get_max_devices(struct lg_mx5500_receiver *receiver,
@@ -165,11 +151,11 @@ static void lg_mx5500_receiver_handle_set_max_devices(struct lg_mx5500_receiver
 }
 
 static struct lg_mx5500_receiver_handler lg_mx5500_receiver_handlers[] = {
-	{ .action = LG_DEVICE_ACTION_GET, .first = 0x00,
+	{ .action = LG_DEVICE_ACTION_GET, .first = 0x00, .size = 6,
 		.func = lg_mx5500_receiver_handle_get_max_devices },
-	{ .action = LG_DEVICE_ACTION_SET, .first = 0x00,
+	{ .action = LG_DEVICE_ACTION_SET, .first = 0x00, .size = 6,
 		.func = lg_mx5500_receiver_handle_set_max_devices },
-	{ .action = LG_DEVICE_ACTION_SET, .first = 0x02,
+	{ .action = LG_DEVICE_ACTION_SET, .first = 0x02, .size = 4,
 		.func = LG_DEVICE_HANDLER_IGNORE },
 	{ }
 };
@@ -189,28 +175,16 @@ void lg_mx5500_receiver_handle(struct lg_device *device, const u8 *buffer,
 		handler = &lg_mx5500_receiver_handlers[i];
 		if (handler->action == buffer[2] &&
 				handler->first == buffer[3]) {
-			if (handler->func != LG_DEVICE_HANDLER_IGNORE)
+			if (count < handler->size)
+				lg_device_err(receiver->receiver.device, "Too short receiver message %02x %02x", buffer[2], buffer[3]);
+			else if (handler->func != LG_DEVICE_HANDLER_IGNORE)
 				handler->func(receiver, buffer, count);
 			handeld = 1;
 		}
 	}
 
 	if (!handeld)
-		lg_device_err(receiver->device, "Unhandeld receiver message %02x %02x", buffer[2], buffer[3]);
-}
-
-static void lg_mx5500_receiver_handle_on_device(struct lg_mx5500_receiver *receiver,
-					 const u8 *buffer, size_t count)
-{
-	struct lg_device *handling_device;
-
-	handling_device = receiver->connected_devices[buffer[1]];
-
-	if (!handling_device)
-		return;
-
-	handling_device->driver->receive_handler(handling_device,
-						 buffer, count);
+		lg_device_unhandled(device, "receiver", buffer, count);
 }
 
 void lg_mx5500_receiver_hid_receive(struct lg_device *device, const u8 *buffer,
@@ -232,45 +206,19 @@ void lg_mx5500_receiver_hid_receive(struct lg_device *device, const u8 *buffer,
 		lg_mx5500_receiver_logon_device(receiver, buffer, count);
 	} else if (buffer[2] == 0x40) {
 		lg_mx5500_receiver_logoff_device(receiver, buffer, count);
-	} else if (buffer[1] >= 1 && buffer[1] <= LG_MX5500_RECEIVER_MAX_DEVICES) {
-		lg_mx5500_receiver_handle_on_device(receiver, buffer, count);
+	} else {
+		lg_receiver_receive(&receiver->receiver, buffer, count);
 	}
 }
 
-struct lg_device *lg_mx5500_receiver_find_device(struct lg_device *device,
-						 struct hid_device_id device_id)
-{
-	struct lg_mx5500_receiver *receiver = get_on_lg_device(device);
-	struct lg_driver *compare_driver;
-	int i;
-
-	for (i = 0; i < LG_MX5500_RECEIVER_MAX_DEVICES; i++) {
-		if (!receiver->connected_devices[i])
-			continue;
-
-		compare_driver = receiver->connected_devices[i]->driver;
-		if (compare_driver->device_id.bus == device_id.bus &&
-			compare_driver->device_id.vendor == device_id.vendor &&
-			compare_driver->device_id.product == device_id.product)
-			return receiver->connected_devices[i];
-	}
-
-	return NULL;
-}
-
 static struct lg_mx5500_receiver *lg_mx5500_receiver_create(void)
 {
 	struct lg_mx5500_receiver *receiver;
-	int i;
 
 	receiver = kzalloc(sizeof(*receiver), GFP_KERNEL);
 	if (!receiver)
 		return NULL;
 
-	for (i = 0; i < LG_MX5500_RECEIVER_MAX_DEVICES; i++) {
-		receiver->connected_devices[i] = NULL;
-	}
-
 	receiver->initialized = 0;
 
 	return receiver;
@@ -278,15 +226,7 @@ static struct lg_mx5500_receiver *lg_mx5500_receiver_create(void)
 
 static void lg_mx5500_receiver_destroy(struct lg_mx5500_receiver *receiver)
 {
-	int i;
-	for (i = 0; i < LG_MX5500_RECEIVER_MAX_DEVICES; i++) {
-		if (receiver->connected_devices[i]) {
-			receiver->connected_devices[i]->driver->exit(
-				receiver->connected_devices[i]);
-		}
-	}
-
-	lg_device_destroy(&receiver->device);
+	lg_receiver_destroy(&receiver->receiver);
 	kfree(receiver);
 }
 
@@ -304,15 +244,16 @@ int lg_mx5500_receiver_init_new(struct hid_device *hdev)
 		goto err;
 	}
 
-	ret = lg_device_init(&receiver->device, hdev, &driver);
+	ret = lg_receiver_init(&receiver->receiver, hdev, &driver,
+			       LG_MX5500_RECEIVER_MAX_DEVICES);
 	if (ret)
 		goto err_free;
 
-	lg_device_queue_out(receiver->device, cmd, sizeof(cmd));
+	lg_device_queue_out(receiver->receiver.device, cmd, sizeof(cmd));
 
 	return 0;
 err_free:
-	lg_mx5500_receiver_destroy(receiver);
+	kfree(receiver);
 err:
 	return ret;
 }
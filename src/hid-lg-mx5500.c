@@ -25,20 +25,26 @@ static const struct hid_device_id lg_hid_devices[] = {
 
 MODULE_DEVICE_TABLE(hid, lg_hid_devices);
 
+static struct lg_driver *lg_mx5500_drivers[4];
+
+static struct lg_driver_set lg_mx5500_driver_set = {
+	.name = "logitech-mx5500-desktop",
+	.drivers = lg_mx5500_drivers,
+};
+
 static int __init lg_mx5500_init(void)
 {
-	lg_register_driver(lg_mx5500_keyboard_get_driver());
-	lg_register_driver(lg_mx5500_receiver_get_driver());
-	lg_register_driver(lg_mx_revolution_get_driver());
+	lg_mx5500_drivers[0] = lg_mx5500_receiver_get_driver();
+	lg_mx5500_drivers[1] = lg_mx5500_keyboard_get_driver();
+	lg_mx5500_drivers[2] = lg_mx_revolution_get_driver();
+	lg_mx5500_drivers[3] = NULL;
 
-	return 0;
+	return lg_register_driver_set(&lg_mx5500_driver_set);
 }
 
 static void __exit lg_mx5500_exit(void)
 {
-	lg_unregister_driver(lg_mx5500_keyboard_get_driver());
-	lg_unregister_driver(lg_mx5500_receiver_get_driver());
-	lg_unregister_driver(lg_mx_revolution_get_driver());
+	lg_unregister_driver_set(&lg_mx5500_driver_set);
 }
 
 module_init(lg_mx5500_init);
@@ -0,0 +1,236 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/hid.h>
+#include <linux/hid-lg-extended.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <net/genetlink.h>
+
+#include "hid-lg-netlink.h"
+
+/*
+ * The events of all devices, multicast on the lg_hidpp generic netlink
+ * family. Events are only collected while a group has listeners. They are
+ * held back for LG_NETLINK_BATCH_MS, or until LG_NETLINK_MAX_PENDING are
+ * waiting, and then sent with as many events per message as fit. Events
+ * arriving while the pending ones are full are dropped.
+ */
+
+#define LG_NETLINK_BATCH_MS 50
+#define LG_NETLINK_MAX_PENDING 64
+
+enum lg_netlink_groups {
+	LG_NETLINK_GROUP_SLOTS,
+	LG_NETLINK_GROUP_STATE,
+};
+
+struct lg_netlink_pending {
+	u64 time_ns;
+	char device[32];
+	u16 bus;
+	u16 vendor;
+	u16 product;
+	u16 type;
+	u32 value;
+	u8 devnum;
+	u8 group;
+};
+
+static const struct genl_multicast_group lg_netlink_groups[] = {
+	[LG_NETLINK_GROUP_SLOTS] = { .name = LG_HIDPP_GENL_SLOTS_GROUP },
+	[LG_NETLINK_GROUP_STATE] = { .name = LG_HIDPP_GENL_STATE_GROUP },
+};
+
+static struct genl_family lg_netlink_family = {
+	.name = LG_HIDPP_GENL_NAME,
+	.version = LG_HIDPP_GENL_VERSION,
+	.maxattr = LG_HIDPP_ATTR_MAX,
+	.module = THIS_MODULE,
+	.mcgrps = lg_netlink_groups,
+	.n_mcgrps = ARRAY_SIZE(lg_netlink_groups),
+};
+
+static bool registered;
+
+/* Filled by lg_netlink_event, the flush worker sends the other one */
+static struct lg_netlink_pending pending[2][LG_NETLINK_MAX_PENDING];
+static unsigned int pending_index;
+static unsigned int pending_count;
+static DEFINE_SPINLOCK(pending_lock);
+
+static void lg_netlink_flush_worker(struct work_struct *work);
+static DECLARE_DELAYED_WORK(flush_worker, lg_netlink_flush_worker);
+
+static int lg_netlink_group(u16 type)
+{
+	switch (type) {
+	case LG_HIDPP_EVENT_LOGON:
+	case LG_HIDPP_EVENT_LOGOFF:
+		return LG_NETLINK_GROUP_SLOTS;
+	case LG_HIDPP_EVENT_BATTERY:
+	case LG_HIDPP_EVENT_LCD_PAGE:
+	case LG_HIDPP_EVENT_SCROLLMODE:
+		return LG_NETLINK_GROUP_STATE;
+	default:
+		return -1;
+	}
+}
+
+static int lg_netlink_put(struct sk_buff *msg,
+			  const struct lg_netlink_pending *event)
+{
+	struct nlattr *nest;
+
+	nest = nla_nest_start(msg, LG_HIDPP_ATTR_EVENT);
+	if (!nest)
+		return -EMSGSIZE;
+
+	if (nla_put_string(msg, LG_HIDPP_ATTR_DEVICE, event->device) ||
+			nla_put_u16(msg, LG_HIDPP_ATTR_BUS, event->bus) ||
+			nla_put_u16(msg, LG_HIDPP_ATTR_VENDOR, event->vendor) ||
+			nla_put_u16(msg, LG_HIDPP_ATTR_PRODUCT,
+				    event->product) ||
+			nla_put_u8(msg, LG_HIDPP_ATTR_DEVNUM, event->devnum) ||
+			nla_put_u16(msg, LG_HIDPP_ATTR_TYPE, event->type) ||
+			nla_put_u32(msg, LG_HIDPP_ATTR_VALUE, event->value) ||
+			nla_put_u64_64bit(msg, LG_HIDPP_ATTR_TIME,
+					  event->time_ns, LG_HIDPP_ATTR_PAD)) {
+		nla_nest_cancel(msg, nest);
+		return -EMSGSIZE;
+	}
+
+	nla_nest_end(msg, nest);
+
+	return 0;
+}
+
+/* Sends the events of a group, starting a new message when one is full */
+static void lg_netlink_send(const struct lg_netlink_pending *events,
+			    unsigned int count, u8 group)
+{
+	struct sk_buff *msg = NULL;
+	void *hdr = NULL;
+	unsigned int i = 0;
+
+	while (i < count) {
+		if (events[i].group != group) {
+			i++;
+			continue;
+		}
+
+		if (!msg) {
+			msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+			if (!msg)
+				return;
+
+			hdr = genlmsg_put(msg, 0, 0, &lg_netlink_family, 0,
+					  LG_HIDPP_CMD_EVENTS);
+			if (!hdr) {
+				nlmsg_free(msg);
+				return;
+			}
+		}
+
+		if (!lg_netlink_put(msg, &events[i])) {
+			i++;
+			continue;
+		}
+
+		genlmsg_end(msg, hdr);
+		genlmsg_multicast(&lg_netlink_family, msg, 0, group,
+				  GFP_KERNEL);
+		msg = NULL;
+	}
+
+	if (msg) {
+		genlmsg_end(msg, hdr);
+		genlmsg_multicast(&lg_netlink_family, msg, 0, group,
+				  GFP_KERNEL);
+	}
+}
+
+static void lg_netlink_flush_worker(struct work_struct *work)
+{
+	struct lg_netlink_pending *events;
+	unsigned long flags;
+	unsigned int count;
+
+	spin_lock_irqsave(&pending_lock, flags);
+	events = pending[pending_index];
+	count = pending_count;
+	pending_index = !pending_index;
+	pending_count = 0;
+	spin_unlock_irqrestore(&pending_lock, flags);
+
+	lg_netlink_send(events, count, LG_NETLINK_GROUP_SLOTS);
+	lg_netlink_send(events, count, LG_NETLINK_GROUP_STATE);
+}
+
+void lg_netlink_event(struct lg_device *device, u16 type, u32 value,
+		      const u8 *buffer, size_t count)
+{
+	struct lg_netlink_pending *event;
+	unsigned long flags;
+	int group = lg_netlink_group(type);
+
+	if (!registered || group < 0 ||
+			!genl_has_listeners(&lg_netlink_family, &init_net,
+					    group))
+		return;
+
+	spin_lock_irqsave(&pending_lock, flags);
+
+	if (pending_count == LG_NETLINK_MAX_PENDING)
+		goto out_unlock;
+
+	event = &pending[pending_index][pending_count++];
+	event->time_ns = ktime_get_ns();
+	strscpy(event->device, dev_name(&device->hdev->dev),
+		sizeof(event->device));
+	event->bus = device->hdev->bus;
+	event->vendor = device->hdev->vendor;
+	event->product = device->hdev->product;
+	event->type = type;
+	event->value = value;
+	event->devnum = buffer[1];
+	event->group = group;
+
+	if (pending_count == LG_NETLINK_MAX_PENDING)
+		mod_delayed_work(system_wq, &flush_worker, 0);
+	else if (pending_count == 1)
+		schedule_delayed_work(&flush_worker,
+				      msecs_to_jiffies(LG_NETLINK_BATCH_MS));
+
+out_unlock:
+	spin_unlock_irqrestore(&pending_lock, flags);
+}
+
+int lg_netlink_init(void)
+{
+	int ret;
+
+	ret = genl_register_family(&lg_netlink_family);
+	if (ret)
+		return ret;
+
+	registered = true;
+
+	return 0;
+}
+
+void lg_netlink_exit(void)
+{
+	if (!registered)
+		return;
+
+	registered = false;
+	cancel_delayed_work_sync(&flush_worker);
+	genl_unregister_family(&lg_netlink_family);
+}
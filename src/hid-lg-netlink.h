@@ -0,0 +1,40 @@
+#ifndef __HID_LG_NETLINK
+#define __HID_LG_NETLINK
+
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/hid-lg-extended.h>
+
+#ifdef CONFIG_NET
+
+int lg_netlink_init(void);
+
+void lg_netlink_exit(void);
+
+void lg_netlink_event(struct lg_device *device, u16 type, u32 value,
+		      const u8 *buffer, size_t count);
+
+#else
+
+static inline int lg_netlink_init(void)
+{
+	return 0;
+}
+
+static inline void lg_netlink_exit(void)
+{
+}
+
+static inline void lg_netlink_event(struct lg_device *device, u16 type,
+				    u32 value, const u8 *buffer, size_t count)
+{
+}
+
+#endif
+
+#endif
@@ -0,0 +1,389 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/hid.h>
+#include <linux/hid-lg-extended.h>
+#include <linux/jiffies.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+#include "hid-lg-cdev.h"
+#include "hid-lg-device.h"
+#include "hid-lg-stats.h"
+
+#define get_receiver(lg_device) container_of(lg_device, struct lg_receiver, device)
+
+static struct lg_receiver_slot *lg_receiver_get_slot(
+		struct lg_receiver *receiver, u8 devnum)
+{
+	if (devnum < 1 || devnum > receiver->slot_count)
+		return NULL;
+
+	return &receiver->slots[devnum - 1];
+}
+
+/* Called with the slot_lock held */
+static void lg_receiver_slot_remove(struct lg_receiver_slot *slot, int i)
+{
+	slot->in_flight--;
+	slot->requests[i] = slot->requests[slot->in_flight];
+}
+
+/*
+ * Whether the report at the head of the out_queue of a slot can be sent.
+ * Requests, with the msb of the sub id set, wait for a place in flight and
+ * take it, as long as no other request for their register is in flight.
+ * Anything else isn't answered, so it is sent right away.
+ */
+static bool lg_receiver_slot_ready(struct lg_receiver *receiver,
+				   struct lg_receiver_slot *slot,
+				   const struct lg_device_buf *buf,
+				   unsigned long *wait)
+{
+	struct lg_receiver_request *request;
+	unsigned long flags;
+	unsigned long expires, first = 0;
+	bool ready = true, busy = false;
+	int i;
+
+	if (!lg_device_is_reply(buf->data, buf->size))
+		return true;
+
+	spin_lock_irqsave(&receiver->slot_lock, flags);
+
+	for (i = 0; i < slot->in_flight; ) {
+		expires = slot->requests[i].sent_at + receiver->reply_timeout;
+		if (!time_before(jiffies, expires)) {
+			/* The reply got lost, don't block the slot forever */
+			lg_receiver_slot_remove(slot, i);
+			continue;
+		}
+
+		if (!first || time_before(expires, first))
+			first = expires;
+		if (slot->requests[i].action == buf->data[2] &&
+		    slot->requests[i].reg == buf->data[3])
+			busy = true;
+		i++;
+	}
+
+	if (busy || slot->in_flight >= receiver->max_in_flight) {
+		expires = max(first - jiffies, 1UL);
+		if (!*wait || expires < *wait)
+			*wait = expires;
+		ready = false;
+	} else {
+		request = &slot->requests[slot->in_flight++];
+		request->action = buf->data[2];
+		request->reg = buf->data[3];
+		request->sent_at = jiffies;
+	}
+
+	spin_unlock_irqrestore(&receiver->slot_lock, flags);
+
+	return ready;
+}
+
+/*
+ * Frees the place of the request a reply or error report answers. Returns
+ * false for anything else, like a notification shaped as a reply or a
+ * duplicate, which must not free the place of another request.
+ */
+static bool lg_receiver_slot_answered(struct lg_receiver *receiver,
+				      struct lg_receiver_slot *slot,
+				      const u8 *buffer, size_t count)
+{
+	unsigned long flags;
+	bool answered = false;
+	u8 action, reg;
+	int i;
+
+	if (buffer[2] == LG_DEVICE_ACTION_ERROR) {
+		if (count < 5)
+			return false;
+		action = buffer[3];
+		reg = buffer[4];
+	} else {
+		if (count < 4)
+			return false;
+		action = buffer[2];
+		reg = buffer[3];
+	}
+
+	spin_lock_irqsave(&receiver->slot_lock, flags);
+
+	for (i = 0; i < slot->in_flight; i++) {
+		if (slot->requests[i].action == action &&
+		    slot->requests[i].reg == reg) {
+			lg_receiver_slot_remove(slot, i);
+			answered = true;
+			break;
+		}
+	}
+
+	spin_unlock_irqrestore(&receiver->slot_lock, flags);
+
+	return answered;
+}
+
+static void lg_receiver_send_worker(struct work_struct *work)
+{
+	struct lg_receiver *receiver = container_of(to_delayed_work(work),
+						struct lg_receiver, send_worker);
+	struct lg_receiver_slot *slot;
+	struct lg_device_buf *buf;
+	unsigned long wait = 0;
+	int i, sent;
+
+	lg_device_stats_inc(receiver->device.stats, worker_runs);
+
+	do {
+		sent = 0;
+
+		for (i = 0; i < receiver->slot_count; i++) {
+			slot = &receiver->slots[(receiver->next_slot + i) %
+						receiver->slot_count];
+
+			buf = lg_device_queue_peek(slot->out_queue);
+			if (!buf)
+				continue;
+
+			if (!lg_receiver_slot_ready(receiver, slot, buf, &wait))
+				continue;
+
+			if (lg_device_hid_send(receiver->device.hdev, buf->data,
+							buf->size) >= 0) {
+				atomic_long_inc(&slot->stats.sent);
+				atomic_long_add(buf->size, &slot->stats.bytes_sent);
+				lg_device_stats_inc(receiver->device.stats, sent);
+				lg_device_stats_add(receiver->device.stats,
+						    bytes_sent, buf->size);
+			}
+			lg_device_queue_pop(slot->out_queue);
+			sent = 1;
+		}
+
+		receiver->next_slot = (receiver->next_slot + 1) %
+						receiver->slot_count;
+	} while (sent);
+
+	if (wait)
+		schedule_delayed_work(&receiver->send_worker, wait);
+}
+
+static void lg_receiver_queue_worker(struct work_struct *work)
+{
+	struct lg_device_queue *queue = container_of(work,
+					struct lg_device_queue, worker);
+	struct lg_receiver *receiver = get_receiver(queue->owner);
+
+	mod_delayed_work(system_wq, &receiver->send_worker, 0);
+}
+
+void lg_receiver_receive(struct lg_receiver *receiver,
+			 const u8 *buffer, size_t count)
+{
+	struct lg_receiver_slot *slot;
+	struct lg_device *device;
+
+	if (count < 3)
+		return;
+
+	slot = lg_receiver_get_slot(receiver, buffer[1]);
+	if (!slot)
+		return;
+
+	/* Not added to the parent, the HID device counted it already */
+	atomic_long_inc(&slot->stats.received);
+	atomic_long_add(count, &slot->stats.bytes_received);
+
+	if (lg_device_is_reply(buffer, count)) {
+		atomic_long_inc(&slot->stats.replies);
+
+		if (lg_receiver_slot_answered(receiver, slot, buffer, count))
+			mod_delayed_work(system_wq, &receiver->send_worker, 0);
+	}
+
+	device = slot->device;
+	if (device)
+		lg_device_dispatch(device, buffer, count);
+	else if (lg_device_is_reply(buffer, count))
+		lg_device_stats_inc(&slot->stats, replies_unmatched);
+}
+EXPORT_SYMBOL_GPL(lg_receiver_receive);
+
+struct lg_device *lg_receiver_logon(struct lg_receiver *receiver, u8 devnum,
+				    u8 device_code, const u8 *buffer,
+				    size_t count)
+{
+	struct lg_receiver_slot *slot;
+	struct lg_device *device;
+	unsigned long flags;
+
+	slot = lg_receiver_get_slot(receiver, devnum);
+	if (!slot)
+		return NULL;
+
+	lg_receiver_logoff(receiver, devnum);
+
+	device = lg_create_on_receiver(&receiver->device, device_code,
+				       buffer, count);
+	if (!device)
+		return NULL;
+
+	lg_device_queue_put(device->out_queue);
+	device->out_queue = lg_device_queue_get(slot->out_queue);
+	device->stats = &slot->stats;
+
+	spin_lock_irqsave(&receiver->slot_lock, flags);
+	slot->in_flight = 0;
+	spin_unlock_irqrestore(&receiver->slot_lock, flags);
+
+	slot->device = device;
+
+	return device;
+}
+EXPORT_SYMBOL_GPL(lg_receiver_logon);
+
+void lg_receiver_logoff(struct lg_receiver *receiver, u8 devnum)
+{
+	struct lg_receiver_slot *slot;
+	struct lg_device *device;
+
+	slot = lg_receiver_get_slot(receiver, devnum);
+	if (!slot || !slot->device)
+		return;
+
+	device = slot->device;
+	slot->device = NULL;
+
+	device->driver->exit(device);
+}
+EXPORT_SYMBOL_GPL(lg_receiver_logoff);
+
+/* The device logged on in a slot, or NULL */
+struct lg_device *lg_receiver_get_device(struct lg_receiver *receiver,
+					 u8 devnum)
+{
+	struct lg_receiver_slot *slot;
+
+	slot = lg_receiver_get_slot(receiver, devnum);
+	if (!slot)
+		return NULL;
+
+	return slot->device;
+}
+EXPORT_SYMBOL_GPL(lg_receiver_get_device);
+
+struct lg_device *lg_receiver_find_device(struct lg_device *device,
+					  struct hid_device_id device_id)
+{
+	struct lg_receiver *receiver = get_receiver(device);
+	struct lg_driver *compare_driver;
+	int i;
+
+	for (i = 0; i < receiver->slot_count; i++) {
+		if (!receiver->slots[i].device)
+			continue;
+
+		compare_driver = receiver->slots[i].device->driver;
+		if (compare_driver->device_id.bus == device_id.bus &&
+			compare_driver->device_id.vendor == device_id.vendor &&
+			compare_driver->device_id.product == device_id.product)
+			return receiver->slots[i].device;
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(lg_receiver_find_device);
+
+/* Requests for a slot are sent through its queue, to keep the pacing */
+struct lg_device_queue *lg_receiver_find_out_queue(struct lg_device *device,
+						   u8 devnum)
+{
+	struct lg_receiver_slot *slot;
+
+	slot = lg_receiver_get_slot(get_receiver(device), devnum);
+	if (!slot)
+		return device->out_queue;
+
+	return slot->out_queue;
+}
+EXPORT_SYMBOL_GPL(lg_receiver_find_out_queue);
+
+int lg_receiver_init(struct lg_receiver *receiver,
+		     struct hid_device *hdev,
+		     struct lg_driver *driver,
+		     u8 slot_count)
+{
+	int i;
+	int ret;
+
+	if (slot_count < 1 || slot_count > LG_RECEIVER_MAX_SLOTS)
+		return -EINVAL;
+
+	receiver->slot_count = slot_count;
+	receiver->max_in_flight = LG_RECEIVER_MAX_IN_FLIGHT;
+	receiver->reply_timeout = msecs_to_jiffies(LG_RECEIVER_REPLY_TIMEOUT_MS);
+	receiver->next_slot = 0;
+	spin_lock_init(&receiver->slot_lock);
+	INIT_DELAYED_WORK(&receiver->send_worker, lg_receiver_send_worker);
+
+	for (i = 0; i < slot_count; i++) {
+		receiver->slots[i].out_queue = lg_device_queue_create(
+				&receiver->device, lg_receiver_queue_worker);
+		if (!receiver->slots[i].out_queue) {
+			ret = -ENOMEM;
+			goto err_free_queues;
+		}
+	}
+
+	ret = lg_device_init(&receiver->device, hdev, driver);
+	if (ret)
+		goto err_free_queues;
+
+	for (i = 0; i < slot_count; i++) {
+		receiver->slots[i].stats.parent = receiver->device.stats;
+		receiver->slots[i].stats.hdev = hdev;
+		receiver->slots[i].stats.devnum = i + 1;
+		lg_stats_register(&receiver->slots[i].stats);
+	}
+
+	return 0;
+err_free_queues:
+	while (--i >= 0)
+		lg_device_queue_put(receiver->slots[i].out_queue);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lg_receiver_init);
+
+void lg_receiver_destroy(struct lg_receiver *receiver)
+{
+	int i;
+
+	/* Stop handling incoming reports before tearing down the slots */
+	lg_device_queue_shutdown(receiver->device.in_queue);
+	lg_cdev_destroy(&receiver->device);
+
+	for (i = 0; i < receiver->slot_count; i++)
+		lg_receiver_logoff(receiver, i + 1);
+
+	for (i = 0; i < receiver->slot_count; i++)
+		lg_device_queue_shutdown(receiver->slots[i].out_queue);
+
+	cancel_delayed_work_sync(&receiver->send_worker);
+
+	for (i = 0; i < receiver->slot_count; i++) {
+		lg_stats_unregister(&receiver->slots[i].stats);
+		lg_device_queue_put(receiver->slots[i].out_queue);
+		receiver->slots[i].out_queue = NULL;
+	}
+
+	lg_device_destroy(&receiver->device);
+}
+EXPORT_SYMBOL_GPL(lg_receiver_destroy);
@@ -0,0 +1,78 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/hid.h>
+#include <linux/hid-lg-extended.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+
+#include "hid-lg-stats.h"
+
+/*
+ * The traffic counters of all devices in one file, hid-logitech/stats. Every
+ * HID device and every slot of a receiver is a line of key=value pairs, slot
+ * 0 is the HID device itself. The counters are only added to on the hot
+ * path, this file is the only place they are read.
+ */
+
+static LIST_HEAD(stats_list);
+static DEFINE_MUTEX(stats_lock);
+
+void lg_stats_register(struct lg_device_stats *stats)
+{
+	mutex_lock(&stats_lock);
+	list_add_tail(&stats->entry, &stats_list);
+	mutex_unlock(&stats_lock);
+}
+
+void lg_stats_unregister(struct lg_device_stats *stats)
+{
+	mutex_lock(&stats_lock);
+	list_del(&stats->entry);
+	mutex_unlock(&stats_lock);
+}
+
+static int lg_stats_show(struct seq_file *s, void *unused)
+{
+	struct lg_device_stats *stats;
+	long replies, unmatched;
+
+	mutex_lock(&stats_lock);
+
+	list_for_each_entry(stats, &stats_list, entry) {
+		/* Read unmatched first, replies never lag behind it then */
+		unmatched = atomic_long_read(&stats->replies_unmatched);
+		replies = atomic_long_read(&stats->replies);
+
+		seq_printf(s, "device=%s slot=%u received=%ld sent=%ld "
+			   "bytes_received=%ld bytes_sent=%ld "
+			   "replies_matched=%ld replies_unmatched=%ld "
+			   "timeouts=%ld queue_drops=%ld worker_runs=%ld\n",
+			   dev_name(&stats->hdev->dev), stats->devnum,
+			   atomic_long_read(&stats->received),
+			   atomic_long_read(&stats->sent),
+			   atomic_long_read(&stats->bytes_received),
+			   atomic_long_read(&stats->bytes_sent),
+			   replies - unmatched, unmatched,
+			   atomic_long_read(&stats->timeouts),
+			   atomic_long_read(&stats->queue_drops),
+			   atomic_long_read(&stats->worker_runs));
+	}
+
+	mutex_unlock(&stats_lock);
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(lg_stats);
+
+void lg_stats_init(struct dentry *root)
+{
+	debugfs_create_file("stats", 0444, root, NULL, &lg_stats_fops);
+}
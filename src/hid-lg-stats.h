@@ -0,0 +1,38 @@
+#ifndef __HID_LG_STATS
+#define __HID_LG_STATS
+
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/hid-lg-extended.h>
+
+#ifdef CONFIG_DEBUG_FS
+
+void lg_stats_init(struct dentry *root);
+
+void lg_stats_register(struct lg_device_stats *stats);
+
+void lg_stats_unregister(struct lg_device_stats *stats);
+
+#else
+
+static inline void lg_stats_init(struct dentry *root)
+{
+}
+
+static inline void lg_stats_register(struct lg_device_stats *stats)
+{
+}
+
+static inline void lg_stats_unregister(struct lg_device_stats *stats)
+{
+}
+
+#endif
+
+#endif
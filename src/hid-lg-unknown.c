@@ -0,0 +1,196 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/hid.h>
+#include <linux/hid-lg-extended.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include "hid-lg-unknown.h"
+
+/*
+ * The reports no driver handles, kept per HID device in debugfs
+ * (hid-logitech/unknown/<device>) instead of logging every one of them. The
+ * file counts the reports by devnum, action and register, and holds the last
+ * LG_UNKNOWN_REPORTS of them. Only the first LG_UNKNOWN_KEYS combinations
+ * are counted on their own, the reports of any other are counted as
+ * untracked.
+ */
+
+#define LG_UNKNOWN_REPORTS 32
+#define LG_UNKNOWN_KEYS 64
+#define LG_UNKNOWN_REPORT_SIZE 20
+
+struct lg_unknown_key {
+	u8 devnum;
+	u8 action;
+	u8 reg;
+	u32 count;
+};
+
+struct lg_unknown_report {
+	u64 time_ns;
+	u8 size;
+	u8 data[LG_UNKNOWN_REPORT_SIZE];
+};
+
+struct lg_unknown {
+	struct dentry *file;
+
+	spinlock_t lock;
+	u32 total;
+	u32 untracked;
+	unsigned int key_count;
+	struct lg_unknown_key keys[LG_UNKNOWN_KEYS];
+	unsigned int head;
+	struct lg_unknown_report reports[LG_UNKNOWN_REPORTS];
+};
+
+static struct dentry *unknown_root;
+
+static struct lg_unknown_key *lg_unknown_find_key(struct lg_unknown *unknown,
+						  const u8 *buffer)
+{
+	struct lg_unknown_key *key;
+	unsigned int i;
+
+	for (i = 0; i < unknown->key_count; i++) {
+		key = &unknown->keys[i];
+		if (key->devnum == buffer[1] && key->action == buffer[2] &&
+				key->reg == buffer[3])
+			return key;
+	}
+
+	if (unknown->key_count == LG_UNKNOWN_KEYS)
+		return NULL;
+
+	key = &unknown->keys[unknown->key_count++];
+	key->devnum = buffer[1];
+	key->action = buffer[2];
+	key->reg = buffer[3];
+
+	return key;
+}
+
+/* Counts the report and keeps it, on the device which owns the in_queue */
+void lg_unknown_record(struct lg_device *owner, const u8 *buffer,
+		       size_t count)
+{
+	struct lg_unknown *unknown = owner->unknown;
+	struct lg_unknown_report *report;
+	struct lg_unknown_key *key;
+	unsigned long flags;
+
+	if (!unknown || count < 4)
+		return;
+
+	spin_lock_irqsave(&unknown->lock, flags);
+
+	unknown->total++;
+
+	key = lg_unknown_find_key(unknown, buffer);
+	if (key)
+		key->count++;
+	else
+		unknown->untracked++;
+
+	report = &unknown->reports[unknown->head];
+	report->time_ns = ktime_get_ns();
+	report->size = min_t(size_t, count, LG_UNKNOWN_REPORT_SIZE);
+	memcpy(report->data, buffer, report->size);
+	unknown->head = (unknown->head + 1) % LG_UNKNOWN_REPORTS;
+
+	spin_unlock_irqrestore(&unknown->lock, flags);
+}
+
+static int lg_unknown_show(struct seq_file *s, void *unused)
+{
+	struct lg_unknown *unknown = s->private;
+	struct lg_unknown_report *report;
+	struct lg_unknown_key *key;
+	unsigned long flags;
+	unsigned int i, j, first, stored;
+
+	spin_lock_irqsave(&unknown->lock, flags);
+
+	seq_printf(s, "total=%u keys=%u untracked=%u\n", unknown->total,
+		   unknown->key_count, unknown->untracked);
+
+	for (i = 0; i < unknown->key_count; i++) {
+		key = &unknown->keys[i];
+		seq_printf(s, "devnum=%u action=0x%02x register=0x%02x "
+			   "count=%u\n", key->devnum, key->action, key->reg,
+			   key->count);
+	}
+
+	/* The oldest report first */
+	stored = min_t(u32, unknown->total, LG_UNKNOWN_REPORTS);
+	first = (unknown->head + LG_UNKNOWN_REPORTS - stored) %
+		LG_UNKNOWN_REPORTS;
+	for (i = 0; i < stored; i++) {
+		report = &unknown->reports[(first + i) % LG_UNKNOWN_REPORTS];
+		seq_printf(s, "time=%llu.%09llu report=",
+			   report->time_ns / NSEC_PER_SEC,
+			   report->time_ns % NSEC_PER_SEC);
+		for (j = 0; j < report->size; j++)
+			seq_printf(s, j ? " %02x" : "%02x", report->data[j]);
+		seq_putc(s, '\n');
+	}
+
+	spin_unlock_irqrestore(&unknown->lock, flags);
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(lg_unknown);
+
+int lg_unknown_create(struct lg_device *device)
+{
+	struct lg_unknown *unknown;
+
+	if (!unknown_root)
+		return 0;
+
+	unknown = kzalloc(sizeof(*unknown), GFP_KERNEL);
+	if (!unknown)
+		return -ENOMEM;
+
+	spin_lock_init(&unknown->lock);
+	unknown->file = debugfs_create_file(dev_name(&device->hdev->dev), 0444,
+					    unknown_root, unknown,
+					    &lg_unknown_fops);
+
+	device->unknown = unknown;
+
+	return 0;
+}
+
+/* The in_queue must be shut down already, so nothing is recorded anymore */
+void lg_unknown_destroy(struct lg_device *device)
+{
+	struct lg_unknown *unknown = device->unknown;
+
+	if (!unknown)
+		return;
+
+	device->unknown = NULL;
+	debugfs_remove(unknown->file);
+	kfree(unknown);
+}
+
+void lg_unknown_init(struct dentry *root)
+{
+	unknown_root = debugfs_create_dir("unknown", root);
+}
+
+void lg_unknown_exit(void)
+{
+	unknown_root = NULL;
+}
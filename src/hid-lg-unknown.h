@@ -0,0 +1,53 @@
+#ifndef __HID_LG_UNKNOWN
+#define __HID_LG_UNKNOWN
+
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/hid-lg-extended.h>
+
+#ifdef CONFIG_DEBUG_FS
+
+void lg_unknown_init(struct dentry *root);
+
+void lg_unknown_exit(void);
+
+int lg_unknown_create(struct lg_device *device);
+
+void lg_unknown_destroy(struct lg_device *device);
+
+void lg_unknown_record(struct lg_device *owner, const u8 *buffer,
+		       size_t count);
+
+#else
+
+static inline void lg_unknown_init(struct dentry *root)
+{
+}
+
+static inline void lg_unknown_exit(void)
+{
+}
+
+static inline int lg_unknown_create(struct lg_device *device)
+{
+	return 0;
+}
+
+static inline void lg_unknown_destroy(struct lg_device *device)
+{
+}
+
+static inline void lg_unknown_record(struct lg_device *owner,
+				     const u8 *buffer, size_t count)
+{
+}
+
+#endif
+
+#endif
@@ -16,8 +16,10 @@
 struct lg_vx_revolution{
 	struct lg_device device;
 	wait_queue_head_t received;
+	int error;
 
 	s8 battery_level;
+	s8 battery_notified;
 };
 
 int lg_vx_revolution_init_device(struct hid_device *hdev);
@@ -27,17 +29,20 @@ void lg_vx_revolution_exit_device(struct lg_device *device);
 void lg_vx_revolution_handle(struct lg_device *device, const u8 *buffer,
 								size_t count);
 
+void lg_vx_revolution_handle_error(struct lg_device *device, u8 action,
+				   u8 reg, int error);
+
 #define get_on_lg_device(device) container_of( 				\
 			lg_find_device_on_lg_device(device, driver.device_id),\
 			struct lg_vx_revolution, device)
 
-#define get_on_device(device) container_of( 				\
-			lg_find_device_on_device(device, driver.device_id),\
+#define get_on_device(lg_device) container_of(lg_device,			\
 			struct lg_vx_revolution, device)
 
 struct lg_vx_revolution_handler {
 	u8 action;
 	u8 first;
+	u8 size;
 	void (*func)(struct lg_vx_revolution *mouse, const u8 *payload, size_t size);
 };
 
@@ -51,6 +56,7 @@ static struct lg_driver driver = {
 	.init = lg_vx_revolution_init_device,
 	.exit = lg_vx_revolution_exit_device,
 	.receive_handler = lg_vx_revolution_handle,
+	.error_handler = lg_vx_revolution_handle_error,
 };
 
 static int lg_vx_revolution_request_battery(struct lg_vx_revolution *mouse)
@@ -58,48 +64,77 @@ static int lg_vx_revolution_request_battery(struct lg_vx_revolution *mouse)
 	u8 cmd[7] = { 0x10, 0x01, LG_DEVICE_ACTION_GET, 0x0d, 0x00, 0x00, 0x00 };
 
 	mouse->battery_level = -1;
+	mouse->error = 0;
 	lg_device_queue_out(mouse->device, cmd, sizeof(cmd));
 
-	return wait_event_interruptible(mouse->received,
-				 mouse->battery_level >= 0);
+	return lg_device_wait_reply(mouse->device, mouse->received,
+				 mouse->battery_level >= 0, mouse->error);
 }
 
-static ssize_t mouse_show_battery(struct device *device,
-			struct device_attribute *attr, char *buf)
+static ssize_t mouse_show_battery(struct lg_device *device, char *buf)
 {
 	struct lg_vx_revolution *mouse = get_on_device(device);
+	int ret;
 
-	if (lg_vx_revolution_request_battery(mouse))
-		return 0;
+	ret = lg_vx_revolution_request_battery(mouse);
+	if (ret)
+		return ret;
 
 	return scnprintf(buf, PAGE_SIZE, "%d%%\n", mouse->battery_level);
 }
 
-static DEVICE_ATTR(battery, 0444, mouse_show_battery, NULL);
+static LG_DEVICE_ATTR(battery, 0444, mouse_show_battery, NULL);
 
-static ssize_t mouse_show_name(struct device *device,
-			struct device_attribute *attr, char *buf)
+static ssize_t mouse_show_name(struct lg_device *device, char *buf)
 {
 	return scnprintf(buf, PAGE_SIZE, "%s\n", driver.device_name);
 }
 
-static DEVICE_ATTR(name, 0444, mouse_show_name, NULL);
+static LG_DEVICE_ATTR(name, 0444, mouse_show_name, NULL);
+
+/* All the other attributes in one read, in the same format */
+static ssize_t mouse_show_status(struct lg_device *device, char *buf)
+{
+	struct lg_vx_revolution *mouse = get_on_device(device);
+	int ret;
+
+	ret = lg_vx_revolution_request_battery(mouse);
+	if (ret)
+		return ret;
+
+	return scnprintf(buf, PAGE_SIZE, "battery=%d%%\nname=%s\n",
+			 mouse->battery_level, driver.device_name);
+}
+
+static LG_DEVICE_ATTR(status, 0444, mouse_show_status, NULL);
 
 static struct attribute *mouse_attrs[] = {
-	&dev_attr_battery.attr,
-	&dev_attr_name.attr,
+	&lg_dev_attr_battery.attr.attr,
+	&lg_dev_attr_name.attr.attr,
+	&lg_dev_attr_status.attr.attr,
 	NULL,
 };
 
+static const struct attribute_group mouse_attr_group = {
+	.attrs = mouse_attrs,
+};
+
 static void mouse_handle_get_battery(
 		struct lg_vx_revolution *mouse, const u8 *buf,
 		size_t size)
 {
 	mouse->battery_level = buf[4];
+
+	if (mouse->battery_level != mouse->battery_notified) {
+		mouse->battery_notified = mouse->battery_level;
+		lg_device_sysfs_notify(&mouse->device, "battery");
+		lg_device_post_event(&mouse->device, LG_HIDPP_EVENT_BATTERY,
+				     mouse->battery_level, buf, size);
+	}
 }
 
 static struct lg_vx_revolution_handler lg_vx_revolution_handlers[] = {
-	{ .action = LG_DEVICE_ACTION_GET, .first = 0x0d,
+	{ .action = LG_DEVICE_ACTION_GET, .first = 0x0d, .size = 5,
 		.func = mouse_handle_get_battery },
 	{ }
 };
@@ -112,6 +147,11 @@ void lg_vx_revolution_handle(struct lg_device *device, const u8 *buffer,
 	struct lg_vx_revolution *mouse;
 	struct lg_vx_revolution_handler *handler;
 
+	if (count < 4) {
+		lg_device_err((*device), "Too few bytes to handle");
+		return;
+	}
+
 	mouse = get_on_lg_device(device);
 
 	for (i = 0; lg_vx_revolution_handlers[i].action ||
@@ -119,18 +159,42 @@ void lg_vx_revolution_handle(struct lg_device *device, const u8 *buffer,
 		handler = &lg_vx_revolution_handlers[i];
 		if (handler->action == buffer[2] &&
 				handler->first == buffer[3]) {
-			if (handler->func != LG_DEVICE_HANDLER_IGNORE)
+			if (count < handler->size)
+				lg_device_err((*device), "Too short mouse message %02x %02x", buffer[2], buffer[3]);
+			else if (handler->func != LG_DEVICE_HANDLER_IGNORE)
 				handler->func(mouse, buffer, count);
 			handeld = 1;
 		}
 	}
 
 	if (!handeld)
-		lg_device_err((*device), "Unhandeld mouse message %02x %02x", buffer[2], buffer[3]);
+		lg_device_unhandled(device, "mouse", buffer, count);
 
 	wake_up_interruptible(&mouse->received);
 }
 
+/* Fails the waiting request if the error is for one of the handled replies */
+void lg_vx_revolution_handle_error(struct lg_device *device, u8 action,
+				   u8 reg, int error)
+{
+	struct lg_vx_revolution *mouse;
+	struct lg_vx_revolution_handler *handler;
+
+	mouse = get_on_lg_device(device);
+
+	for (handler = lg_vx_revolution_handlers; handler->action ||
+			handler->first; handler++) {
+		if (handler->action == action && handler->first == reg) {
+			mouse->error = error;
+			wake_up_interruptible(&mouse->received);
+			return;
+		}
+	}
+
+	lg_device_dbg((*device), "Error %d for mouse request %02x %02x",
+		      error, action, reg);
+}
+
 static struct lg_vx_revolution *lg_vx_revolution_create(void)
 {
 	struct lg_vx_revolution *mouse;
@@ -140,6 +204,7 @@ static struct lg_vx_revolution *lg_vx_revolution_create(void)
 		return NULL;
 
 	mouse->battery_level = -1;
+	mouse->battery_notified = -1;
 	init_waitqueue_head(&mouse->received);
 
 	return mouse;
@@ -172,12 +237,13 @@ int lg_vx_revolution_init_device(struct hid_device *hdev)
 	if (ret)
 		goto error_free;
 
-	ret = sysfs_create_files(&mouse->device.hdev->dev.kobj,
-		(const struct attribute**)mouse_attrs);
+	ret = lg_device_sysfs_create(&mouse->device, NULL, &mouse_attr_group);
 	if (ret)
-		goto error_free;
+		goto error_destroy;
 
 	return ret;
+error_destroy:
+	lg_device_destroy(&mouse->device);
 error_free:
 	kfree(mouse);
 error:
@@ -193,8 +259,7 @@ void lg_vx_revolution_exit_device(struct lg_device *device)
 	if (mouse == NULL)
 		return;
 
-	sysfs_remove_files(&device->hdev->dev.kobj,
-		(const struct attribute**)mouse_attrs);
+	lg_device_sysfs_remove(&mouse->device, &mouse_attr_group);
 
 	lg_vx_revolution_destroy(mouse);
 }
@@ -8,10 +8,144 @@
  * any later version.
  */
 
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * The ioctl of the /dev/lg-hidpp* character devices. LG_HIDPP_IOC_BATCH
+ * sends a request for every operation to its devnum, through the queues of
+ * the driver, and returns when all of them got a reply or the timeout (in
+ * milliseconds, 0 for the default of one second) expired. A batch has at
+ * most LG_HIDPP_MAX_OPS operations, so the queues keep room for the requests
+ * of the driver itself.
+ *
+ * In size and data are the parameters of a request: up to 3 bytes are sent
+ * as a short report, more as a long one. Out status is 0 with the reply in
+ * size and data, -EIO for an error reply with its HID++ error code in error
+ * or -ETIMEDOUT without a reply.
+ *
+ * The devices also pass raw HID++ reports through, like hidraw but without
+ * taking replies away from the driver. A write of a short (7 bytes, report
+ * 0x10) or long (20 bytes, report 0x11) report queues it behind the requests
+ * of the driver, a read returns a reply to one of the reports written to
+ * that file: the report with the same devnum, action and register, or the
+ * error report naming it. At most LG_HIDPP_RAW_MAX_PENDING reports per file
+ * wait for their reply, for at most a second, and a write fails with EAGAIN
+ * while the queue of the driver is more than half full.
+ */
+
+#define LG_HIDPP_MAX_OPS 16
+#define LG_HIDPP_DATA_SIZE 16
+#define LG_HIDPP_RAW_MAX_PENDING 8
+
+struct lg_hidpp_op {
+    __u8 devnum;
+    __u8 action;
+    __u8 reg;
+    __u8 error;
+    __s32 status;
+    __u8 size;
+    __u8 reserved[3];
+    __u8 data[LG_HIDPP_DATA_SIZE];
+};
+
+struct lg_hidpp_batch {
+    __u32 count;
+    __u32 timeout_ms;
+    __u64 ops;
+};
+
+#define LG_HIDPP_IOC_BATCH _IOW('L', 0x01, struct lg_hidpp_batch)
+
+/*
+ * The events of the devices, in a ring of LG_HIDPP_RING_SIZE bytes which is
+ * mapped (read and write) at offset 0 of a /dev/lg-hidpp* device. The driver
+ * fills the event at head and only then moves head, the reader consumes the
+ * events up to head and moves tail. Both wrap around at size. When the ring
+ * is full new events are dropped and counted in dropped. The device polls
+ * readable as long as there are events.
+ *
+ * Every event has the report it was decoded from in data. Value is the
+ * battery level, the LCD page, the device code of a logon or the 3 bytes of
+ * the scrollmode (first byte lowest).
+ */
+
+#define LG_HIDPP_RING_SIZE 16384
+
+enum lg_hidpp_event_type {
+    LG_HIDPP_EVENT_LOGON = 1,
+    LG_HIDPP_EVENT_LOGOFF = 2,
+    LG_HIDPP_EVENT_BATTERY = 3,
+    LG_HIDPP_EVENT_LCD_PAGE = 4,
+    LG_HIDPP_EVENT_SCROLLMODE = 5,
+    LG_HIDPP_EVENT_UNKNOWN = 6,
+};
+
+struct lg_hidpp_event {
+    __u64 time_ns;
+    __u16 type;
+    __u8 devnum;
+    __u8 size;
+    __u32 value;
+    __u8 data[24];
+};
+
+struct lg_hidpp_ring {
+    __u32 head;
+    __u32 tail;
+    __u32 size;
+    __u32 dropped;
+    struct lg_hidpp_event events[];
+};
+
+/*
+ * The generic netlink family with the same events for every device, as one
+ * LG_HIDPP_CMD_EVENTS message with a nested LG_HIDPP_ATTR_EVENT per event.
+ * Events are collected for a short while and sent in batches. Logons and
+ * logoffs go to the slots group, battery, LCD page and scrollmode changes to
+ * the state group. Device, bus, vendor and product are the name and ids of
+ * the HID device, the receiver for a device behind one, which is told apart
+ * by the devnum.
+ */
+
+#define LG_HIDPP_GENL_NAME "lg_hidpp"
+#define LG_HIDPP_GENL_VERSION 1
+#define LG_HIDPP_GENL_SLOTS_GROUP "slots"
+#define LG_HIDPP_GENL_STATE_GROUP "state"
+
+enum lg_hidpp_genl_cmd {
+    LG_HIDPP_CMD_UNSPEC,
+    LG_HIDPP_CMD_EVENTS,
+};
+
+enum lg_hidpp_genl_attr {
+    LG_HIDPP_ATTR_UNSPEC,
+    LG_HIDPP_ATTR_EVENT,        /* nested */
+    LG_HIDPP_ATTR_DEVICE,       /* string */
+    LG_HIDPP_ATTR_BUS,          /* u16 */
+    LG_HIDPP_ATTR_VENDOR,       /* u16 */
+    LG_HIDPP_ATTR_PRODUCT,      /* u16 */
+    LG_HIDPP_ATTR_DEVNUM,       /* u8 */
+    LG_HIDPP_ATTR_TYPE,         /* u16, enum lg_hidpp_event_type */
+    LG_HIDPP_ATTR_VALUE,        /* u32 */
+    LG_HIDPP_ATTR_TIME,         /* u64, CLOCK_MONOTONIC in ns */
+    LG_HIDPP_ATTR_PAD,
+    __LG_HIDPP_ATTR_MAX,
+};
+
+#define LG_HIDPP_ATTR_MAX (__LG_HIDPP_ATTR_MAX - 1)
+
 #ifdef __KERNEL__
 
+#include <linux/atomic.h>
 #include <linux/hid.h>
+#include <linux/jiffies.h>
+#include <linux/kobject.h>
 #include <linux/list.h>
+#include <linux/sysfs.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #define USB_VENDOR_ID_LOGITECH          0x046d
 
@@ -23,10 +157,20 @@
 #define lg_device_dbg(device, fmt, arg...) hid_dbg(device.hdev, fmt, ##arg)
 
 struct lg_device;
+struct lg_device_queue;
 
 typedef void (*lg_device_hid_receive_handler)(struct lg_device *device,
                       const u8 *payload, size_t size);
 
+/*
+ * Gets the error replies instead of the receive_handler, with the action and
+ * register of the failed request and the error mapped to an errno. Drivers
+ * of receivers leave it NULL, so the errors for the devices in the slots
+ * reach the drivers of those devices.
+ */
+typedef void (*lg_device_error_handler)(struct lg_device *device, u8 action,
+                      u8 reg, int error);
+
 struct lg_driver {
     char *name;
     char *device_name;
@@ -39,8 +183,11 @@ struct lg_driver {
                         const u8 *buffer, size_t count);
     void (*exit)(struct lg_device *device);
     lg_device_hid_receive_handler receive_handler;
+    lg_device_error_handler error_handler;
     struct lg_device *(*find_device)(struct lg_device *device,
                      struct hid_device_id device_id);
+    struct lg_device_queue *(*find_out_queue)(struct lg_device *device,
+                     u8 devnum);
 
     struct list_head list;
 };
@@ -59,14 +206,85 @@ int lg_register_driver(struct lg_driver *driver);
 
 void lg_unregister_driver(struct lg_driver *driver);
 
+/*
+ * A set of drivers registered as one hid_driver. Its id_table is built from
+ * the device_id of every driver, with the driver_data pointing at the driver
+ * itself, so the HID core only has to match against one driver per module.
+ */
+struct lg_driver_set {
+    char *name;
+    struct lg_driver **drivers;
+    struct hid_driver hid_driver;
+};
+
+int lg_register_driver_set(struct lg_driver_set *set);
+
+void lg_unregister_driver_set(struct lg_driver_set *set);
+
 enum lg_device_actions {
     LG_DEVICE_ACTION_SET = 0x80,
     LG_DEVICE_ACTION_GET = 0x81,
     LG_DEVICE_ACTION_DO = 0x83,
+    LG_DEVICE_ACTION_ERROR = 0x8F,
 };
 
+#define LG_DEVICE_REPLY_TIMEOUT_MS 2000
+
+/*
+ * The traffic counters of a HID device, and of every slot of a receiver. The
+ * received, sent and bytes counters of a HID device include the reports of
+ * its slots, those of a slot only its own. The other counters are counted on
+ * the device they happened to and added to its parent, a slot is the child
+ * of its receiver. Replies are the reports with the msb of the sub id set,
+ * the unmatched ones are those no handler knew or for an empty slot.
+ */
+struct lg_device_stats {
+    struct list_head entry;
+    struct lg_device_stats *parent;
+    struct hid_device *hdev;
+    u8 devnum;
+
+    atomic_long_t received;
+    atomic_long_t sent;
+    atomic_long_t bytes_received;
+    atomic_long_t bytes_sent;
+    atomic_long_t replies;
+    atomic_long_t replies_unmatched;
+    atomic_long_t timeouts;
+    atomic_long_t queue_drops;
+    atomic_long_t worker_runs;
+};
+
+/* Adds to a counter of the stats and of its parents, stats may be NULL */
+#define lg_device_stats_add(stats, field, value) do {               \
+    struct lg_device_stats *__stats;                                \
+    for (__stats = (stats); __stats; __stats = __stats->parent)     \
+        atomic_long_add(value, &__stats->field);                    \
+} while (0)
+
+#define lg_device_stats_inc(stats, field)                           \
+    lg_device_stats_add(stats, field, 1)
+
+/*
+ * Waits until condition holds for the replies a driver requested. Returns 0,
+ * the errno an error reply stored in error, -ETIMEDOUT when the replies
+ * didn't come within LG_DEVICE_REPLY_TIMEOUT_MS or -ERESTARTSYS when
+ * interrupted. Timeouts are counted in the stats of the device.
+ */
+#define lg_device_wait_reply(device, wq, condition, error) ({       \
+    long __ret = wait_event_interruptible_timeout(wq,               \
+                    (error) || (condition),                         \
+                    msecs_to_jiffies(LG_DEVICE_REPLY_TIMEOUT_MS));  \
+    if (__ret >= 0)                                                 \
+        __ret = (error) ? (error) : __ret ? 0 : -ETIMEDOUT;         \
+    if (__ret == -ETIMEDOUT)                                        \
+        lg_device_stats_inc((device).stats, timeouts);              \
+    (int)__ret;                                                     \
+})
 
-struct lg_device_queue;
+
+struct lg_cdev;
+struct lg_unknown;
 
 struct lg_device {
     struct hid_device *hdev;
@@ -75,14 +293,68 @@ struct lg_device {
 
     struct lg_device_queue *out_queue;
     struct lg_device_queue *in_queue;
+
+    /* Only for a device with its own directory, see lg_device_sysfs_create */
+    struct kobject *kobj;
+
+    struct lg_cdev *cdev;
+    struct lg_unknown *unknown;
+
+    /* Owned by the HID device, a device in a slot points at the slot's */
+    struct lg_device_stats *stats;
 };
 
+/*
+ * Attributes of a lg_device. The callbacks get the lg_device the attribute
+ * belongs to, regardless of it being a direct HID device, with the attributes
+ * on the hid_device, or a device on a receiver, with its own kobject.
+ */
+struct lg_device_attribute {
+    struct device_attribute attr;
+    ssize_t (*show)(struct lg_device *device, char *buf);
+    ssize_t (*store)(struct lg_device *device, const char *buf, size_t count);
+};
+
+ssize_t lg_device_attr_show(struct device *dev,
+                    struct device_attribute *attr, char *buf);
+
+ssize_t lg_device_attr_store(struct device *dev,
+                    struct device_attribute *attr,
+                    const char *buf, size_t count);
+
+#define LG_DEVICE_ATTR(_name, _mode, _show, _store)                 \
+    struct lg_device_attribute lg_dev_attr_##_name = {              \
+        .attr = __ATTR(_name, _mode, lg_device_attr_show,           \
+                    lg_device_attr_store),                          \
+        .show = _show,                                              \
+        .store = _store,                                            \
+    }
+
+int lg_device_sysfs_create(struct lg_device *device, const char *name,
+                    const struct attribute_group *group);
+
+void lg_device_sysfs_remove(struct lg_device *device,
+                    const struct attribute_group *group);
+
+void lg_device_sysfs_notify(struct lg_device *device, const char *attr);
+
+void lg_device_post_event(struct lg_device *device, u16 type, u32 value,
+                    const u8 *buffer, size_t count);
+
+void lg_device_unhandled(struct lg_device *device, const char *kind,
+                    const u8 *buffer, size_t count);
+
 void lg_device_queue(struct lg_device *device, struct lg_device_queue *queue,
                         const u8 *buffer, size_t count);
 
 #define lg_device_queue_out(device, buffer, count)  \
     lg_device_queue(&device, device.out_queue, buffer, count)
 
+int lg_device_error_reply(const u8 *buffer, size_t count);
+
+void lg_device_dispatch(struct lg_device *device, const u8 *buffer,
+                        size_t count);
+
 void lg_device_send_worker(struct work_struct *work);
 
 void lg_device_receive_worker(struct work_struct *work);
@@ -100,6 +372,78 @@ int lg_device_init_copy(struct lg_device *device,
 
 void lg_device_destroy(struct lg_device *device);
 
+#define LG_RECEIVER_MAX_SLOTS 6
+#define LG_RECEIVER_MAX_IN_FLIGHT 4
+#define LG_RECEIVER_REPLY_TIMEOUT_MS 500
+
+/*
+ * A request sent to a slot and still waiting for its reply, or for an error
+ * report naming its action and register.
+ */
+struct lg_receiver_request {
+    u8 action;
+    u8 reg;
+    unsigned long sent_at;
+};
+
+/*
+ * A receiver multiplexes several devices over one hid_device. Every slot,
+ * addressed by devnum 1..slot_count, gets its own out_queue. The queues are
+ * served round-robin and a slot only gets a new request sent when it has
+ * less than max_in_flight requests waiting for a reply, so a slow or asleep
+ * device can't block the other devices on the same receiver. Only the reply
+ * to one of the requests in flight frees its place. The replies only carry
+ * the action and register, so the requests in flight for a slot are for
+ * different registers, a second one for the same register waits.
+ */
+struct lg_receiver_slot {
+    struct lg_device *device;
+    struct lg_device_queue *out_queue;
+
+    u8 in_flight;
+    struct lg_receiver_request requests[LG_RECEIVER_MAX_IN_FLIGHT];
+
+    struct lg_device_stats stats;
+};
+
+struct lg_receiver {
+    struct lg_device device;
+
+    u8 slot_count;
+    u8 max_in_flight;
+    unsigned long reply_timeout;
+
+    spinlock_t slot_lock;
+    u8 next_slot;
+    struct delayed_work send_worker;
+
+    struct lg_receiver_slot slots[LG_RECEIVER_MAX_SLOTS];
+};
+
+int lg_receiver_init(struct lg_receiver *receiver,
+                    struct hid_device *hdev,
+                    struct lg_driver *driver,
+                    u8 slot_count);
+
+void lg_receiver_destroy(struct lg_receiver *receiver);
+
+struct lg_device *lg_receiver_logon(struct lg_receiver *receiver, u8 devnum,
+                    u8 device_code, const u8 *buffer, size_t count);
+
+void lg_receiver_logoff(struct lg_receiver *receiver, u8 devnum);
+
+void lg_receiver_receive(struct lg_receiver *receiver,
+                    const u8 *buffer, size_t count);
+
+struct lg_device *lg_receiver_get_device(struct lg_receiver *receiver,
+                    u8 devnum);
+
+struct lg_device *lg_receiver_find_device(struct lg_device *device,
+                    struct hid_device_id device_id);
+
+struct lg_device_queue *lg_receiver_find_out_queue(struct lg_device *device,
+                    u8 devnum);
+
 #endif
 
 #endif
@@ -0,0 +1,607 @@
+/* C */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+/* Unix */
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <unistd.h>
+
+/* Linux */
+#include <linux/netlink.h>
+
+/*
+ * Warns when the batteries of a device are low.
+ *
+ * Usage: lg-battery [-l level] [-i interval] [-t timeout]
+ *
+ * Runs in the session of the user to warn, the warnings are sent as desktop
+ * notifications over the session bus and printed as a line of key=value
+ * pairs. A device is warned about when its battery level drops below level
+ * per cent (default 25), and again for every 5 per cent it drops further.
+ *
+ * Devices are found when the daemon starts and when the kernel reports a HID
+ * device or a device on a receiver coming or going. The battery attribute of
+ * every device is polled, the drivers wake up the pollers when a reply
+ * changes the level, whoever asked for it. Every interval minutes (default
+ * 30) the daemon asks for the levels itself, a device not answering within
+ * timeout seconds (default 5) is tried again next time.
+ */
+
+#define BATTERY_MAX_DEVICES 32
+#define BATTERY_WARN_STEP 5
+
+#define DBUS_BUFFER_SIZE 2048
+
+struct battery_device {
+	int fd;
+	char path[256];
+	char name[256];
+	int level;
+	int warned;
+	int seen;
+	int gone;
+};
+
+struct dbus_message {
+	uint8_t data[DBUS_BUFFER_SIZE];
+	size_t len;
+	int overflow;
+};
+
+struct battery_device devices[BATTERY_MAX_DEVICES];
+int device_count;
+
+int min_level = 25;
+int timeout_s = 5;
+
+int bus_fd = -1;
+uint32_t bus_serial;
+
+volatile sig_atomic_t running = 1;
+
+void stop(int sig)
+{
+	running = 0;
+}
+
+/* Only there to interrupt a read which takes too long */
+void interrupt(int sig)
+{
+}
+
+/* D-Bus, only what is needed to send notifications */
+
+void dbus_pad(struct dbus_message *msg, size_t align)
+{
+	while (msg->len % align) {
+		if (msg->len == sizeof(msg->data)) {
+			msg->overflow = 1;
+			return;
+		}
+		msg->data[msg->len++] = 0;
+	}
+}
+
+void dbus_put(struct dbus_message *msg, const void *data, size_t size)
+{
+	if (msg->len + size > sizeof(msg->data)) {
+		msg->overflow = 1;
+		return;
+	}
+
+	memcpy(msg->data + msg->len, data, size);
+	msg->len += size;
+}
+
+void dbus_put_u32(struct dbus_message *msg, uint32_t value)
+{
+	dbus_pad(msg, 4);
+	dbus_put(msg, &value, sizeof(value));
+}
+
+void dbus_put_string(struct dbus_message *msg, const char *value)
+{
+	dbus_put_u32(msg, strlen(value));
+	dbus_put(msg, value, strlen(value) + 1);
+}
+
+void dbus_put_signature(struct dbus_message *msg, const char *value)
+{
+	uint8_t len = strlen(value);
+
+	dbus_put(msg, &len, 1);
+	dbus_put(msg, value, len + 1);
+}
+
+/* A header field is a struct of the field code and a variant */
+void dbus_put_field(struct dbus_message *msg, uint8_t code, const char *type,
+		    const char *value)
+{
+	dbus_pad(msg, 8);
+	dbus_put(msg, &code, 1);
+	dbus_put_signature(msg, type);
+	if (type[0] == 'g')
+		dbus_put_signature(msg, value);
+	else
+		dbus_put_string(msg, value);
+}
+
+/*
+ * Sends a method call without waiting for the reply, the replies are read
+ * and thrown away by dbus_discard.
+ */
+int dbus_call(const char *destination, const char *path,
+	      const char *interface, const char *member,
+	      const char *signature, const struct dbus_message *body)
+{
+	struct dbus_message msg = { .len = 0 };
+	uint8_t fixed[4] = { 'l', 1, 0, 1 };
+	uint32_t fields;
+
+	dbus_put(&msg, fixed, sizeof(fixed));
+	dbus_put_u32(&msg, body ? body->len : 0);
+	dbus_put_u32(&msg, ++bus_serial);
+	dbus_put_u32(&msg, 0);
+
+	dbus_put_field(&msg, 1, "o", path);
+	dbus_put_field(&msg, 2, "s", interface);
+	dbus_put_field(&msg, 3, "s", member);
+	dbus_put_field(&msg, 6, "s", destination);
+	if (signature)
+		dbus_put_field(&msg, 8, "g", signature);
+
+	fields = msg.len - 16;
+	memcpy(msg.data + 12, &fields, sizeof(fields));
+	dbus_pad(&msg, 8);
+	if (body)
+		dbus_put(&msg, body->data, body->len);
+
+	if (msg.overflow || (body && body->overflow)) {
+		fprintf(stderr, "D-Bus message too big\n");
+		return -1;
+	}
+
+	if (write(bus_fd, msg.data, msg.len) != (ssize_t)msg.len)
+		return -1;
+
+	return 0;
+}
+
+void dbus_disconnect(void)
+{
+	if (bus_fd >= 0)
+		close(bus_fd);
+	bus_fd = -1;
+}
+
+/* Reads and ignores everything the bus sends, nothing of it is needed */
+void dbus_discard(void)
+{
+	char buf[4096];
+	ssize_t res;
+
+	while ((res = read(bus_fd, buf, sizeof(buf))) > 0)
+		;
+
+	if (!res || (res < 0 && errno != EAGAIN)) {
+		fprintf(stderr, "Lost the session bus\n");
+		dbus_disconnect();
+	}
+}
+
+int dbus_address(struct sockaddr_un *addr, socklen_t *len)
+{
+	const char *address = getenv("DBUS_SESSION_BUS_ADDRESS");
+	const char *runtime = getenv("XDG_RUNTIME_DIR");
+	const char *value;
+	size_t size;
+	int abstract = 0;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+
+	if (address && !strncmp(address, "unix:path=", 10)) {
+		value = address + 10;
+	} else if (address && !strncmp(address, "unix:abstract=", 14)) {
+		value = address + 14;
+		abstract = 1;
+	} else if (!address && runtime) {
+		snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/bus",
+			 runtime);
+		*len = sizeof(*addr);
+		return 0;
+	} else {
+		return -1;
+	}
+
+	size = strcspn(value, ",");
+	if (size + abstract >= sizeof(addr->sun_path))
+		return -1;
+	memcpy(addr->sun_path + abstract, value, size);
+	*len = offsetof(struct sockaddr_un, sun_path) + abstract + size;
+	return 0;
+}
+
+int dbus_connect(void)
+{
+	struct sockaddr_un addr;
+	socklen_t len;
+	char buf[256], uid[32], *p;
+	size_t i;
+	ssize_t res;
+
+	if (dbus_address(&addr, &len))
+		return -1;
+
+	bus_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (bus_fd < 0)
+		return -1;
+
+	if (connect(bus_fd, (struct sockaddr *)&addr, len))
+		goto err;
+
+	/* EXTERNAL authentication, with the uid in hex encoded ASCII */
+	snprintf(uid, sizeof(uid), "%u", getuid());
+	buf[0] = '\0';
+	p = buf + 1 + sprintf(buf + 1, "AUTH EXTERNAL ");
+	for (i = 0; uid[i]; i++)
+		p += sprintf(p, "%02x", uid[i]);
+	p += sprintf(p, "\r\n");
+	if (write(bus_fd, buf, p - buf) != p - buf)
+		goto err;
+
+	res = read(bus_fd, buf, sizeof(buf) - 1);
+	if (res < 3 || strncmp(buf, "OK ", 3))
+		goto err;
+
+	if (write(bus_fd, "BEGIN\r\n", 7) != 7)
+		goto err;
+
+	fcntl(bus_fd, F_SETFL, O_NONBLOCK);
+	bus_serial = 0;
+	if (dbus_call("org.freedesktop.DBus", "/org/freedesktop/DBus",
+		      "org.freedesktop.DBus", "Hello", NULL, NULL))
+		goto err;
+
+	return 0;
+err:
+	dbus_disconnect();
+	return -1;
+}
+
+int notify(const char *summary, const char *text)
+{
+	struct dbus_message body = { .len = 0 };
+
+	if (bus_fd < 0 && dbus_connect())
+		return -1;
+
+	dbus_put_string(&body, "lg-battery");
+	dbus_put_u32(&body, 0);
+	dbus_put_string(&body, "battery-caution");
+	dbus_put_string(&body, summary);
+	dbus_put_string(&body, text);
+	/* No actions and no hints, an empty a{sv} is still aligned to 8 */
+	dbus_put_u32(&body, 0);
+	dbus_put_u32(&body, 0);
+	dbus_pad(&body, 8);
+	dbus_put_u32(&body, 5000);
+
+	if (dbus_call("org.freedesktop.Notifications",
+		      "/org/freedesktop/Notifications",
+		      "org.freedesktop.Notifications", "Notify",
+		      "susssasa{sv}i", &body)) {
+		dbus_disconnect();
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Devices */
+
+void read_name(struct battery_device *device)
+{
+	char path[300];
+	int fd;
+	ssize_t res;
+
+	snprintf(path, sizeof(path), "%s/name", device->path);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		snprintf(device->name, sizeof(device->name), "%s",
+			 device->path);
+		return;
+	}
+
+	res = read(fd, device->name, sizeof(device->name) - 1);
+	device->name[res > 0 ? res : 0] = '\0';
+	device->name[strcspn(device->name, "\n")] = '\0';
+	close(fd);
+}
+
+/*
+ * Whether a failed read is worth trying again: our own timeout (EINTR), the
+ * driver's timeout (ETIMEDOUT) or an error reply of a sleeping or busy device
+ * (EBUSY, EIO).
+ */
+int transient_error(int error)
+{
+	return error == EINTR || error == ETIMEDOUT || error == EBUSY ||
+		error == EIO;
+}
+
+/*
+ * Reads the level, which asks the device for it. Returns -1 on a transient
+ * error and marks the device as gone on other errors.
+ */
+int read_level(struct battery_device *device)
+{
+	char buf[16];
+	ssize_t res;
+
+	alarm(timeout_s);
+	res = pread(device->fd, buf, sizeof(buf) - 1, 0);
+	alarm(0);
+
+	if (res < 0 && !transient_error(errno))
+		device->gone = 1;
+	if (res <= 0)
+		return -1;
+
+	buf[res] = '\0';
+	return atoi(buf);
+}
+
+void check_level(struct battery_device *device)
+{
+	char text[384];
+	int level;
+
+	level = read_level(device);
+	if (level < 0 || level == device->level)
+		return;
+
+	device->level = level;
+	if (level >= min_level) {
+		device->warned = 0;
+		return;
+	}
+
+	if (device->warned && level > device->warned - BATTERY_WARN_STEP)
+		return;
+	device->warned = level;
+
+	printf("device=\"%s\" battery=%d warned=1\n", device->name, level);
+	fflush(stdout);
+
+	snprintf(text, sizeof(text), "The batteries of device %s are low. "
+		 "Only %d%% remaining", device->name, level);
+	if (notify("Battery level low", text))
+		fprintf(stderr, "Unable to send a notification\n");
+}
+
+void remove_device(int i)
+{
+	close(devices[i].fd);
+	devices[i] = devices[--device_count];
+}
+
+/*
+ * Looks for devices which came and went, the ones which are still there
+ * keep their state.
+ */
+void scan_devices(void)
+{
+	struct battery_device *device;
+	glob_t files;
+	char path[256];
+	size_t i;
+	int j;
+
+	for (j = 0; j < device_count; j++)
+		devices[j].seen = 0;
+
+	glob("/sys/bus/hid/devices/*/battery", 0, NULL, &files);
+	glob("/sys/bus/hid/devices/*/*/battery",
+	     files.gl_pathc ? GLOB_APPEND : 0, NULL, &files);
+
+	for (i = 0; i < files.gl_pathc; i++) {
+		snprintf(path, sizeof(path), "%s", files.gl_pathv[i]);
+		*strrchr(path, '/') = '\0';
+
+		for (j = 0; j < device_count; j++) {
+			if (!strcmp(devices[j].path, path))
+				break;
+		}
+		if (j < device_count && !devices[j].gone) {
+			devices[j].seen = 1;
+			continue;
+		}
+
+		if (device_count == BATTERY_MAX_DEVICES)
+			break;
+
+		device = &devices[device_count];
+		memset(device, 0, sizeof(*device));
+		device->fd = open(files.gl_pathv[i], O_RDONLY | O_CLOEXEC);
+		if (device->fd < 0)
+			continue;
+
+		snprintf(device->path, sizeof(device->path), "%s", path);
+		read_name(device);
+		device->level = -1;
+		device->seen = 1;
+		device_count++;
+
+		fprintf(stderr, "Watching %s\n", device->name);
+		check_level(device);
+	}
+
+	globfree(&files);
+
+	for (j = device_count - 1; j >= 0; j--) {
+		if (!devices[j].seen) {
+			fprintf(stderr, "%s is gone\n", devices[j].name);
+			remove_device(j);
+		}
+	}
+}
+
+int open_uevents(void)
+{
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1,
+	};
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0)
+		return -1;
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Whether one of the uevents is about a HID device */
+int read_uevents(int fd)
+{
+	char buf[8192];
+	ssize_t res;
+	int found = 0;
+	char *p;
+
+	while ((res = recv(fd, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[res] = '\0';
+		for (p = buf; p < buf + res; p += strlen(p) + 1) {
+			if (!strcmp(p, "SUBSYSTEM=hid"))
+				found = 1;
+		}
+	}
+
+	return found;
+}
+
+int main(int argc, char **argv)
+{
+	struct pollfd fds[BATTERY_MAX_DEVICES + 2];
+	struct sigaction action;
+	long long interval_s = 30 * 60;
+	time_t next;
+	int uevent_fd, nfds, opt, res, i;
+
+	while ((opt = getopt(argc, argv, "l:i:t:")) != -1) {
+		switch (opt) {
+		case 'l':
+			min_level = atoi(optarg);
+			break;
+		case 'i':
+			interval_s = atoi(optarg) * 60LL;
+			break;
+		case 't':
+			timeout_s = atoi(optarg);
+			break;
+		default:
+			goto err_usage;
+		}
+	}
+
+	if (optind != argc || interval_s <= 0 || timeout_s <= 0)
+		goto err_usage;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	/* Without SA_RESTART, so the alarm interrupts a read */
+	action.sa_handler = interrupt;
+	sigaction(SIGALRM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	uevent_fd = open_uevents();
+	if (uevent_fd < 0) {
+		perror("Unable to listen for uevents");
+		return 1;
+	}
+
+	if (dbus_connect())
+		fprintf(stderr, "No session bus, only printing warnings\n");
+
+	scan_devices();
+	next = time(NULL) + interval_s;
+
+	while (running) {
+		fds[0].fd = uevent_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = bus_fd;
+		fds[1].events = POLLIN;
+		for (i = 0; i < device_count; i++) {
+			fds[i + 2].fd = devices[i].fd;
+			fds[i + 2].events = POLLPRI;
+		}
+		nfds = device_count + 2;
+
+		res = poll(fds, nfds, next > time(NULL) ?
+			   (next - time(NULL)) * 1000 : 0);
+		if (res < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+
+		if (res > 0 && (fds[1].revents & (POLLIN | POLLHUP)))
+			dbus_discard();
+
+		if (res > 0 && (fds[0].revents & POLLIN) &&
+				read_uevents(uevent_fd)) {
+			scan_devices();
+			continue;
+		}
+
+		/* Sysfs reports a changed attribute as POLLERR | POLLPRI */
+		for (i = 0; res > 0 && i < device_count; i++) {
+			if (fds[i + 2].revents & (POLLPRI | POLLERR))
+				check_level(&devices[i]);
+		}
+
+		if (time(NULL) >= next) {
+			for (i = 0; i < device_count; i++)
+				check_level(&devices[i]);
+			next = time(NULL) + interval_s;
+		}
+
+		for (i = device_count - 1; i >= 0; i--) {
+			if (devices[i].gone) {
+				fprintf(stderr, "%s is gone\n", devices[i].name);
+				remove_device(i);
+			}
+		}
+	}
+
+	for (i = device_count - 1; i >= 0; i--)
+		remove_device(i);
+	dbus_disconnect();
+	close(uevent_fd);
+	return 0;
+err_usage:
+	fprintf(stderr, "Usage: %s [-l level] [-i interval] [-t timeout]\n",
+		argv[0]);
+	return 1;
+}
@@ -0,0 +1,1564 @@
+/* C */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Unix */
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+/* Drivers, built against the shim */
+#include <linux/hid.h>
+#include <linux/hid-lg-extended.h>
+
+#include "hid-lg-device.h"
+#include "hid-lg-mx5500.h"
+
+/*
+ * Microbenchmarks of the driver core, with the drivers built in userspace on
+ * top of the kernel shim in shim/. Every benchmark prints one line of
+ * key=value pairs.
+ *
+ * Usage: lg-bench-core [-n reports] [-p producers] [-v] [benchmark...]
+ *
+ * The benchmarks are:
+ *   queue      producers filling one lg_device_queue, drained by its worker
+ *   ring       pushing and popping across the wraparound of a queue, and
+ *              filling a queue up to full and timing the drain by the worker
+ *   dispatch   handling a report by the receiver and keyboard handlers,
+ *              called directly so only the dispatch itself is measured
+ *   demux      the receiver paths: its own (0xFF) reports, logon (0x41)
+ *              and logoff (0x40), and dispatch to the devices in the slots
+ *   handlers   every entry of the keyboard and mouse handler tables
+ *   input      reports from raw_event through the in_queue to the handlers
+ *   roundtrip  reading the battery and status attributes of a keyboard on
+ *              a receiver, answered by a fake receiver, and the same
+ *              registers of the keyboard and the mouse in one batch of the
+ *              character device
+ *   events     LCD page changes of a keyboard on a receiver, read from the
+ *              event ring of the character device by another thread
+ *   netlink    the same LCD page changes and the logons, multicast in
+ *              batches on the generic netlink family
+ *   errors     reading the attributes of a keyboard on a receiver which
+ *              answers every request for it with a busy error reply
+ *   passthrough  raw reports for the mouse written to the character device
+ *              and their replies read back, while another thread keeps
+ *              reading the status attribute of the keyboard
+ *   unknown    reports no handler of the keyboard knows, counted and kept in
+ *              debugfs, and the reading of that file afterwards
+ *   stats      reading the battery attribute of a keyboard on a receiver,
+ *              and then the traffic counters of the receiver and its slots
+ *   latency    the battery attribute, battery, time and date one by one, and
+ *              the status attribute of a keyboard on a receiver which
+ *              answers after BENCH_RADIO_LATENCY_US, like a real radio link
+ * Producers is a comma separated list, the queue benchmark is run for every
+ * value. Without a benchmark all of them are run.
+ *
+ * Ring, demux and handlers also check what they measured: a corrupted
+ * report, a drain out of order or slower than BENCH_DRAIN_MAX_NS, a report
+ * lost between the slots or one no handler knew fails them, and the exit
+ * status is 1. make check runs just these three.
+ */
+
+#define BENCH_MAX_PRODUCERS 16
+#define BENCH_RADIO_LATENCY_US 8000
+
+/* The drain of a full queue by its worker must stay well below a jiffy */
+#define BENCH_DRAIN_MAX_NS 1000000
+
+/* FAKE_BUSY answers every request for a device with an error, busy */
+#define FAKE_RESPOND 1
+#define FAKE_BUSY 2
+
+struct fake_device {
+	struct hid_device *hdev;
+	int respond;
+	unsigned long sent;
+
+	/* Replies are delayed by latency_us, pending are still underway */
+	unsigned int latency_us;
+	unsigned long pending;
+};
+
+struct fake_reply {
+	struct hid_device *hdev;
+	u8 buf[20];
+	size_t len;
+};
+
+struct bench_producer {
+	pthread_t thread;
+	struct lg_device *device;
+	struct lg_device_queue *queue;
+	long reports;
+};
+
+struct bench_queue {
+	struct lg_device device;
+	struct lg_device_queue *queue;
+	unsigned long consumed;
+};
+
+/* Keeps the (single) worker busy, so a queue can be filled before draining */
+struct bench_gate {
+	struct work_struct work;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int entered;
+	int open;
+};
+
+struct bench_drain {
+	struct lg_device device;
+	struct lg_device_queue *queue;
+	long long start;
+	long long end;
+	unsigned long consumed;
+	unsigned long out_of_order;
+};
+
+struct bench_events {
+	pthread_t thread;
+	struct lg_hidpp_ring *ring;
+	int stop;
+	unsigned long events[LG_HIDPP_EVENT_UNKNOWN + 1];
+};
+
+struct bench_netlink {
+	unsigned long messages;
+	unsigned long events[LG_HIDPP_EVENT_UNKNOWN + 1];
+};
+
+struct bench_passthrough {
+	pthread_t thread;
+	struct kobject *kobj;
+	int stop;
+	unsigned long reads;
+	unsigned long failed;
+};
+
+struct bench_report {
+	const char *name;
+	int devnum;
+	u8 data[20];
+	int size;
+};
+
+long reports = 100000;
+int producer_values[BENCH_MAX_PRODUCERS] = { 1, 2, 4 };
+int producer_value_count = 3;
+
+long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int compare_latency(const void *a, const void *b)
+{
+	long long left = *(const long long *)a;
+	long long right = *(const long long *)b;
+
+	return left < right ? -1 : left > right;
+}
+
+/* Answers like the MX5500 receiver with a keyboard and mouse logged on */
+void fake_respond(struct hid_device *hdev, const u8 *buf, size_t len)
+{
+	u8 reply[20] = { 0x10, buf[1], buf[2], buf[3] };
+	u8 logon[7] = { 0x10, 0x01, 0x41, 0x04, 0x00, 0x0b, 0xb3 };
+	int size = 7;
+
+	if (len < 4 || buf[0] != 0x10)
+		return;
+
+	if (buf[1] == 0xFF) {
+		if (buf[2] == LG_DEVICE_ACTION_GET && buf[3] == 0x00)
+			reply[5] = 0x03;
+		else if (buf[2] == LG_DEVICE_ACTION_SET)
+			memcpy(&reply[4], &buf[4], 3);
+		shim_hid_input(hdev, reply, size);
+
+		if (buf[2] == LG_DEVICE_ACTION_SET && buf[3] == 0x02) {
+			shim_hid_input(hdev, logon, sizeof(logon));
+			logon[1] = 0x02;
+			logon[5] = 0x07;
+			logon[6] = 0xb0;
+			shim_hid_input(hdev, logon, sizeof(logon));
+		}
+		return;
+	}
+
+	if (((struct fake_device *)hdev->shim_data)->respond == FAKE_BUSY) {
+		reply[2] = LG_DEVICE_ACTION_ERROR;
+		reply[3] = buf[2];
+		reply[4] = buf[3];
+		reply[5] = 0x07;
+		shim_hid_input(hdev, reply, size);
+		return;
+	}
+
+	if (buf[2] == LG_DEVICE_ACTION_GET) {
+		switch (buf[3]) {
+		case 0x0d:
+			reply[4] = 75;
+			break;
+		case 0x31:
+			reply[0] = 0x11;
+			reply[5] = 12;
+			reply[6] = 34;
+			reply[7] = 56;
+			size = 20;
+			break;
+		case 0x32:
+			reply[5] = 10;
+			reply[6] = 19;
+			break;
+		case 0x33:
+			reply[4] = 26;
+			break;
+		case 0x56:
+			reply[4] = 0x02;
+			break;
+		}
+	} else {
+		memcpy(&reply[4], &buf[4], 3);
+	}
+
+	shim_hid_input(hdev, reply, size);
+}
+
+/* Answers a request after the latency, from a thread of its own */
+void *fake_radio(void *data)
+{
+	struct fake_reply *reply = data;
+	struct fake_device *fake = reply->hdev->shim_data;
+
+	usleep(fake->latency_us);
+	fake_respond(reply->hdev, reply->buf, reply->len);
+	__atomic_sub_fetch(&fake->pending, 1, __ATOMIC_RELEASE);
+	free(reply);
+	return NULL;
+}
+
+int fake_output_report(struct hid_device *hdev, u8 *buf, size_t len)
+{
+	struct fake_device *fake = hdev->shim_data;
+	struct fake_reply *reply;
+	pthread_t thread;
+
+	__atomic_add_fetch(&fake->sent, 1, __ATOMIC_RELAXED);
+	if (!fake->respond)
+		return len;
+
+	if (!fake->latency_us) {
+		fake_respond(hdev, buf, len);
+		return len;
+	}
+
+	reply = malloc(sizeof(*reply));
+	if (!reply)
+		return -ENOMEM;
+
+	reply->hdev = hdev;
+	reply->len = min(len, sizeof(reply->buf));
+	memcpy(reply->buf, buf, reply->len);
+
+	__atomic_add_fetch(&fake->pending, 1, __ATOMIC_RELAXED);
+	if (pthread_create(&thread, NULL, fake_radio, reply)) {
+		__atomic_sub_fetch(&fake->pending, 1, __ATOMIC_RELAXED);
+		free(reply);
+		return -ENOMEM;
+	}
+	pthread_detach(thread);
+
+	return len;
+}
+
+/* Waits for the replies still underway, before the device is destroyed */
+void fake_wait_radio(struct fake_device *fake)
+{
+	while (__atomic_load_n(&fake->pending, __ATOMIC_ACQUIRE))
+		usleep(1000);
+}
+
+int fake_raw_request(struct hid_device *hdev, unsigned char reportnum,
+		     u8 *buf, size_t len, unsigned char rtype, int reqtype)
+{
+	return fake_output_report(hdev, buf, len);
+}
+
+struct hid_ll_driver fake_ll_driver = {
+	.raw_request = fake_raw_request,
+	.output_report = fake_output_report,
+};
+
+int fake_create(struct fake_device *fake, u16 bus, u32 product, int respond)
+{
+	memset(fake, 0, sizeof(*fake));
+	fake->respond = respond;
+	fake->hdev = shim_hid_create(bus, USB_VENDOR_ID_LOGITECH, product,
+				     &fake_ll_driver, fake);
+	if (!fake->hdev) {
+		fprintf(stderr, "Unable to probe %04x\n", product);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Waits until the receiver created the device in a slot */
+struct lg_device *fake_wait_logon(struct fake_device *fake, u8 devnum)
+{
+	struct lg_receiver *receiver;
+	int i;
+
+	receiver = container_of(hid_get_drvdata(fake->hdev),
+				struct lg_receiver, device);
+
+	for (i = 0; i < 1000; i++) {
+		flush_scheduled_work();
+		if (receiver->slots[devnum - 1].device)
+			return receiver->slots[devnum - 1].device;
+		usleep(1000);
+	}
+
+	fprintf(stderr, "Device %d didn't log on\n", devnum);
+	return NULL;
+}
+
+/* The reports no handler knew, from hid-logitech/unknown/<device> */
+long fake_unknown_total(struct fake_device *fake)
+{
+	char path[128], buf[PAGE_SIZE];
+	unsigned long total;
+	ssize_t size;
+
+	snprintf(path, sizeof(path), "hid-logitech/unknown/%s",
+		 dev_name(&fake->hdev->dev));
+	size = shim_debugfs_show(path, buf, sizeof(buf) - 1);
+	if (size < 0)
+		return -1;
+	buf[size] = '\0';
+
+	if (sscanf(buf, "total=%lu", &total) != 1)
+		return -1;
+
+	return total;
+}
+
+void bench_queue_worker(struct work_struct *work)
+{
+	struct lg_device_queue *queue = container_of(work,
+					struct lg_device_queue, worker);
+	struct bench_queue *bench = container_of(queue->owner,
+					struct bench_queue, device);
+
+	while (lg_device_queue_peek(queue)) {
+		lg_device_queue_pop(queue);
+		bench->consumed++;
+	}
+}
+
+void *produce(void *data)
+{
+	struct bench_producer *producer = data;
+	u8 cmd[7] = { 0x10, 0x01, LG_DEVICE_ACTION_GET, 0x0d, 0x00, 0x00, 0x00 };
+	long i;
+
+	for (i = 0; i < producer->reports; i++)
+		lg_device_queue(producer->device, producer->queue, cmd,
+				sizeof(cmd));
+
+	return NULL;
+}
+
+int bench_queue(int producers)
+{
+	struct bench_producer producer[BENCH_MAX_PRODUCERS];
+	struct bench_queue bench;
+	unsigned long messages = shim_messages;
+	long long start, elapsed;
+	long total;
+	int i;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.queue = lg_device_queue_create(&bench.device, bench_queue_worker);
+	if (!bench.queue)
+		return -1;
+
+	start = now_ns();
+	for (i = 0; i < producers; i++) {
+		producer[i].device = &bench.device;
+		producer[i].queue = bench.queue;
+		producer[i].reports = reports / producers;
+		pthread_create(&producer[i].thread, NULL, produce, &producer[i]);
+	}
+	for (i = 0; i < producers; i++)
+		pthread_join(producer[i].thread, NULL);
+	flush_scheduled_work();
+	elapsed = now_ns() - start;
+
+	total = producer[0].reports * producers;
+	printf("benchmark=queue producers=%d reports=%ld consumed=%lu "
+	       "dropped=%lu ns_per_report=%.1f throughput=%.0f\n",
+	       producers, total, bench.consumed, shim_messages - messages,
+	       (double)elapsed / total, bench.consumed * 1e9 / elapsed);
+
+	lg_device_queue_shutdown(bench.queue);
+	lg_device_queue_put(bench.queue);
+	return 0;
+}
+
+void bench_gate_worker(struct work_struct *work)
+{
+	struct bench_gate *gate = container_of(work, struct bench_gate, work);
+
+	pthread_mutex_lock(&gate->lock);
+	gate->entered = 1;
+	pthread_cond_broadcast(&gate->cond);
+	while (!gate->open)
+		pthread_cond_wait(&gate->cond, &gate->lock);
+	pthread_mutex_unlock(&gate->lock);
+}
+
+void bench_gate_close(struct bench_gate *gate)
+{
+	gate->entered = 0;
+	gate->open = 0;
+	schedule_work(&gate->work);
+
+	pthread_mutex_lock(&gate->lock);
+	while (!gate->entered)
+		pthread_cond_wait(&gate->cond, &gate->lock);
+	pthread_mutex_unlock(&gate->lock);
+}
+
+void bench_gate_open(struct bench_gate *gate)
+{
+	pthread_mutex_lock(&gate->lock);
+	gate->open = 1;
+	pthread_cond_broadcast(&gate->cond);
+	pthread_mutex_unlock(&gate->lock);
+}
+
+void bench_idle_worker(struct work_struct *work)
+{
+}
+
+void bench_drain_worker(struct work_struct *work)
+{
+	struct lg_device_queue *queue = container_of(work,
+					struct lg_device_queue, worker);
+	struct bench_drain *drain = container_of(queue->owner,
+					struct bench_drain, device);
+
+	struct lg_device_buf *buf;
+
+	drain->start = now_ns();
+	while ((buf = lg_device_queue_peek(queue))) {
+		if (buf->data[4] != (u8)drain->consumed)
+			drain->out_of_order++;
+		lg_device_queue_pop(queue);
+		drain->consumed++;
+	}
+	drain->end = now_ns();
+}
+
+/* Every entry is checked, the ring must return them in order */
+int bench_ring_wraparound(void)
+{
+	u8 cmd[7] = { 0x10, 0x01, LG_DEVICE_ACTION_GET, 0x0d, 0x00, 0x00, 0x00 };
+	struct bench_queue bench;
+	struct lg_device_buf *buf;
+	unsigned long corrupt = 0;
+	long long start, elapsed;
+	long i;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.queue = lg_device_queue_create(&bench.device, bench_idle_worker);
+	if (!bench.queue)
+		return -1;
+
+	start = now_ns();
+	for (i = 0; i < reports; i++) {
+		cmd[4] = i;
+		lg_device_queue(&bench.device, bench.queue, cmd, sizeof(cmd));
+
+		buf = lg_device_queue_peek(bench.queue);
+		if (!buf || buf->size != sizeof(cmd) || buf->data[4] != cmd[4])
+			corrupt++;
+		lg_device_queue_pop(bench.queue);
+	}
+	elapsed = now_ns() - start;
+
+	printf("benchmark=ring test=wraparound reports=%ld wraps=%ld "
+	       "corrupt=%lu ns_per_report=%.1f\n", reports,
+	       reports / LG_DEVICE_BUFSIZE, corrupt,
+	       (double)elapsed / reports);
+
+	lg_device_queue_shutdown(bench.queue);
+	lg_device_queue_put(bench.queue);
+
+	if (corrupt) {
+		fprintf(stderr, "ring: %lu reports corrupted\n", corrupt);
+		return -1;
+	}
+
+	return 0;
+}
+
+int bench_ring_full(void)
+{
+	u8 cmd[7] = { 0x10, 0x01, LG_DEVICE_ACTION_GET, 0x0d, 0x00, 0x00, 0x00 };
+	struct bench_gate gate;
+	struct bench_drain drain;
+	unsigned long messages, dropped = 0, capacity = 0, short_fills = 0;
+	long long *drains;
+	long count = reports / LG_DEVICE_BUFSIZE ? reports / LG_DEVICE_BUFSIZE : 1;
+	long i;
+	int j, ret = 0;
+
+	drains = malloc(count * sizeof(*drains));
+	if (!drains)
+		return -1;
+
+	memset(&drain, 0, sizeof(drain));
+	drain.queue = lg_device_queue_create(&drain.device, bench_drain_worker);
+	if (!drain.queue) {
+		free(drains);
+		return -1;
+	}
+
+	memset(&gate, 0, sizeof(gate));
+	INIT_WORK(&gate.work, bench_gate_worker);
+	pthread_mutex_init(&gate.lock, NULL);
+	pthread_cond_init(&gate.cond, NULL);
+
+	for (i = 0; i < count; i++) {
+		bench_gate_close(&gate);
+
+		/* One more than fits, the last ones hit the full path */
+		messages = shim_messages;
+		drain.consumed = 0;
+		for (j = 0; j < LG_DEVICE_BUFSIZE; j++) {
+			cmd[4] = j;
+			lg_device_queue(&drain.device, drain.queue, cmd,
+					sizeof(cmd));
+		}
+		dropped += shim_messages - messages;
+
+		bench_gate_open(&gate);
+		flush_scheduled_work();
+
+		capacity = drain.consumed;
+		if (capacity != LG_DEVICE_BUFSIZE - 1)
+			short_fills++;
+		drains[i] = drain.end - drain.start;
+	}
+
+	qsort(drains, count, sizeof(*drains), compare_latency);
+	printf("benchmark=ring test=full drains=%ld capacity=%lu "
+	       "dropped_per_fill=%.1f out_of_order=%lu drain_p50_ns=%lld "
+	       "drain_p99_ns=%lld drain_max_ns=%lld\n", count, capacity,
+	       (double)dropped / count, drain.out_of_order, drains[count / 2],
+	       drains[(count - 1) * 99 / 100], drains[count - 1]);
+
+	/* Every fill keeps one entry free and drops the last report */
+	if (short_fills || dropped != count) {
+		fprintf(stderr, "ring: %lu fills didn't hold %d reports, "
+			"%lu dropped instead of %ld\n", short_fills,
+			LG_DEVICE_BUFSIZE - 1, dropped, count);
+		ret = -1;
+	}
+	if (drain.out_of_order) {
+		fprintf(stderr, "ring: %lu reports drained out of order\n",
+			drain.out_of_order);
+		ret = -1;
+	}
+	if (drains[(count - 1) * 99 / 100] > BENCH_DRAIN_MAX_NS) {
+		fprintf(stderr, "ring: drain p99 above %d ns\n",
+			BENCH_DRAIN_MAX_NS);
+		ret = -1;
+	}
+
+	lg_device_queue_shutdown(drain.queue);
+	lg_device_queue_put(drain.queue);
+	free(drains);
+	return ret;
+}
+
+int bench_ring(void)
+{
+	if (bench_ring_wraparound())
+		return -1;
+
+	return bench_ring_full();
+}
+
+double dispatch(struct lg_device *device, const u8 (*buf)[20],
+		const int *sizes, int count)
+{
+	long long start;
+	long i;
+
+	start = now_ns();
+	for (i = 0; i < reports; i++)
+		device->driver->receive_handler(device, buf[i % count],
+						sizes[i % count]);
+
+	return (double)(now_ns() - start) / reports;
+}
+
+int bench_dispatch(void)
+{
+	static const u8 keyboard_reports[][20] = {
+		{ 0x10, 0x01, 0x81, 0x0d, 0x4b },
+		{ 0x11, 0x01, 0x81, 0x31, 0x00, 0x0c, 0x22, 0x38 },
+		{ 0x10, 0x01, 0x81, 0x32, 0x00, 0x0a, 0x13 },
+		{ 0x10, 0x01, 0x81, 0x33, 0x1a },
+		{ 0x10, 0x01, 0x0b, 0x00, 0x02 },
+	};
+	static const int keyboard_sizes[] = { 7, 20, 7, 7, 7 };
+	struct fake_device fake;
+	struct lg_device *keyboard;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		return -1;
+
+	keyboard = fake_wait_logon(&fake, 1);
+	if (!keyboard)
+		goto err;
+
+	printf("benchmark=dispatch handler=keyboard reports=%ld "
+	       "ns_per_report=%.1f\n", reports,
+	       dispatch(keyboard, keyboard_reports, keyboard_sizes,
+			ARRAY_SIZE(keyboard_sizes)));
+	printf("benchmark=dispatch handler=receiver reports=%ld "
+	       "ns_per_report=%.1f\n", reports,
+	       dispatch(hid_get_drvdata(fake.hdev), keyboard_reports,
+			keyboard_sizes, ARRAY_SIZE(keyboard_sizes)));
+
+	shim_hid_destroy(fake.hdev);
+	return 0;
+err:
+	shim_hid_destroy(fake.hdev);
+	return -1;
+}
+
+double dispatch_report(struct lg_device *device,
+		       const struct bench_report *report)
+{
+	long long start;
+	long i;
+
+	start = now_ns();
+	for (i = 0; i < reports; i++)
+		device->driver->receive_handler(device, report->data,
+						report->size);
+
+	return (double)(now_ns() - start) / reports;
+}
+
+int bench_demux(void)
+{
+	static const struct bench_report receiver_report = {
+		"ff:81:00", 0xFF, { 0x10, 0xff, 0x81, 0x00, 0x00, 0x03 }, 7 };
+	static const u8 logoff[7] = { 0x10, 0x01, 0x40, 0x04, 0x00, 0x0b, 0xb3 };
+	static const u8 logon[7] = { 0x10, 0x01, 0x41, 0x04, 0x00, 0x0b, 0xb3 };
+	static const u8 slots[][7] = {
+		{ 0x10, 0x01, 0x81, 0x0d, 0x4b },
+		{ 0x10, 0x02, 0x81, 0x0d, 0x4b },
+	};
+	struct fake_device fake;
+	struct lg_device *receiver;
+	struct lg_receiver_slot *slot;
+	long received[2], unknown;
+	long long start;
+	long i, count;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		return -1;
+
+	if (!fake_wait_logon(&fake, 1) || !fake_wait_logon(&fake, 2))
+		goto err;
+
+	receiver = hid_get_drvdata(fake.hdev);
+	slot = container_of(receiver, struct lg_receiver, device)->slots;
+	unknown = fake_unknown_total(&fake);
+	received[0] = atomic_long_read(&slot[0].stats.received);
+	received[1] = atomic_long_read(&slot[1].stats.received);
+
+	printf("benchmark=demux path=receiver reports=%ld ns_per_report=%.1f\n",
+	       reports, dispatch_report(receiver, &receiver_report));
+
+	start = now_ns();
+	for (i = 0; i < reports; i++)
+		receiver->driver->receive_handler(receiver, slots[i & 1], 7);
+	printf("benchmark=demux path=slots reports=%ld ns_per_report=%.1f\n",
+	       reports, (double)(now_ns() - start) / reports);
+
+	/* Creates and destroys the keyboard, so far fewer iterations */
+	count = reports / 100 ? reports / 100 : 1;
+	start = now_ns();
+	for (i = 0; i < count; i++) {
+		receiver->driver->receive_handler(receiver, logoff,
+						  sizeof(logoff));
+		receiver->driver->receive_handler(receiver, logon,
+						  sizeof(logon));
+	}
+	printf("benchmark=demux path=logoff_logon cycles=%ld "
+	       "ns_per_cycle=%.1f\n", count,
+	       (double)(now_ns() - start) / count);
+
+	/* Every report reached its slot, and a handler knew all of them */
+	if (atomic_long_read(&slot[0].stats.received) - received[0] !=
+			(reports + 1) / 2 ||
+	    atomic_long_read(&slot[1].stats.received) - received[1] !=
+			reports / 2) {
+		fprintf(stderr, "demux: reports lost between the slots\n");
+		goto err;
+	}
+	if (unknown < 0 || fake_unknown_total(&fake) != unknown) {
+		fprintf(stderr, "demux: reports not handled\n");
+		goto err;
+	}
+	if (!slot[0].device) {
+		fprintf(stderr, "demux: device 1 gone after logon\n");
+		goto err;
+	}
+
+	shim_hid_destroy(fake.hdev);
+	return 0;
+err:
+	shim_hid_destroy(fake.hdev);
+	return -1;
+}
+
+int bench_handlers(void)
+{
+	static const struct bench_report handler_reports[] = {
+		{ "keyboard:0b:00", 1, { 0x10, 0x01, 0x0b, 0x00, 0x02 }, 7 },
+		{ "keyboard:81:0d", 1, { 0x10, 0x01, 0x81, 0x0d, 0x4b }, 7 },
+		{ "keyboard:81:31", 1, { 0x11, 0x01, 0x81, 0x31, 0x00, 0x0c,
+					 0x22, 0x38 }, 20 },
+		{ "keyboard:81:32", 1, { 0x10, 0x01, 0x81, 0x32, 0x00, 0x0a,
+					 0x13 }, 7 },
+		{ "keyboard:81:33", 1, { 0x10, 0x01, 0x81, 0x33, 0x1a }, 7 },
+		{ "mouse:81:0d", 2, { 0x10, 0x02, 0x81, 0x0d, 0x4b }, 7 },
+		{ "mouse:81:56", 2, { 0x10, 0x02, 0x81, 0x56, 0x02 }, 7 },
+		{ "mouse:80:56", 2, { 0x10, 0x02, 0x80, 0x56, 0x02 }, 7 },
+		{ }
+	};
+	const struct bench_report *report;
+	struct lg_device *devices[3];
+	struct fake_device fake;
+	long unknown;
+	int ret = 0;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		return -1;
+
+	devices[1] = fake_wait_logon(&fake, 1);
+	devices[2] = fake_wait_logon(&fake, 2);
+	if (!devices[1] || !devices[2]) {
+		shim_hid_destroy(fake.hdev);
+		return -1;
+	}
+
+	/* An entry which doesn't match its report ends up as unknown */
+	for (report = handler_reports; report->name; report++) {
+		unknown = fake_unknown_total(&fake);
+		printf("benchmark=handlers report=%s reports=%ld "
+		       "ns_per_report=%.1f\n", report->name, reports,
+		       dispatch_report(devices[report->devnum], report));
+		if (unknown < 0 || fake_unknown_total(&fake) != unknown) {
+			fprintf(stderr, "handlers: %s not handled\n",
+				report->name);
+			ret = -1;
+		}
+	}
+
+	shim_hid_destroy(fake.hdev);
+	return ret;
+}
+
+int bench_input(void)
+{
+	u8 report[7] = { 0x10, 0x01, 0x0b, 0x00, 0x01, 0x00, 0x00 };
+	struct fake_device fake;
+	unsigned long messages;
+	long long start, elapsed;
+	long i;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		return -1;
+
+	if (!fake_wait_logon(&fake, 1)) {
+		shim_hid_destroy(fake.hdev);
+		return -1;
+	}
+
+	messages = shim_messages;
+	start = now_ns();
+	for (i = 0; i < reports; i++) {
+		report[4] = i & 0x07;
+		shim_hid_input(fake.hdev, report, sizeof(report));
+	}
+	flush_scheduled_work();
+	elapsed = now_ns() - start;
+
+	printf("benchmark=input reports=%ld dropped=%lu ns_per_report=%.1f\n",
+	       reports, shim_messages - messages, (double)elapsed / reports);
+
+	shim_hid_destroy(fake.hdev);
+	return 0;
+}
+
+void *consume_events(void *data)
+{
+	struct bench_events *events = data;
+	struct lg_hidpp_ring *ring = events->ring;
+	u32 head, tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	int stop;
+
+	do {
+		stop = __atomic_load_n(&events->stop, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			sched_yield();
+			continue;
+		}
+
+		while (tail != head) {
+			if (ring->events[tail].type <= LG_HIDPP_EVENT_UNKNOWN)
+				events->events[ring->events[tail].type]++;
+			tail = (tail + 1) % ring->size;
+		}
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	} while (!stop || head != tail);
+
+	return NULL;
+}
+
+int bench_events(void)
+{
+	u8 report[7] = { 0x10, 0x01, 0x0b, 0x00, 0x00, 0x00, 0x00 };
+	struct bench_events events = { 0 };
+	struct fake_device fake;
+	struct file *file;
+	unsigned long messages;
+	long long start, elapsed;
+	long i;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		return -1;
+
+	if (!fake_wait_logon(&fake, 1) || !fake_wait_logon(&fake, 2))
+		goto err_destroy;
+
+	file = shim_misc_open("lg-hidpp0");
+	if (!file)
+		goto err_destroy;
+
+	events.ring = shim_misc_mmap(file, LG_HIDPP_RING_SIZE);
+	if (!events.ring)
+		goto err_release;
+
+	if (pthread_create(&events.thread, NULL, consume_events, &events))
+		goto err_release;
+
+	/* Flushing now and then keeps the in_queue from overflowing */
+	messages = shim_messages;
+	start = now_ns();
+	for (i = 0; i < reports; i++) {
+		report[4] = i & 0x07;
+		shim_hid_input(fake.hdev, report, sizeof(report));
+		if (i % 16 == 15)
+			flush_scheduled_work();
+	}
+	flush_scheduled_work();
+	elapsed = now_ns() - start;
+
+	__atomic_store_n(&events.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(events.thread, NULL);
+
+	printf("benchmark=events reports=%ld dropped=%lu logons=%lu "
+	       "lcd_pages=%lu ring_size=%u ring_dropped=%u "
+	       "ns_per_report=%.1f\n", reports, shim_messages - messages,
+	       events.events[LG_HIDPP_EVENT_LOGON],
+	       events.events[LG_HIDPP_EVENT_LCD_PAGE], events.ring->size,
+	       events.ring->dropped, (double)elapsed / reports);
+
+	shim_misc_release(file);
+	shim_hid_destroy(fake.hdev);
+	return 0;
+err_release:
+	shim_misc_release(file);
+err_destroy:
+	shim_hid_destroy(fake.hdev);
+	return -1;
+}
+
+struct bench_netlink netlink_counts;
+
+/* Counts the events of a message by their type */
+void receive_netlink(const struct genl_family *family, unsigned int group,
+		     const void *data, size_t len)
+{
+	const struct nlattr *nla, *event;
+	const unsigned char *p = data, *end = p + len;
+	const unsigned char *q, *event_end;
+	u16 type;
+
+	netlink_counts.messages++;
+
+	p += NLA_ALIGN(sizeof(struct nlmsghdr)) +
+		NLA_ALIGN(sizeof(struct genlmsghdr));
+	for (; p + NLA_HDRLEN <= end; p += NLA_ALIGN(nla->nla_len)) {
+		nla = (const struct nlattr *)p;
+		if (nla->nla_len < NLA_HDRLEN)
+			break;
+		if ((nla->nla_type & ~NLA_F_NESTED) != LG_HIDPP_ATTR_EVENT)
+			continue;
+
+		event_end = p + nla->nla_len;
+		for (q = p + NLA_HDRLEN; q + NLA_HDRLEN <= event_end;
+				q += NLA_ALIGN(event->nla_len)) {
+			event = (const struct nlattr *)q;
+			if (event->nla_len < NLA_HDRLEN)
+				break;
+			if (event->nla_type != LG_HIDPP_ATTR_TYPE)
+				continue;
+
+			memcpy(&type, q + NLA_HDRLEN, sizeof(type));
+			if (type <= LG_HIDPP_EVENT_UNKNOWN)
+				netlink_counts.events[type]++;
+		}
+	}
+}
+
+int bench_netlink(void)
+{
+	u8 report[7] = { 0x10, 0x01, 0x0b, 0x00, 0x00, 0x00, 0x00 };
+	struct fake_device fake;
+	long long start, elapsed;
+	unsigned long events;
+	long i;
+
+	memset(&netlink_counts, 0, sizeof(netlink_counts));
+	shim_genl_receive = receive_netlink;
+	shim_genl_listeners = 1;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		goto err;
+
+	if (!fake_wait_logon(&fake, 1) || !fake_wait_logon(&fake, 2))
+		goto err_destroy;
+
+	/* Flushing now and then keeps the in_queue from overflowing */
+	start = now_ns();
+	for (i = 0; i < reports; i++) {
+		report[4] = i & 0x07;
+		shim_hid_input(fake.hdev, report, sizeof(report));
+		if (i % 16 == 15)
+			flush_scheduled_work();
+	}
+	flush_scheduled_work();
+	elapsed = now_ns() - start;
+
+	/* Let the last batch go out */
+	usleep(100000);
+	flush_scheduled_work();
+
+	events = netlink_counts.events[LG_HIDPP_EVENT_LOGON] +
+		netlink_counts.events[LG_HIDPP_EVENT_LCD_PAGE];
+	printf("benchmark=netlink reports=%ld messages=%lu logons=%lu "
+	       "lcd_pages=%lu events_per_message=%.1f ns_per_report=%.1f\n",
+	       reports, netlink_counts.messages,
+	       netlink_counts.events[LG_HIDPP_EVENT_LOGON],
+	       netlink_counts.events[LG_HIDPP_EVENT_LCD_PAGE],
+	       netlink_counts.messages ?
+	       (double)events / netlink_counts.messages : 0,
+	       (double)elapsed / reports);
+
+	shim_hid_destroy(fake.hdev);
+	shim_genl_listeners = 0;
+	return 0;
+err_destroy:
+	shim_hid_destroy(fake.hdev);
+err:
+	shim_genl_listeners = 0;
+	return -1;
+}
+
+void *read_status(void *data)
+{
+	struct bench_passthrough *passthrough = data;
+	char buf[PAGE_SIZE];
+
+	while (!__atomic_load_n(&passthrough->stop, __ATOMIC_ACQUIRE)) {
+		if (shim_sysfs_show(passthrough->kobj, "status", buf) > 0)
+			passthrough->reads++;
+		else
+			passthrough->failed++;
+	}
+
+	return NULL;
+}
+
+/* Keeps LG_HIDPP_RAW_MAX_PENDING reports waiting, every reply is checked */
+int bench_passthrough(void)
+{
+	const u8 registers[] = { 0x0d, 0x56 };
+	struct bench_passthrough passthrough = { 0 };
+	u8 cmd[7] = { 0x10, 0x02, LG_DEVICE_ACTION_GET };
+	u8 reply[20];
+	struct fake_device fake;
+	struct file *file;
+	unsigned long mismatched = 0, refused = 0;
+	long long start, elapsed;
+	long count = reports / 10 ? reports / 10 : 1;
+	long sent = 0, received = 0;
+	ssize_t res;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		return -1;
+
+	if (fake_wait_logon(&fake, 1) && fake_wait_logon(&fake, 2))
+		passthrough.kobj = shim_kobject_find(&fake.hdev->dev.kobj,
+						     "keyboard");
+	if (!passthrough.kobj)
+		goto err_destroy;
+
+	file = shim_misc_open("lg-hidpp0");
+	if (!file)
+		goto err_destroy;
+
+	if (pthread_create(&passthrough.thread, NULL, read_status,
+			   &passthrough))
+		goto err_release;
+
+	start = now_ns();
+	while (received < count) {
+		while (sent < count &&
+				sent - received < LG_HIDPP_RAW_MAX_PENDING) {
+			cmd[3] = registers[sent % ARRAY_SIZE(registers)];
+			res = shim_misc_write(file, cmd, sizeof(cmd));
+			if (res == -EAGAIN) {
+				refused++;
+				break;
+			} else if (res != sizeof(cmd)) {
+				goto err_stop;
+			}
+			sent++;
+		}
+
+		res = shim_misc_read(file, reply, sizeof(reply));
+		if (res < 4)
+			goto err_stop;
+
+		if (reply[1] != 0x02 || reply[2] != LG_DEVICE_ACTION_GET ||
+				reply[3] != registers[received %
+						      ARRAY_SIZE(registers)])
+			mismatched++;
+		received++;
+	}
+	elapsed = now_ns() - start;
+
+	__atomic_store_n(&passthrough.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(passthrough.thread, NULL);
+
+	printf("benchmark=passthrough requests=%ld mismatched=%lu "
+	       "refused=%lu status_reads=%lu status_failed=%lu "
+	       "ns_per_request=%.1f\n", count, mismatched, refused,
+	       passthrough.reads, passthrough.failed,
+	       (double)elapsed / count);
+
+	shim_misc_release(file);
+	shim_hid_destroy(fake.hdev);
+	return 0;
+err_stop:
+	fprintf(stderr, "Raw request %ld failed\n", received);
+	__atomic_store_n(&passthrough.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(passthrough.thread, NULL);
+err_release:
+	shim_misc_release(file);
+err_destroy:
+	shim_hid_destroy(fake.hdev);
+	return -1;
+}
+
+int bench_roundtrip_attribute(struct kobject *kobj, const char *attribute,
+			       long long *latencies, long count)
+{
+	char buf[PAGE_SIZE];
+	long long start;
+	long i;
+
+	for (i = 0; i < count; i++) {
+		start = now_ns();
+		if (shim_sysfs_show(kobj, attribute, buf) <= 0)
+			return -1;
+		latencies[i] = now_ns() - start;
+	}
+
+	qsort(latencies, count, sizeof(*latencies), compare_latency);
+	printf("benchmark=roundtrip attribute=%s reads=%ld p50_ns=%lld "
+	       "p99_ns=%lld max_ns=%lld\n", attribute, count,
+	       latencies[count / 2], latencies[(count - 1) * 99 / 100],
+	       latencies[count - 1]);
+	return 0;
+}
+
+/* The registers of the keyboard (1) and mouse (2) read by a batch */
+const u8 batch_registers[][2] = {
+	{ 1, 0x0d }, { 1, 0x31 }, { 1, 0x32 }, { 1, 0x33 },
+	{ 2, 0x0d }, { 2, 0x56 },
+};
+
+int bench_roundtrip_batch(long long *latencies, long count)
+{
+	struct lg_hidpp_op ops[ARRAY_SIZE(batch_registers)];
+	struct lg_hidpp_batch batch = {
+		.count = ARRAY_SIZE(ops),
+		.ops = (uintptr_t)ops,
+	};
+	struct file *file;
+	long long start;
+	long i;
+	size_t j;
+
+	file = shim_misc_open("lg-hidpp0");
+	if (!file) {
+		fprintf(stderr, "No character device\n");
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		memset(ops, 0, sizeof(ops));
+		for (j = 0; j < ARRAY_SIZE(ops); j++) {
+			ops[j].devnum = batch_registers[j][0];
+			ops[j].action = LG_DEVICE_ACTION_GET;
+			ops[j].reg = batch_registers[j][1];
+		}
+
+		start = now_ns();
+		if (shim_misc_ioctl(file, LG_HIDPP_IOC_BATCH,
+				    (unsigned long)&batch))
+			goto err_release;
+		latencies[i] = now_ns() - start;
+
+		for (j = 0; j < ARRAY_SIZE(ops); j++) {
+			if (ops[j].status)
+				goto err_release;
+		}
+	}
+
+	shim_misc_release(file);
+
+	qsort(latencies, count, sizeof(*latencies), compare_latency);
+	printf("benchmark=roundtrip batch=%zu batches=%ld p50_ns=%lld "
+	       "p99_ns=%lld max_ns=%lld\n", ARRAY_SIZE(ops), count,
+	       latencies[count / 2], latencies[(count - 1) * 99 / 100],
+	       latencies[count - 1]);
+	return 0;
+err_release:
+	fprintf(stderr, "Batch %ld failed\n", i);
+	shim_misc_release(file);
+	return -1;
+}
+
+int bench_errors(void)
+{
+	const char *attributes[] = { "battery", "time", "date", "status" };
+	struct fake_device fake;
+	struct kobject *kobj = NULL;
+	char buf[PAGE_SIZE];
+	unsigned long busy = 0, other = 0;
+	long long start, elapsed, max = 0;
+	long count = reports / 100 ? reports / 100 : 1;
+	long i;
+	ssize_t res;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		return -1;
+
+	if (fake_wait_logon(&fake, 1))
+		kobj = shim_kobject_find(&fake.hdev->dev.kobj, "keyboard");
+	if (!kobj)
+		goto err_destroy;
+
+	fake.respond = FAKE_BUSY;
+
+	start = now_ns();
+	for (i = 0; i < count; i++) {
+		elapsed = now_ns();
+		res = shim_sysfs_show(kobj, attributes[i % ARRAY_SIZE(attributes)],
+				      buf);
+		elapsed = now_ns() - elapsed;
+		if (elapsed > max)
+			max = elapsed;
+
+		if (res == -EBUSY)
+			busy++;
+		else
+			other++;
+	}
+	elapsed = now_ns() - start;
+
+	printf("benchmark=errors reads=%ld busy=%lu other=%lu "
+	       "ns_per_read=%.1f max_ns=%lld\n", count, busy, other,
+	       (double)elapsed / count, max);
+
+	shim_hid_destroy(fake.hdev);
+	return 0;
+err_destroy:
+	shim_hid_destroy(fake.hdev);
+	return -1;
+}
+
+int bench_roundtrip(void)
+{
+	struct fake_device fake;
+	struct kobject *kobj;
+	long long *latencies;
+	long count = reports / 100 ? reports / 100 : 1;
+
+	latencies = malloc(count * sizeof(*latencies));
+	if (!latencies)
+		return -1;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		goto err_free;
+
+	kobj = NULL;
+	if (fake_wait_logon(&fake, 1) && fake_wait_logon(&fake, 2))
+		kobj = shim_kobject_find(&fake.hdev->dev.kobj, "keyboard");
+	if (!kobj)
+		goto err_destroy;
+
+	if (bench_roundtrip_attribute(kobj, "battery", latencies, count) ||
+			bench_roundtrip_attribute(kobj, "status", latencies,
+						  count) ||
+			bench_roundtrip_batch(latencies, count))
+		goto err_destroy;
+
+	shim_hid_destroy(fake.hdev);
+	free(latencies);
+	return 0;
+err_destroy:
+	shim_hid_destroy(fake.hdev);
+err_free:
+	free(latencies);
+	return -1;
+}
+
+int bench_unknown(void)
+{
+	u8 report[7] = { 0x10, 0x01, 0x81, 0xf0 };
+	struct fake_device fake;
+	struct lg_device *keyboard;
+	char path[128], buf[PAGE_SIZE];
+	unsigned long messages, total = 0;
+	long long start, elapsed;
+	ssize_t size;
+	long i;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		return -1;
+
+	keyboard = fake_wait_logon(&fake, 1);
+	if (!keyboard)
+		goto err;
+
+	messages = shim_messages;
+	start = now_ns();
+	for (i = 0; i < reports; i++) {
+		report[3] = 0xf0 + (i & 0x0f);
+		keyboard->driver->receive_handler(keyboard, report,
+						  sizeof(report));
+	}
+	elapsed = now_ns() - start;
+	messages = shim_messages - messages;
+
+	snprintf(path, sizeof(path), "hid-logitech/unknown/%s",
+		 dev_name(&fake.hdev->dev));
+	start = now_ns();
+	size = shim_debugfs_show(path, buf, sizeof(buf) - 1);
+	if (size < 0)
+		goto err;
+	buf[size] = '\0';
+	sscanf(buf, "total=%lu", &total);
+
+	printf("benchmark=unknown reports=%ld ns_per_report=%.1f "
+	       "messages=%lu total=%lu show_bytes=%zd show_ns=%lld\n",
+	       reports, (double)elapsed / reports, messages, total, size,
+	       now_ns() - start);
+
+	shim_hid_destroy(fake.hdev);
+	return 0;
+err:
+	shim_hid_destroy(fake.hdev);
+	return -1;
+}
+
+int bench_stats(void)
+{
+	struct fake_device fake;
+	struct kobject *kobj = NULL;
+	char buf[PAGE_SIZE], *line;
+	char device[64];
+	unsigned long slot, sent = 0, matched = 0, value, lines = 0;
+	long count = reports / 100 ? reports / 100 : 1;
+	long long start, elapsed;
+	ssize_t size;
+	long i;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		return -1;
+
+	if (fake_wait_logon(&fake, 1))
+		kobj = shim_kobject_find(&fake.hdev->dev.kobj, "keyboard");
+	if (!kobj)
+		goto err;
+
+	start = now_ns();
+	for (i = 0; i < count; i++) {
+		if (shim_sysfs_show(kobj, "battery", buf) <= 0)
+			goto err;
+	}
+	elapsed = now_ns() - start;
+
+	start = now_ns();
+	size = shim_debugfs_show("hid-logitech/stats", buf, sizeof(buf) - 1);
+	if (size < 0)
+		goto err;
+	buf[size] = '\0';
+
+	/* The counters of the keyboard, in slot 1 */
+	for (line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+		lines++;
+		if (sscanf(line, "device=%63s slot=%lu received=%*d sent=%lu",
+			   device, &slot, &value) == 3 && slot == 1 &&
+				!strcmp(device, dev_name(&fake.hdev->dev))) {
+			sent = value;
+			sscanf(strstr(line, "replies_matched="),
+			       "replies_matched=%lu", &matched);
+		}
+	}
+
+	printf("benchmark=stats reads=%ld ns_per_read=%.1f lines=%lu "
+	       "slot_sent=%lu slot_replies_matched=%lu show_ns=%lld\n",
+	       count, (double)elapsed / count, lines, sent, matched,
+	       now_ns() - start);
+
+	shim_hid_destroy(fake.hdev);
+	return 0;
+err:
+	shim_hid_destroy(fake.hdev);
+	return -1;
+}
+
+/* Reads the attributes one after another, count times */
+int bench_latency_read(struct kobject *kobj, const char *name,
+		       const char **attributes, size_t attribute_count,
+		       long long *latencies, long count)
+{
+	char buf[PAGE_SIZE];
+	long long start;
+	size_t j;
+	long i;
+
+	for (i = 0; i < count; i++) {
+		start = now_ns();
+		for (j = 0; j < attribute_count; j++) {
+			if (shim_sysfs_show(kobj, attributes[j], buf) <= 0)
+				return -1;
+		}
+		latencies[i] = now_ns() - start;
+	}
+
+	qsort(latencies, count, sizeof(*latencies), compare_latency);
+	printf("benchmark=latency latency_us=%d read=%s reads=%ld "
+	       "p50_ns=%lld max_ns=%lld round_trips=%.1f\n",
+	       BENCH_RADIO_LATENCY_US, name, count, latencies[count / 2],
+	       latencies[count - 1],
+	       latencies[count / 2] / (BENCH_RADIO_LATENCY_US * 1000.0));
+	return 0;
+}
+
+int bench_latency(void)
+{
+	static const char *battery[] = { "battery" };
+	static const char *separate[] = { "battery", "time", "date" };
+	static const char *status[] = { "status" };
+	struct fake_device fake;
+	struct kobject *kobj = NULL;
+	long long *latencies;
+	long count = reports / 1000 ? reports / 1000 : 1;
+
+	latencies = malloc(count * sizeof(*latencies));
+	if (!latencies)
+		return -1;
+
+	if (fake_create(&fake, BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER,
+			FAKE_RESPOND))
+		goto err_free;
+
+	if (fake_wait_logon(&fake, 1))
+		kobj = shim_kobject_find(&fake.hdev->dev.kobj, "keyboard");
+	if (!kobj)
+		goto err_destroy;
+
+	fake.latency_us = BENCH_RADIO_LATENCY_US;
+
+	if (bench_latency_read(kobj, "battery", battery, ARRAY_SIZE(battery),
+			       latencies, count) ||
+			bench_latency_read(kobj, "separate", separate,
+					   ARRAY_SIZE(separate), latencies,
+					   count) ||
+			bench_latency_read(kobj, "status", status,
+					   ARRAY_SIZE(status), latencies,
+					   count))
+		goto err_destroy;
+
+	fake_wait_radio(&fake);
+	shim_hid_destroy(fake.hdev);
+	free(latencies);
+	return 0;
+err_destroy:
+	fake_wait_radio(&fake);
+	shim_hid_destroy(fake.hdev);
+err_free:
+	free(latencies);
+	return -1;
+}
+
+int run(const char *benchmark)
+{
+	int i;
+
+	if (!strcmp(benchmark, "queue")) {
+		for (i = 0; i < producer_value_count; i++) {
+			if (bench_queue(producer_values[i]))
+				return -1;
+		}
+		return 0;
+	} else if (!strcmp(benchmark, "ring")) {
+		return bench_ring();
+	} else if (!strcmp(benchmark, "dispatch")) {
+		return bench_dispatch();
+	} else if (!strcmp(benchmark, "demux")) {
+		return bench_demux();
+	} else if (!strcmp(benchmark, "handlers")) {
+		return bench_handlers();
+	} else if (!strcmp(benchmark, "input")) {
+		return bench_input();
+	} else if (!strcmp(benchmark, "roundtrip")) {
+		return bench_roundtrip();
+	} else if (!strcmp(benchmark, "events")) {
+		return bench_events();
+	} else if (!strcmp(benchmark, "netlink")) {
+		return bench_netlink();
+	} else if (!strcmp(benchmark, "errors")) {
+		return bench_errors();
+	} else if (!strcmp(benchmark, "passthrough")) {
+		return bench_passthrough();
+	} else if (!strcmp(benchmark, "unknown")) {
+		return bench_unknown();
+	} else if (!strcmp(benchmark, "stats")) {
+		return bench_stats();
+	} else if (!strcmp(benchmark, "latency")) {
+		return bench_latency();
+	}
+
+	fprintf(stderr, "Unknown benchmark %s\n", benchmark);
+	return -1;
+}
+
+int parse_producers(const char *arg)
+{
+	char *end;
+
+	producer_value_count = 0;
+	do {
+		if (producer_value_count == BENCH_MAX_PRODUCERS)
+			return -1;
+
+		producer_values[producer_value_count] = strtol(arg, &end, 10);
+		if (end == arg || producer_values[producer_value_count] < 1 ||
+				producer_values[producer_value_count] >
+				BENCH_MAX_PRODUCERS)
+			return -1;
+		producer_value_count++;
+		arg = end + 1;
+	} while (*end == ',');
+
+	return *end ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *benchmarks[] = { "queue", "ring", "dispatch",
+					    "demux", "handlers", "input",
+					    "roundtrip", "errors", "events",
+					    "netlink", "passthrough", "unknown",
+					    "stats", "latency", NULL };
+	int opt, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "n:p:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			reports = atol(optarg);
+			break;
+		case 'p':
+			if (parse_producers(optarg))
+				goto err_usage;
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			goto err_usage;
+		}
+	}
+
+	if (reports <= 0)
+		goto err_usage;
+
+	if (shim_modules_load()) {
+		fprintf(stderr, "Unable to load the drivers\n");
+		return 1;
+	}
+
+	if (optind == argc) {
+		for (i = 0; benchmarks[i] && !ret; i++)
+			ret = run(benchmarks[i]);
+	} else {
+		for (i = optind; i < argc && !ret; i++)
+			ret = run(argv[i]);
+	}
+
+	shim_modules_unload();
+	return ret ? 1 : 0;
+err_usage:
+	fprintf(stderr, "Usage: %s [-n reports] [-p producers] [-v] "
+		"[benchmark...]\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,403 @@
+#define _GNU_SOURCE
+
+/* C */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+/* Unix */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+ * Measures how the sysfs attributes of the drivers perform, against real
+ * devices or the ones created by lg-emulator.
+ *
+ * Usage: lg-bench [-t threads] [-r rate] [-d duration] [-T timeout]
+ *                 attribute...
+ *
+ * An attribute is either a path or the name of an attribute (battery, time,
+ * date, scrollmode or lcd_page), which is benchmarked on every device it is
+ * found on. Threads and rate are comma separated lists which are all
+ * combined; the rate is the number of reads per second per reader, where 0
+ * reads as fast as possible. The duration is in seconds, the timeout of a
+ * single read in milliseconds.
+ *
+ * Every run prints one line of key=value pairs, latencies are in
+ * microseconds.
+ */
+
+#define BENCH_MAX_VALUES 16
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+struct bench_reader {
+	pthread_t thread;
+	const char *path;
+	int rate;
+
+	long long *latencies;
+	size_t count;
+	size_t size;
+	unsigned long timeouts;
+	unsigned long errors;
+	long long cpu_us;
+};
+
+int thread_values[BENCH_MAX_VALUES] = { 1 };
+int thread_value_count = 1;
+int rate_values[BENCH_MAX_VALUES] = { 0 };
+int rate_value_count = 1;
+int duration = 5;
+int timeout_ms = 1000;
+
+volatile sig_atomic_t running;
+
+long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+long long thread_cpu_us(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_THREAD, &usage))
+		return 0;
+
+	return (long long)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+		1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* Only there to interrupt the read, which sleeps until the reply arrives */
+void interrupt(int sig)
+{
+}
+
+int parse_values(const char *arg, int *values, int *count)
+{
+	char *end;
+
+	*count = 0;
+	do {
+		if (*count == BENCH_MAX_VALUES)
+			return -1;
+
+		values[*count] = strtol(arg, &end, 10);
+		if (end == arg || values[*count] < 0)
+			return -1;
+		(*count)++;
+		arg = end + 1;
+	} while (*end == ',');
+
+	return *end ? -1 : 0;
+}
+
+int add_latency(struct bench_reader *reader, long long latency)
+{
+	long long *latencies;
+
+	if (reader->count == reader->size) {
+		reader->size = reader->size ? reader->size * 2 : 1024;
+		latencies = realloc(reader->latencies,
+				    reader->size * sizeof(*latencies));
+		if (!latencies)
+			return -1;
+		reader->latencies = latencies;
+	}
+
+	reader->latencies[reader->count++] = latency;
+	return 0;
+}
+
+void *read_attribute(void *data)
+{
+	struct bench_reader *reader = data;
+	struct itimerspec timeout, disarm;
+	struct sigevent sev;
+	struct timespec next;
+	timer_t timer;
+	long long start, cpu;
+	char buf[4096];
+	ssize_t ret;
+	int fd;
+
+	fd = open(reader->path, O_RDONLY);
+	if (fd < 0) {
+		reader->errors++;
+		return NULL;
+	}
+
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGALRM;
+	sev.sigev_notify_thread_id = syscall(SYS_gettid);
+	if (timer_create(CLOCK_MONOTONIC, &sev, &timer)) {
+		reader->errors++;
+		close(fd);
+		return NULL;
+	}
+
+	memset(&timeout, 0, sizeof(timeout));
+	timeout.it_value.tv_sec = timeout_ms / 1000;
+	timeout.it_value.tv_nsec = (timeout_ms % 1000) * 1000000;
+	memset(&disarm, 0, sizeof(disarm));
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	cpu = thread_cpu_us();
+
+	while (running) {
+		if (reader->rate) {
+			next.tv_nsec += 1000000000 / reader->rate;
+			if (next.tv_nsec >= 1000000000) {
+				next.tv_sec++;
+				next.tv_nsec -= 1000000000;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+					NULL);
+			if (!running)
+				break;
+		}
+
+		timer_settime(timer, 0, &timeout, NULL);
+		start = now_us();
+		ret = pread(fd, buf, sizeof(buf), 0);
+		start = now_us() - start;
+		timer_settime(timer, 0, &disarm, NULL);
+
+		/* Interrupted by the end of the run, not a sample of it */
+		if (!running)
+			break;
+
+		/*
+		 * Timed out by our timer (EINTR, or an empty value from older
+		 * drivers) or by the driver itself (ETIMEDOUT)
+		 */
+		if (ret == 0 || (ret < 0 && (errno == EINTR ||
+					     errno == ETIMEDOUT))) {
+			reader->timeouts++;
+		} else if (ret < 0) {
+			reader->errors++;
+		} else if (add_latency(reader, start)) {
+			reader->errors++;
+			break;
+		}
+	}
+
+	reader->cpu_us = thread_cpu_us() - cpu;
+
+	timer_delete(timer);
+	close(fd);
+	return NULL;
+}
+
+int compare_latency(const void *a, const void *b)
+{
+	long long left = *(const long long *)a;
+	long long right = *(const long long *)b;
+
+	return left < right ? -1 : left > right;
+}
+
+long long percentile(const long long *latencies, size_t count, int pct)
+{
+	if (!count)
+		return 0;
+
+	return latencies[(count - 1) * pct / 100];
+}
+
+int run(const char *path, int threads, int rate)
+{
+	struct bench_reader *readers;
+	long long *latencies;
+	long long start, elapsed, cpu_us = 0;
+	unsigned long timeouts = 0, errors = 0;
+	size_t count = 0, reads;
+	int i;
+
+	readers = calloc(threads, sizeof(*readers));
+	if (!readers)
+		return -1;
+
+	running = 1;
+	start = now_us();
+
+	for (i = 0; i < threads; i++) {
+		readers[i].path = path;
+		readers[i].rate = rate;
+		if (pthread_create(&readers[i].thread, NULL, read_attribute,
+				   &readers[i])) {
+			perror("Unable to start reader");
+			running = 0;
+			threads = i;
+			break;
+		}
+	}
+
+	if (running)
+		sleep(duration);
+	running = 0;
+
+	for (i = 0; i < threads; i++) {
+		/* Wake readers which are sleeping or blocked on a reply */
+		pthread_kill(readers[i].thread, SIGALRM);
+		pthread_join(readers[i].thread, NULL);
+		count += readers[i].count;
+	}
+
+	elapsed = now_us() - start;
+
+	latencies = malloc((count ? count : 1) * sizeof(*latencies));
+	if (!latencies)
+		errors++;
+
+	count = 0;
+	for (i = 0; i < threads; i++) {
+		if (latencies) {
+			memcpy(&latencies[count], readers[i].latencies,
+			       readers[i].count * sizeof(*latencies));
+			count += readers[i].count;
+		}
+		timeouts += readers[i].timeouts;
+		errors += readers[i].errors;
+		cpu_us += readers[i].cpu_us;
+		free(readers[i].latencies);
+	}
+
+	qsort(latencies, count, sizeof(*latencies), compare_latency);
+	reads = count + timeouts;
+
+	printf("attribute=%s threads=%d rate=%d duration_us=%lld reads=%zu "
+	       "timeouts=%lu errors=%lu throughput=%.1f p50_us=%lld "
+	       "p90_us=%lld p99_us=%lld max_us=%lld cpu_us_per_read=%.1f\n",
+	       path, threads, rate, elapsed, count, timeouts, errors,
+	       count * 1000000.0 / elapsed,
+	       percentile(latencies, count, 50),
+	       percentile(latencies, count, 90),
+	       percentile(latencies, count, 99),
+	       count ? latencies[count - 1] : 0,
+	       reads ? (double)cpu_us / reads : 0.0);
+	fflush(stdout);
+
+	free(latencies);
+	free(readers);
+	return 0;
+}
+
+int run_attribute(const char *path)
+{
+	int i, j;
+
+	for (i = 0; i < thread_value_count; i++) {
+		for (j = 0; j < rate_value_count; j++) {
+			if (run(path, thread_values[i], rate_values[j]))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Looks up the attribute on the devices and on the devices on a receiver */
+int run_name(const char *name)
+{
+	glob_t paths;
+	char pattern[256];
+	size_t i;
+	int ret = 0;
+
+	memset(&paths, 0, sizeof(paths));
+	snprintf(pattern, sizeof(pattern), "/sys/bus/hid/devices/*/%s", name);
+	glob(pattern, 0, NULL, &paths);
+	snprintf(pattern, sizeof(pattern), "/sys/bus/hid/devices/*/*/%s", name);
+	glob(pattern, paths.gl_pathc ? GLOB_APPEND : 0, NULL, &paths);
+
+	if (!paths.gl_pathc) {
+		fprintf(stderr, "No device has a %s attribute\n", name);
+		return -1;
+	}
+
+	for (i = 0; i < paths.gl_pathc && !ret; i++)
+		ret = run_attribute(paths.gl_pathv[i]);
+
+	globfree(&paths);
+	return ret;
+}
+
+void usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [-t threads] [-r rate] [-d duration] "
+		"[-T timeout] attribute...\n", program);
+}
+
+int main(int argc, char **argv)
+{
+	struct sigaction sa;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "t:r:d:T:")) != -1) {
+		switch (opt) {
+		case 't':
+			if (parse_values(optarg, thread_values,
+					 &thread_value_count))
+				goto err_usage;
+			for (i = 0; i < thread_value_count; i++) {
+				if (!thread_values[i])
+					goto err_usage;
+			}
+			break;
+		case 'r':
+			if (parse_values(optarg, rate_values,
+					 &rate_value_count))
+				goto err_usage;
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'T':
+			timeout_ms = atoi(optarg);
+			break;
+		default:
+			goto err_usage;
+		}
+	}
+
+	if (optind == argc || duration <= 0 || timeout_ms <= 0)
+		goto err_usage;
+
+	/* No SA_RESTART, the timer has to interrupt the blocking read */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = interrupt;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGALRM, &sa, NULL);
+
+	for (i = optind; i < argc; i++) {
+		if (strchr(argv[i], '/')) {
+			if (run_attribute(argv[i]))
+				return 1;
+		} else if (run_name(argv[i])) {
+			return 1;
+		}
+	}
+
+	return 0;
+err_usage:
+	usage(argv[0]);
+	return 1;
+}
@@ -3,11 +3,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
 
 /* Unix */
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/select.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <readline/readline.h>
@@ -18,9 +21,53 @@
 #include <linux/input.h>
 #include <linux/hidraw.h>
 
+#include "lg-hidpp.h"
+
+/*
+ * Usage: lg-debug [-c capture] [-b script [-p depth] [-t timeout] [-n repeat]
+ *                 [-q]] hidraw|lg-hidpp
+ *
+ * Without a capture file the reports typed at the prompt, as hex bytes, are
+ * sent to the device and the HID++ reports it sends back are printed.
+ *
+ * Instead of the hidraw device the /dev/lg-hidpp device of the driver can be
+ * given. The reports are then queued behind the requests of the driver and
+ * only the replies to them are read back, so the driver keeps working. This
+ * doesn't work for a capture.
+ *
+ * With -c the HID++ reports of the device are recorded in the capture file
+ * until interrupted, without a prompt. Reports read from stdin, one per line,
+ * are sent to the device and recorded too. The capture can be read with
+ * lg-decode and played back with lg-replay.
+ *
+ * With -b the reports in the script, or stdin for -, are sent without a
+ * prompt and every reply is matched to its request. Up to depth requests
+ * (default 1) are outstanding at the same time, a request without a reply
+ * after timeout milliseconds (default 1000) has timed out. The script is run
+ * repeat times (default 1). Every request prints a line with its round trip
+ * time, unless -q is given, and a summary line follows at the end. All
+ * lines are key=value pairs, times are in microseconds.
+ */
+
+#define BATCH_MAX_DEPTH 64
+
+struct batch_command {
+	__u8 data[64];
+	int size;
+	int line;
+};
+
+struct batch_pending {
+	struct batch_command *command;
+	unsigned long seq;
+	long long sent_us;
+};
+
 int *report_list;
 int report_list_size;
 
+volatile sig_atomic_t running = 1;
+
 int desc_data(__u8 *value, int data_size)
 {
 	int data = 0;
@@ -37,7 +84,8 @@ int desc_data(__u8 *value, int data_size)
 
 void add_report_id(int report_id)
 {
-	report_list = realloc(report_list, report_list_size+1);
+	report_list = realloc(report_list,
+			      (report_list_size + 1) * sizeof(*report_list));
 	report_list[report_list_size] = report_id;
 	report_list_size++;
 }
@@ -84,16 +132,423 @@ int valid_report_id(__u8 report_id)
 	return 0;
 }
 
+void stop(int sig)
+{
+	running = 0;
+}
+
+/* Parses a report of hex bytes, returns its size or -1 when it is invalid */
+int parse_report(const char *line, __u8 *buf, size_t size)
+{
+	unsigned long value;
+	char *end;
+	size_t count = 0;
+
+	for (;;) {
+		while (*line == ' ' || *line == '\t')
+			line++;
+		if (!*line || *line == '\n')
+			break;
+
+		value = strtoul(line, &end, 16);
+		if (end == line || value > 0xff || count == size)
+			return -1;
+		buf[count++] = value;
+		line = end;
+	}
+
+	return count;
+}
+
+long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int record(FILE *f, long long *last, __u8 direction, const __u8 *data,
+	   size_t size)
+{
+	long long now = now_us();
+	long long delta = now - *last;
+
+	*last = now;
+	if (delta > UINT32_MAX)
+		delta = UINT32_MAX;
+
+	return lg_capture_write_record(f, delta, direction, data, size);
+}
+
+int capture(int fd, const char *path)
+{
+	struct lg_capture_header header;
+	struct hidraw_report_descriptor rpt_desc;
+	struct hidraw_devinfo info;
+	struct timespec start;
+	unsigned long in = 0, out = 0;
+	long long last;
+	char line[256];
+	__u8 buf[64];
+	fd_set fds;
+	int input = STDIN_FILENO;
+	int res, size;
+	FILE *f;
+
+	memset(&header, 0, sizeof(header));
+	memset(&rpt_desc, 0, sizeof(rpt_desc));
+	if (ioctl(fd, HIDIOCGRAWINFO, &info) < 0 ||
+			ioctl(fd, HIDIOCGRDESCSIZE, &rpt_desc.size) < 0 ||
+			ioctl(fd, HIDIOCGRDESC, &rpt_desc) < 0 ||
+			ioctl(fd, HIDIOCGRAWNAME(sizeof(header.name) - 1),
+			      header.name) < 0) {
+		perror("Can't read device information");
+		return 1;
+	}
+
+	f = fopen(path, "w");
+	if (!f) {
+		perror("Unable to open capture");
+		return 1;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &start);
+	memcpy(header.magic, LG_CAPTURE_MAGIC, sizeof(header.magic));
+	header.version = LG_CAPTURE_VERSION;
+	header.rdesc_size = rpt_desc.size;
+	header.bus = info.bustype;
+	header.vendor = info.vendor;
+	header.product = info.product;
+	header.start_ns = start.tv_sec * 1000000000ULL + start.tv_nsec;
+	if (lg_capture_write_header(f, &header, rpt_desc.value))
+		goto err_write;
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	last = now_us();
+
+	while (running) {
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+		if (input >= 0)
+			FD_SET(input, &fds);
+
+		if (select(fd + 1, &fds, NULL, NULL, NULL) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("select");
+			break;
+		}
+
+		if (input >= 0 && FD_ISSET(input, &fds)) {
+			if (!fgets(line, sizeof(line), stdin)) {
+				input = -1;
+			} else if (line[0] != ';' &&
+					(size = parse_report(line, buf,
+							     sizeof(buf))) > 0) {
+				if (write(fd, buf, size) < 0)
+					perror("write");
+				else if (record(f, &last, LG_CAPTURE_OUT, buf,
+						size))
+					goto err_write;
+				out++;
+			}
+		}
+
+		if (!FD_ISSET(fd, &fds))
+			continue;
+
+		while ((res = read(fd, buf, sizeof(buf))) > 0) {
+			if (!valid_report_id(buf[0]))
+				continue;
+			if (record(f, &last, LG_CAPTURE_IN, buf, res))
+				goto err_write;
+			in++;
+		}
+	}
+
+	fprintf(stderr, "Captured %lu reports from and %lu to the device\n",
+		in, out);
+	if (fclose(f)) {
+		perror("Unable to write capture");
+		return 1;
+	}
+	return 0;
+err_write:
+	perror("Unable to write capture");
+	fclose(f);
+	return 1;
+}
+
+int read_script(const char *path, struct batch_command **commands)
+{
+	struct batch_command *command;
+	char line[256];
+	int count = 0, number = 0;
+	FILE *f = stdin;
+
+	if (strcmp(path, "-")) {
+		f = fopen(path, "r");
+		if (!f) {
+			perror("Unable to open script");
+			return -1;
+		}
+	}
+
+	*commands = NULL;
+	while (fgets(line, sizeof(line), f)) {
+		number++;
+		if (line[0] == ';' || line[strspn(line, " \t\n")] == '\0')
+			continue;
+
+		command = realloc(*commands, (count + 1) * sizeof(*command));
+		if (!command) {
+			perror("Unable to read script");
+			goto err;
+		}
+		*commands = command;
+
+		command = &command[count];
+		command->line = number;
+		command->size = parse_report(line, command->data,
+					     sizeof(command->data));
+		if (command->size < 4) {
+			fprintf(stderr, "Invalid report on line %d\n", number);
+			goto err;
+		}
+		count++;
+	}
+
+	if (f != stdin)
+		fclose(f);
+	return count;
+err:
+	if (f != stdin)
+		fclose(f);
+	free(*commands);
+	return -1;
+}
+
+/* A reply has the action and register of its request, an error names them */
+int batch_matches(const struct batch_command *command, const __u8 *reply,
+		  int size)
+{
+	const __u8 *request = command->data;
+
+	if (size < 5 || reply[1] != request[1])
+		return 0;
+
+	if (reply[2] == 0x8f)
+		return reply[3] == request[2] && reply[4] == request[3];
+
+	return reply[2] == request[2] && reply[3] == request[3];
+}
+
+int compare_rtt(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+void batch_print(const struct batch_pending *pending, const char *result,
+		 long long rtt, const __u8 *reply, int size)
+{
+	char description[64];
+
+	if (reply)
+		lg_hidpp_describe(reply, size, description,
+				  sizeof(description));
+	else
+		strcpy(description, "-");
+
+	printf("seq=%lu line=%d result=%s rtt_us=%lld reply=\"%s\"\n",
+	       pending->seq, pending->command->line, result, rtt,
+	       description);
+}
+
+int batch(int fd, const char *path, int depth, int timeout_ms, int repeat,
+	  int quiet)
+{
+	struct batch_command *commands;
+	struct batch_pending pending[BATCH_MAX_DEPTH];
+	unsigned long total, next = 0;
+	unsigned long ok = 0, errors = 0, timeouts = 0, unmatched = 0;
+	long long *rtts, start, now, rtt, rtt_sum = 0, deadline;
+	size_t rtt_count = 0;
+	int count, outstanding = 0;
+	int i, res;
+	__u8 buf[64];
+	struct timeval timeout;
+	fd_set fds;
+
+	count = read_script(path, &commands);
+	if (count <= 0)
+		return count ? 1 : 0;
+
+	total = (unsigned long)count * repeat;
+	rtts = malloc(total * sizeof(*rtts));
+	if (!rtts) {
+		perror("Unable to run script");
+		free(commands);
+		return 1;
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	/* Replies which are still on their way from an earlier run */
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	start = now_us();
+	while (running && (next < total || outstanding)) {
+		while (outstanding < depth && next < total) {
+			pending[outstanding].command = &commands[next % count];
+			pending[outstanding].seq = next++;
+			pending[outstanding].sent_us = now_us();
+			if (write(fd, pending[outstanding].command->data,
+				  pending[outstanding].command->size) < 0) {
+				/* lg-hidpp limits the requests in flight */
+				if (errno == EAGAIN) {
+					next--;
+					if (!outstanding)
+						usleep(1000);
+					break;
+				}
+				perror("write");
+				goto out;
+			}
+			outstanding++;
+		}
+
+		/* The oldest request is the first to time out */
+		deadline = pending[0].sent_us + timeout_ms * 1000LL;
+		now = now_us();
+		if (deadline > now) {
+			timeout.tv_sec = (deadline - now) / 1000000;
+			timeout.tv_usec = (deadline - now) % 1000000;
+			FD_ZERO(&fds);
+			FD_SET(fd, &fds);
+			if (select(fd + 1, &fds, NULL, NULL, &timeout) < 0 &&
+					errno != EINTR) {
+				perror("select");
+				goto out;
+			}
+		}
+
+		while ((res = read(fd, buf, sizeof(buf))) > 0) {
+			now = now_us();
+			if (!valid_report_id(buf[0]))
+				continue;
+
+			for (i = 0; i < outstanding; i++) {
+				if (batch_matches(pending[i].command, buf, res))
+					break;
+			}
+			if (i == outstanding) {
+				unmatched++;
+				continue;
+			}
+
+			rtt = now - pending[i].sent_us;
+			rtts[rtt_count++] = rtt;
+			if (buf[2] == 0x8f)
+				errors++;
+			else
+				ok++;
+			if (!quiet)
+				batch_print(&pending[i], buf[2] == 0x8f ?
+					    "error" : "ok", rtt, buf, res);
+
+			outstanding--;
+			memmove(&pending[i], &pending[i + 1],
+				(outstanding - i) * sizeof(*pending));
+		}
+
+		now = now_us();
+		while (outstanding &&
+				now - pending[0].sent_us >= timeout_ms * 1000LL) {
+			timeouts++;
+			if (!quiet)
+				batch_print(&pending[0], "timeout",
+					    now - pending[0].sent_us, NULL, 0);
+			outstanding--;
+			memmove(&pending[0], &pending[1],
+				outstanding * sizeof(*pending));
+		}
+	}
+
+out:
+	now = now_us();
+	qsort(rtts, rtt_count, sizeof(*rtts), compare_rtt);
+	for (i = 0; i < rtt_count; i++)
+		rtt_sum += rtts[i];
+
+	printf("commands=%lu ok=%lu errors=%lu timeouts=%lu unmatched=%lu "
+	       "depth=%d elapsed_us=%lld requests_per_sec=%.0f ",
+	       next, ok, errors, timeouts, unmatched, depth, now - start,
+	       now > start ? next * 1000000.0 / (now - start) : 0);
+	if (rtt_count)
+		printf("rtt_min_us=%lld rtt_avg_us=%lld rtt_p50_us=%lld "
+		       "rtt_p99_us=%lld rtt_max_us=%lld\n",
+		       rtts[0], rtt_sum / (long long)rtt_count,
+		       rtts[rtt_count / 2], rtts[rtt_count * 99 / 100],
+		       rtts[rtt_count - 1]);
+	else
+		printf("rtt_min_us=-1 rtt_avg_us=-1 rtt_p50_us=-1 "
+		       "rtt_p99_us=-1 rtt_max_us=-1\n");
+
+	free(rtts);
+	free(commands);
+	return timeouts || next < total;
+}
+
 int main(int argc, char **argv)
 {
 	int fd, one_read;
 	int i, res;
-	char buf[256], *line;
+	char buf[256], *line, *capture_path = NULL, *script_path = NULL;
+	char description[64];
 	size_t length;
 	fd_set fds;
 	struct timeval timeout;
+	int depth = 1, timeout_ms = 1000, repeat = 1, quiet = 0;
+	int passthrough = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:b:p:t:n:q")) != -1) {
+		switch (opt) {
+		case 'c':
+			capture_path = optarg;
+			break;
+		case 'b':
+			script_path = optarg;
+			break;
+		case 'p':
+			depth = atoi(optarg);
+			break;
+		case 't':
+			timeout_ms = atoi(optarg);
+			break;
+		case 'n':
+			repeat = atoi(optarg);
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			goto err_usage;
+		}
+	}
 
-	fd = open(argv[1], O_RDWR|O_NONBLOCK);
+	if (optind != argc - 1 || (capture_path && script_path) ||
+			depth < 1 || depth > BATCH_MAX_DEPTH ||
+			timeout_ms < 1 || repeat < 1)
+		goto err_usage;
+
+	fd = open(argv[optind], O_RDWR|O_NONBLOCK);
 
 	if (fd < 0) {
 		perror("Unable to open device");
@@ -101,9 +556,34 @@ int main(int argc, char **argv)
 	}
 
 	if (fill_report_list(fd)) {
-		perror("Can't read report descriptor");
+		if (errno != ENOTTY) {
+			perror("Can't read report descriptor");
+			close(fd);
+			return 2;
+		}
+
+		/* Not hidraw but lg-hidpp, which only passes HID++ reports */
+		passthrough = 1;
+		add_report_id(0x10);
+		add_report_id(0x11);
+	}
+
+	if (capture_path && passthrough) {
+		fprintf(stderr, "Capturing needs the hidraw device\n");
+		close(fd);
+		return 1;
+	}
+
+	if (capture_path) {
+		res = capture(fd, capture_path);
+		close(fd);
+		return res;
+	}
+
+	if (script_path) {
+		res = batch(fd, script_path, depth, timeout_ms, repeat, quiet);
 		close(fd);
-		return 2;
+		return res;
 	}
 
 	using_history();
@@ -116,9 +596,10 @@ int main(int argc, char **argv)
 			}
 
 			add_history(line);
-			for(i = 0; sscanf(line + i, "%hx", &buf[i / 3]) && i < length; i += 3);
-			res = write(fd, buf, i/3);
+			res = parse_report(line, (__u8 *)buf, sizeof(buf));
 			if (res < 0) {
+				fprintf(stderr, "Invalid report\n");
+			} else if (write(fd, buf, res) < 0) {
 				perror("write");
 			}
 		}
@@ -145,10 +626,16 @@ int main(int argc, char **argv)
 			for (i = 0; i < res; i++) {
 				printf("%02hhx ", buf[i]);
 			}
-			puts("");
+			lg_hidpp_describe((__u8 *)buf, res, description,
+					  sizeof(description));
+			printf(" (%s)\n", description);
 		}
 		while(res > 0);
 	}
 	close(fd);
 	return 0;
+err_usage:
+	fprintf(stderr, "Usage: %s [-c capture] [-b script [-p depth] "
+		"[-t timeout] [-n repeat] [-q]] hidraw|lg-hidpp\n", argv[0]);
+	return 1;
 }
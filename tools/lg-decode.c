@@ -0,0 +1,191 @@
+/* C */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+/* Unix */
+#include <unistd.h>
+
+#include "lg-hidpp.h"
+
+/*
+ * Prints a capture of lg-debug, one report per line.
+ *
+ * Usage: lg-decode [-s] [capture]
+ *
+ * Without a capture it is read from stdin. Every line has the time since the
+ * start of the capture in seconds, the direction (< from the device, > to
+ * the device), the report and its description. With -s only a summary is
+ * printed instead: one line of key=value pairs for the whole capture and one
+ * for every action and register seen.
+ */
+
+#define DECODE_BUFFER_SIZE (1 << 20)
+
+struct decode_count {
+	unsigned long in;
+	unsigned long out;
+};
+
+/* Indexed by action << 8 | register */
+struct decode_count counts[256 * 256];
+
+const char hex[] = "0123456789abcdef";
+
+void print_header(const struct lg_capture_header *header)
+{
+	time_t start = header->start_ns / 1000000000ULL;
+	char date[32];
+
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&start));
+	printf("; %s bus %04x vendor %04x product %04x started %s\n",
+	       header->name, header->bus, header->vendor, header->product,
+	       date);
+}
+
+/* Formats the line by hand, printf is too slow for big captures */
+void print_record(unsigned long long time_us,
+		  const struct lg_capture_record *record, const uint8_t *data)
+{
+	char line[1024], *p = line;
+	int i;
+
+	p += sprintf(p, "%llu.%06llu %c ", time_us / 1000000,
+		     time_us % 1000000,
+		     record->direction == LG_CAPTURE_IN ? '<' : '>');
+
+	for (i = 0; i < record->size; i++) {
+		*p++ = hex[data[i] >> 4];
+		*p++ = hex[data[i] & 0xf];
+		*p++ = ' ';
+	}
+
+	*p++ = ' ';
+	*p++ = '(';
+	p += lg_hidpp_describe(data, record->size, p, 64);
+	*p++ = ')';
+	*p++ = '\n';
+
+	fwrite(line, p - line, 1, stdout);
+}
+
+void count_record(const struct lg_capture_record *record,
+		  const uint8_t *data)
+{
+	struct decode_count *count;
+
+	if (record->size < 4 ||
+			(data[0] != LG_HIDPP_SHORT && data[0] != LG_HIDPP_LONG))
+		return;
+
+	/* Errors are counted for the register of the failed request */
+	if (data[2] == 0x8f && record->size >= 6)
+		count = &counts[data[2] << 8 | data[4]];
+	else
+		count = &counts[data[2] << 8 | data[3]];
+	if (record->direction == LG_CAPTURE_IN)
+		count->in++;
+	else
+		count->out++;
+}
+
+void print_counts(void)
+{
+	char action[8], reg[8];
+	int i;
+
+	for (i = 0; i < 256 * 256; i++) {
+		if (!counts[i].in && !counts[i].out)
+			continue;
+
+		printf("action=%s register=%s in=%lu out=%lu\n",
+		       lg_hidpp_format(lg_hidpp_actions, i >> 8, action),
+		       lg_hidpp_format(lg_hidpp_registers, i & 0xff, reg),
+		       counts[i].in, counts[i].out);
+	}
+}
+
+long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char **argv)
+{
+	struct lg_capture_header header;
+	struct lg_capture_record record;
+	static uint8_t rdesc[4096];
+	uint8_t data[256];
+	unsigned long long time_us = 0, bytes = 0;
+	unsigned long in = 0, out = 0;
+	long long start, elapsed;
+	int summary = 0;
+	int opt, res;
+	FILE *f = stdin;
+
+	while ((opt = getopt(argc, argv, "s")) != -1) {
+		switch (opt) {
+		case 's':
+			summary = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-s] [capture]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind < argc) {
+		f = fopen(argv[optind], "r");
+		if (!f) {
+			perror("Unable to open capture");
+			return 1;
+		}
+	}
+
+	setvbuf(f, NULL, _IOFBF, DECODE_BUFFER_SIZE);
+	setvbuf(stdout, NULL, _IOFBF, DECODE_BUFFER_SIZE);
+
+	if (lg_capture_read_header(f, &header, rdesc)) {
+		fprintf(stderr, "Not a capture\n");
+		return 1;
+	}
+
+	if (!summary)
+		print_header(&header);
+
+	start = now_us();
+	while ((res = lg_capture_read_record(f, &record, data)) > 0) {
+		time_us += record.delta_us;
+		bytes += record.size;
+		if (record.direction == LG_CAPTURE_IN)
+			in++;
+		else
+			out++;
+
+		if (summary)
+			count_record(&record, data);
+		else
+			print_record(time_us, &record, data);
+	}
+	elapsed = now_us() - start;
+
+	if (res < 0)
+		fprintf(stderr, "The capture is truncated\n");
+
+	if (summary) {
+		printf("name=\"%s\" records=%lu in=%lu out=%lu bytes=%llu "
+		       "duration_s=%llu.%06llu decode_records_per_sec=%.0f\n",
+		       header.name, in + out, in, out, bytes,
+		       time_us / 1000000, time_us % 1000000,
+		       elapsed ? (in + out) * 1000000.0 / elapsed : 0);
+		print_counts();
+	}
+
+	fclose(f);
+	return res < 0;
+}
@@ -0,0 +1,1315 @@
+/* C */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+/* Unix */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <unistd.h>
+
+/* Linux */
+#include <linux/types.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+/*
+ * Emulates the MX5500 receiver, keyboard, MX Revolution and VX Revolution
+ * through /dev/uhid, so the drivers can be exercised without the hardware.
+ *
+ * Usage: lg-emulator [-l latency] [-j jitter] [-d loss] [-r reorder]
+ *                    [-s script] device...
+ *
+ * The devices are receiver, keyboard, mouse and vx. The keyboard and mouse are
+ * bluetooth devices, the receiver has the keyboard paired in slot 1 and the
+ * mouse in slot 2. Latency and jitter are in milliseconds, loss and reorder
+ * are the percentage of replies which are dropped or held back behind the
+ * next reply.
+ *
+ * Commands are read from the script, or from stdin without one:
+ *   logon <slot>                   connect the device paired in a slot
+ *   logoff <slot>                  disconnect the device in a slot
+ *   pair <slot> keyboard|mouse     pair a device in a slot
+ *   battery <target> <percent>     set the battery level
+ *   lcd <target> <page>            switch the LCD page of a keyboard
+ *   asleep <target> on|off         stop or start answering requests
+ *   latency <ms> [jitter]          change the reply latency
+ *   loss <percent>                 change the reply loss
+ *   reorder <percent>              change the reply reordering
+ *   flood <target> <rate> <seconds> [mix]
+ *                                  flood a keyboard with reports, see below
+ *   fuzz <target> <seconds>        send random reports, see below
+ *   sleep <ms>                     wait before the next command
+ *   stats                          print the statistics
+ *   quit                           destroy the devices and exit
+ * A target is either a receiver slot or the name of a device.
+ *
+ * A flood sends rate reports per second, mixed as notify/reply/unknown
+ * percentages (default 60/30/10): LCD page notifications, unrequested
+ * battery replies and replies for an unknown register. The notifications
+ * carry a sequence number as page, so sampling the lcd_page attribute gives
+ * the time from sending a report until its handler ran. Reports dropped by
+ * a full queue and unhandled ones are counted from the stats and unknown
+ * files in debugfs, the CPU time of all kworker threads is taken from /proc.
+ * Both need root.
+ *
+ * A fuzz sends mutations of valid reports as fast as possible: random
+ * actions, registers, parameters and sizes, with the devnum of the target
+ * most of the time. Afterwards the reports per second are printed, along
+ * with the change of /proc/sys/kernel/tainted and the number of oopses,
+ * warnings and sanitizer reports in /dev/kmsg.
+ */
+
+#define EMU_MAX_DEVICES 8
+#define EMU_MAX_SLOTS 3
+#define EMU_MAX_PENDING 1024
+
+#define EMU_REPORT_SHORT 0x10
+#define EMU_REPORT_LONG 0x11
+#define EMU_REPORT_SHORT_SIZE 7
+#define EMU_REPORT_LONG_SIZE 20
+
+#define EMU_ACTION_SET 0x80
+#define EMU_ACTION_GET 0x81
+#define EMU_ACTION_ERROR 0x8F
+#define EMU_ACTION_LOGOFF 0x40
+#define EMU_ACTION_LOGON 0x41
+#define EMU_ACTION_LCD_PAGE 0x0b
+
+#define EMU_FLOOD_UNKNOWN_REGISTER 0x7f
+#define EMU_FLOOD_PROBE_US 1000
+#define EMU_DEBUGFS "/sys/kernel/debug/hid-logitech"
+#define EMU_FUZZ_SERVICE_REPORTS 64
+
+#define EMU_ERR_INVALID_ADDRESS 0x02
+#define EMU_ERR_UNKNOWN_DEVICE 0x08
+
+enum emu_kind {
+	EMU_RECEIVER,
+	EMU_KEYBOARD,
+	EMU_MOUSE,
+	EMU_VX,
+};
+
+struct emu_function {
+	enum emu_kind kind;
+	__u16 product;
+	int paired;
+	int logged_on;
+	int asleep;
+
+	__u8 battery;
+	__u8 lcd_page;
+	__u8 time[3];
+	__u8 date[3];
+	__u8 scrollmode[3];
+};
+
+struct emu_device {
+	enum emu_kind kind;
+	const char *name;
+	int fd;
+	__u16 bus;
+	__u32 product;
+	const __u8 *rdesc;
+	size_t rdesc_size;
+
+	__u8 max_devices;
+	struct emu_function slots[EMU_MAX_SLOTS + 1];
+	struct emu_function self;
+};
+
+struct emu_pending {
+	struct emu_device *device;
+	long long due;
+	unsigned long seq;
+	__u8 data[EMU_REPORT_LONG_SIZE];
+	size_t size;
+};
+
+struct emu_stats {
+	unsigned long requests;
+	unsigned long replies;
+	unsigned long dropped;
+	unsigned long reordered;
+	unsigned long notifications;
+	unsigned long errors;
+};
+
+struct emu_flood {
+	unsigned long sent[3];
+	long long sent_at[256];
+	long long *latencies;
+	size_t latency_count;
+	size_t latency_size;
+	int probe_fd;
+	int last_page;
+};
+
+#define EMU_RDESC_KEYBOARD \
+	0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01, \
+	0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, \
+	0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02, \
+	0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x26, 0xFF, \
+	0x00, 0x05, 0x07, 0x19, 0x00, 0x2A, 0xFF, 0x00, \
+	0x81, 0x00, 0xC0
+
+#define EMU_RDESC_MOUSE \
+	0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x02, \
+	0x09, 0x01, 0xA1, 0x00, 0x05, 0x09, 0x19, 0x01, \
+	0x29, 0x05, 0x15, 0x00, 0x25, 0x01, 0x95, 0x05, \
+	0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x03, \
+	0x81, 0x01, 0x05, 0x01, 0x09, 0x30, 0x09, 0x31, \
+	0x09, 0x38, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, \
+	0x95, 0x03, 0x81, 0x06, 0xC0, 0xC0
+
+/* The HID++ short (0x10) and long (0x11) reports on the vendor page */
+#define EMU_RDESC_HIDPP \
+	0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0x85, \
+	0x10, 0x75, 0x08, 0x95, 0x06, 0x15, 0x00, 0x26, \
+	0xFF, 0x00, 0x09, 0x01, 0x81, 0x00, 0x09, 0x01, \
+	0x91, 0x00, 0xC0, \
+	0x06, 0x00, 0xFF, 0x09, 0x02, 0xA1, 0x01, 0x85, \
+	0x11, 0x75, 0x08, 0x95, 0x13, 0x15, 0x00, 0x26, \
+	0xFF, 0x00, 0x09, 0x02, 0x81, 0x00, 0x09, 0x02, \
+	0x91, 0x00, 0xC0
+
+const __u8 rdesc_receiver[] = { EMU_RDESC_KEYBOARD, EMU_RDESC_MOUSE,
+				EMU_RDESC_HIDPP };
+const __u8 rdesc_keyboard[] = { EMU_RDESC_KEYBOARD, EMU_RDESC_HIDPP };
+const __u8 rdesc_mouse[] = { EMU_RDESC_MOUSE, EMU_RDESC_HIDPP };
+
+struct emu_device devices[EMU_MAX_DEVICES];
+int device_count;
+
+struct emu_pending pending[EMU_MAX_PENDING];
+int pending_count;
+unsigned long pending_seq;
+
+int latency_ms = 10;
+int jitter_ms;
+int loss;
+int reorder;
+
+struct emu_stats stats;
+
+volatile sig_atomic_t running = 1;
+
+long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void stop(int sig)
+{
+	running = 0;
+}
+
+void init_function(struct emu_function *function, enum emu_kind kind)
+{
+	time_t now = time(NULL);
+	struct tm *tm = localtime(&now);
+
+	memset(function, 0, sizeof(*function));
+	function->kind = kind;
+	function->battery = 100;
+	function->time[0] = tm->tm_sec;
+	function->time[1] = tm->tm_min;
+	function->time[2] = tm->tm_hour;
+	function->date[0] = tm->tm_mday;
+	function->date[1] = tm->tm_mon;
+	function->date[2] = tm->tm_year % 100;
+	function->scrollmode[0] = 0x02;
+
+	if (kind == EMU_KEYBOARD)
+		function->product = 0xb30b;
+	else if (kind == EMU_MOUSE)
+		function->product = 0xb007;
+	else if (kind == EMU_VX)
+		function->product = 0xc521;
+}
+
+int uhid_write(int fd, struct uhid_event *ev)
+{
+	ssize_t ret;
+
+	ret = write(fd, ev, sizeof(*ev));
+	if (ret < 0) {
+		perror("uhid write");
+		return -1;
+	}
+
+	return 0;
+}
+
+int create_device(struct emu_device *device)
+{
+	struct uhid_event ev;
+
+	device->fd = open("/dev/uhid", O_RDWR | O_CLOEXEC | O_NONBLOCK);
+	if (device->fd < 0) {
+		perror("Unable to open /dev/uhid");
+		return -1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_CREATE2;
+	snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name),
+		 "lg-emulator %s", device->name);
+	ev.u.create2.rd_size = device->rdesc_size;
+	ev.u.create2.bus = device->bus;
+	ev.u.create2.vendor = 0x046d;
+	ev.u.create2.product = device->product;
+	memcpy(ev.u.create2.rd_data, device->rdesc, device->rdesc_size);
+
+	return uhid_write(device->fd, &ev);
+}
+
+void destroy_device(struct emu_device *device)
+{
+	struct uhid_event ev;
+
+	if (device->fd < 0)
+		return;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_DESTROY;
+	uhid_write(device->fd, &ev);
+	close(device->fd);
+	device->fd = -1;
+}
+
+int add_device(const char *name)
+{
+	struct emu_device *device;
+
+	if (device_count == EMU_MAX_DEVICES)
+		return -1;
+
+	device = &devices[device_count];
+	memset(device, 0, sizeof(*device));
+	device->name = name;
+	device->fd = -1;
+
+	if (!strcmp(name, "receiver")) {
+		device->kind = EMU_RECEIVER;
+		device->bus = BUS_USB;
+		device->product = 0xc71c;
+		device->rdesc = rdesc_receiver;
+		device->rdesc_size = sizeof(rdesc_receiver);
+		device->max_devices = EMU_MAX_SLOTS;
+		init_function(&device->slots[1], EMU_KEYBOARD);
+		device->slots[1].paired = 1;
+		init_function(&device->slots[2], EMU_MOUSE);
+		device->slots[2].paired = 1;
+	} else if (!strcmp(name, "keyboard")) {
+		device->kind = EMU_KEYBOARD;
+		device->bus = BUS_BLUETOOTH;
+		device->product = 0xb30b;
+		device->rdesc = rdesc_keyboard;
+		device->rdesc_size = sizeof(rdesc_keyboard);
+	} else if (!strcmp(name, "mouse")) {
+		device->kind = EMU_MOUSE;
+		device->bus = BUS_BLUETOOTH;
+		device->product = 0xb007;
+		device->rdesc = rdesc_mouse;
+		device->rdesc_size = sizeof(rdesc_mouse);
+	} else if (!strcmp(name, "vx")) {
+		device->kind = EMU_VX;
+		device->bus = BUS_USB;
+		device->product = 0xc521;
+		device->rdesc = rdesc_mouse;
+		device->rdesc_size = sizeof(rdesc_mouse);
+	} else {
+		return -1;
+	}
+
+	init_function(&device->self, device->kind);
+	device->self.logged_on = 1;
+	device_count++;
+
+	return 0;
+}
+
+void send_report(struct emu_device *device, const __u8 *data, size_t size)
+{
+	struct uhid_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_INPUT2;
+	ev.u.input2.size = size;
+	memcpy(ev.u.input2.data, data, size);
+
+	uhid_write(device->fd, &ev);
+}
+
+/* Reports due at the same time are sent in the order they were queued */
+void queue_report(struct emu_device *device, const __u8 *data, size_t size,
+		  long long delay)
+{
+	struct emu_pending *report;
+
+	if (pending_count == EMU_MAX_PENDING) {
+		stats.dropped++;
+		return;
+	}
+
+	report = &pending[pending_count++];
+	report->device = device;
+	report->due = now_us() + delay * 1000;
+	report->seq = pending_seq++;
+	report->size = size;
+	memcpy(report->data, data, size);
+}
+
+/* Notifications are never lost, replies suffer latency, loss and reorder */
+void send_notification(struct emu_device *device, const __u8 *data,
+		       size_t size)
+{
+	stats.notifications++;
+	queue_report(device, data, size, 0);
+}
+
+void send_reply(struct emu_device *device, const __u8 *data, size_t size)
+{
+	long long delay;
+
+	if (loss && rand() % 100 < loss) {
+		stats.dropped++;
+		return;
+	}
+
+	delay = latency_ms;
+	if (jitter_ms)
+		delay += rand() % (jitter_ms + 1);
+	if (reorder && rand() % 100 < reorder) {
+		delay += latency_ms + 1;
+		stats.reordered++;
+	}
+
+	stats.replies++;
+	queue_report(device, data, size, delay);
+}
+
+void send_error(struct emu_device *device, const __u8 *request, __u8 error)
+{
+	__u8 reply[EMU_REPORT_SHORT_SIZE] = { EMU_REPORT_SHORT, request[1],
+		EMU_ACTION_ERROR, request[2], request[3], error, 0x00 };
+
+	stats.errors++;
+	send_reply(device, reply, sizeof(reply));
+}
+
+/* Sends the reports which are due, returns when the next one is due */
+long long flush_pending(void)
+{
+	long long now = now_us();
+	struct emu_pending *first;
+	int i;
+
+	while (pending_count) {
+		first = &pending[0];
+		for (i = 1; i < pending_count; i++) {
+			if (pending[i].due < first->due ||
+					(pending[i].due == first->due &&
+					 pending[i].seq < first->seq))
+				first = &pending[i];
+		}
+
+		if (first->due > now)
+			return first->due;
+
+		send_report(first->device, first->data, first->size);
+		*first = pending[--pending_count];
+	}
+
+	return -1;
+}
+
+void send_logon(struct emu_device *device, int slot, long long delay)
+{
+	struct emu_function *function = &device->slots[slot];
+	__u8 report[EMU_REPORT_SHORT_SIZE] = { EMU_REPORT_SHORT, slot,
+		EMU_ACTION_LOGON, 0x04, 0x00, function->product & 0xff,
+		function->product >> 8 };
+
+	function->logged_on = 1;
+	stats.notifications++;
+	queue_report(device, report, sizeof(report), delay);
+}
+
+void send_logoff(struct emu_device *device, int slot)
+{
+	__u8 report[EMU_REPORT_SHORT_SIZE] = { EMU_REPORT_SHORT, slot,
+		EMU_ACTION_LOGOFF, 0x00, 0x00, 0x00, 0x00 };
+
+	device->slots[slot].logged_on = 0;
+	send_notification(device, report, sizeof(report));
+}
+
+void handle_receiver_request(struct emu_device *device, const __u8 *request)
+{
+	__u8 reply[EMU_REPORT_SHORT_SIZE];
+	int slot;
+
+	memcpy(reply, request, sizeof(reply));
+
+	if (request[2] == EMU_ACTION_GET && request[3] == 0x00) {
+		reply[4] = 0x00;
+		reply[5] = device->max_devices;
+		reply[6] = 0x00;
+		send_reply(device, reply, sizeof(reply));
+	} else if (request[2] == EMU_ACTION_SET && request[3] == 0x00) {
+		device->max_devices = request[5];
+		send_reply(device, reply, sizeof(reply));
+	} else if (request[2] == EMU_ACTION_SET && request[3] == 0x02) {
+		send_reply(device, reply, sizeof(reply));
+		if (request[4] != 0x02)
+			return;
+
+		/* The devices log on after the receiver acknowledged */
+		for (slot = 1; slot <= EMU_MAX_SLOTS; slot++) {
+			if (device->slots[slot].paired)
+				send_logon(device, slot, latency_ms);
+		}
+	} else {
+		send_error(device, request, EMU_ERR_INVALID_ADDRESS);
+	}
+}
+
+void handle_function_request(struct emu_device *device,
+			     struct emu_function *function,
+			     const __u8 *request)
+{
+	__u8 reply[EMU_REPORT_LONG_SIZE];
+	__u8 action = request[2];
+	__u8 reg = request[3];
+
+	memset(reply, 0, sizeof(reply));
+	memcpy(reply, request, EMU_REPORT_SHORT_SIZE);
+
+	if (action == EMU_ACTION_GET && reg == 0x0d) {
+		reply[4] = function->battery;
+		reply[5] = 0x00;
+		reply[6] = 0x00;
+	} else if (function->kind == EMU_KEYBOARD && reg == 0x31) {
+		if (action == EMU_ACTION_SET) {
+			memcpy(function->time, &request[4], 3);
+		} else {
+			/* The time doesn't fit in a short report */
+			reply[0] = EMU_REPORT_LONG;
+			reply[4] = 0x00;
+			memcpy(&reply[5], function->time, 3);
+			send_reply(device, reply, EMU_REPORT_LONG_SIZE);
+			return;
+		}
+	} else if (function->kind == EMU_KEYBOARD && reg == 0x32) {
+		if (action == EMU_ACTION_SET) {
+			function->date[0] = request[5];
+			function->date[1] = request[6];
+		} else {
+			reply[4] = 0x00;
+			reply[5] = function->date[0];
+			reply[6] = function->date[1];
+		}
+	} else if (function->kind == EMU_KEYBOARD && reg == 0x33) {
+		if (action == EMU_ACTION_SET)
+			function->date[2] = request[4];
+		else
+			reply[4] = function->date[2];
+	} else if (function->kind == EMU_MOUSE && reg == 0x56) {
+		if (action == EMU_ACTION_SET)
+			memcpy(function->scrollmode, &request[4], 3);
+		memcpy(&reply[4], function->scrollmode, 3);
+	} else {
+		send_error(device, request, EMU_ERR_INVALID_ADDRESS);
+		return;
+	}
+
+	send_reply(device, reply, EMU_REPORT_SHORT_SIZE);
+}
+
+void handle_output(struct emu_device *device, const __u8 *data, size_t size)
+{
+	struct emu_function *function;
+	__u8 devnum;
+
+	if (size < EMU_REPORT_SHORT_SIZE)
+		return;
+	if (data[0] != EMU_REPORT_SHORT && data[0] != EMU_REPORT_LONG)
+		return;
+
+	stats.requests++;
+	devnum = data[1];
+
+	if (device->kind == EMU_RECEIVER) {
+		if (devnum == 0xFF) {
+			handle_receiver_request(device, data);
+			return;
+		}
+
+		if (devnum < 1 || devnum > EMU_MAX_SLOTS ||
+				!device->slots[devnum].logged_on) {
+			send_error(device, data, EMU_ERR_UNKNOWN_DEVICE);
+			return;
+		}
+		function = &device->slots[devnum];
+	} else {
+		function = &device->self;
+	}
+
+	if (function->asleep)
+		return;
+
+	handle_function_request(device, function, data);
+}
+
+void handle_uhid_event(struct emu_device *device)
+{
+	struct uhid_event ev;
+	ssize_t ret;
+
+	ret = read(device->fd, &ev, sizeof(ev));
+	if (ret <= 0)
+		return;
+
+	switch (ev.type) {
+	case UHID_OUTPUT:
+		handle_output(device, ev.u.output.data, ev.u.output.size);
+		break;
+	case UHID_SET_REPORT:
+		handle_output(device, ev.u.set_report.data,
+			      ev.u.set_report.size);
+		ev.u.set_report_reply.err = 0;
+		ev.type = UHID_SET_REPORT_REPLY;
+		uhid_write(device->fd, &ev);
+		break;
+	case UHID_GET_REPORT:
+		ev.type = UHID_GET_REPORT_REPLY;
+		ev.u.get_report_reply.err = EIO;
+		ev.u.get_report_reply.size = 0;
+		uhid_write(device->fd, &ev);
+		break;
+	default:
+		break;
+	}
+}
+
+struct emu_device *find_device(const char *name)
+{
+	int i;
+
+	for (i = 0; i < device_count; i++) {
+		if (!strcmp(devices[i].name, name))
+			return &devices[i];
+	}
+
+	return NULL;
+}
+
+/* Resolves a receiver slot number or a device name */
+struct emu_function *find_target(const char *target,
+				 struct emu_device **device, __u8 *devnum)
+{
+	char *end;
+	long slot;
+
+	slot = strtol(target, &end, 10);
+	if (*end == '\0') {
+		*device = find_device("receiver");
+		if (!*device || slot < 1 || slot > EMU_MAX_SLOTS)
+			return NULL;
+		*devnum = slot;
+		return &(*device)->slots[slot];
+	}
+
+	*device = find_device(target);
+	if (!*device)
+		return NULL;
+	*devnum = 0x01;
+	return &(*device)->self;
+}
+
+void print_stats(void)
+{
+	fprintf(stderr, "requests=%lu replies=%lu dropped=%lu reordered=%lu "
+		"notifications=%lu errors=%lu\n", stats.requests,
+		stats.replies, stats.dropped, stats.reordered,
+		stats.notifications, stats.errors);
+}
+
+/* Sums the CPU time of the kworker threads, in clock ticks */
+long long kworker_ticks(void)
+{
+	unsigned long long utime, stime;
+	long long ticks = 0;
+	struct dirent *entry;
+	/* Sized for the longest d_name, /proc/<pid> never gets near it */
+	char path[sizeof("/proc//stat") + sizeof(entry->d_name)];
+	char buf[512], *comm;
+	DIR *proc;
+	FILE *f;
+
+	proc = opendir("/proc");
+	if (!proc)
+		return -1;
+
+	while ((entry = readdir(proc))) {
+		if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+
+		if (fgets(buf, sizeof(buf), f)) {
+			comm = strchr(buf, '(');
+			if (comm && !strncmp(comm, "(kworker", 8)) {
+				comm = strrchr(buf, ')');
+				if (comm && sscanf(comm + 2, "%*c %*d %*d %*d %*d "
+						"%*d %*u %*u %*u %*u %*u %llu %llu",
+						&utime, &stime) == 2)
+					ticks += utime + stime;
+			}
+		}
+		fclose(f);
+	}
+
+	closedir(proc);
+	return ticks;
+}
+
+/* The name of the newest HID device of an emulated device */
+int hid_device_name(struct emu_device *device, char *name, size_t size)
+{
+	char pattern[128];
+	glob_t paths;
+	int ret = -1;
+
+	snprintf(pattern, sizeof(pattern),
+		 "/sys/bus/hid/devices/%04X:046D:%04X.*",
+		 device->bus, device->product);
+
+	if (!glob(pattern, 0, NULL, &paths)) {
+		snprintf(name, size, "%s",
+			 strrchr(paths.gl_pathv[paths.gl_pathc - 1], '/') + 1);
+		globfree(&paths);
+		ret = 0;
+	}
+
+	return ret;
+}
+
+/*
+ * Reads the reports no handler knew from hid-logitech/unknown/<device> and
+ * the queue drops of the device from hid-logitech/stats. Its slot 0 line
+ * already includes the drops of the slots of a receiver. Both are in
+ * debugfs, which needs root.
+ */
+int read_flood_counters(const char *name, long *unknown, long *drops)
+{
+	char path[256], line[512], device[64];
+	const char *value;
+	unsigned int slot;
+	FILE *f;
+	int found = 0;
+
+	snprintf(path, sizeof(path), EMU_DEBUGFS "/unknown/%s", name);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "total=%ld", unknown) != 1)
+		*unknown = -1;
+	fclose(f);
+	if (*unknown < 0)
+		return -1;
+
+	f = fopen(EMU_DEBUGFS "/stats", "r");
+	if (!f)
+		return -1;
+
+	while (!found && fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "device=%63s slot=%u", device, &slot) != 2 ||
+		    strcmp(device, name) || slot)
+			continue;
+
+		value = strstr(line, " queue_drops=");
+		if (value) {
+			*drops = strtol(value + strlen(" queue_drops="),
+					NULL, 10);
+			found = 1;
+		}
+	}
+	fclose(f);
+
+	return found ? 0 : -1;
+}
+
+/* The newest lcd_page attribute of an emulated keyboard */
+int open_lcd_page(struct emu_device *device)
+{
+	char pattern[128];
+	glob_t paths;
+	int fd = -1;
+
+	snprintf(pattern, sizeof(pattern),
+		 "/sys/bus/hid/devices/%04X:046D:%04X.*/%slcd_page",
+		 device->bus, device->product,
+		 device->kind == EMU_RECEIVER ? "keyboard/" : "");
+
+	if (!glob(pattern, 0, NULL, &paths)) {
+		fd = open(paths.gl_pathv[paths.gl_pathc - 1], O_RDONLY);
+		globfree(&paths);
+	}
+
+	return fd;
+}
+
+void flood_probe(struct emu_flood *flood)
+{
+	long long *latencies;
+	char buf[16];
+	ssize_t ret;
+	int page;
+
+	if (flood->probe_fd < 0)
+		return;
+
+	ret = pread(flood->probe_fd, buf, sizeof(buf) - 1, 0);
+	if (ret <= 0)
+		return;
+	buf[ret] = '\0';
+
+	/* Only a changed page tells when a notification was handled */
+	page = atoi(buf);
+	if (page == flood->last_page || !flood->sent_at[page & 0xff])
+		return;
+	flood->last_page = page;
+
+	if (flood->latency_count == flood->latency_size) {
+		flood->latency_size = flood->latency_size ?
+			flood->latency_size * 2 : 1024;
+		latencies = realloc(flood->latencies,
+				    flood->latency_size * sizeof(*latencies));
+		if (!latencies)
+			return;
+		flood->latencies = latencies;
+	}
+
+	flood->latencies[flood->latency_count++] = now_us() -
+		flood->sent_at[page & 0xff];
+}
+
+void flood_service(void)
+{
+	struct pollfd fds[EMU_MAX_DEVICES];
+	int i;
+
+	for (i = 0; i < device_count; i++) {
+		fds[i].fd = devices[i].fd;
+		fds[i].events = POLLIN;
+	}
+
+	if (poll(fds, device_count, 0) > 0) {
+		for (i = 0; i < device_count; i++) {
+			if (fds[i].revents & POLLIN)
+				handle_uhid_event(&devices[i]);
+		}
+	}
+
+	flush_pending();
+}
+
+int compare_latency(const void *a, const void *b)
+{
+	long long left = *(const long long *)a;
+	long long right = *(const long long *)b;
+
+	return left < right ? -1 : left > right;
+}
+
+void run_flood(struct emu_device *device, struct emu_function *function,
+	       __u8 devnum, int rate, int seconds, const int *mix)
+{
+	__u8 report[EMU_REPORT_SHORT_SIZE] = { EMU_REPORT_SHORT, devnum };
+	struct emu_flood flood;
+	struct rusage usage;
+	struct timespec due_ts;
+	unsigned long sent;
+	long unknown_start, unknown_end, drops_start, drops_end;
+	long long start, end, due, now, last_probe = 0;
+	long long kworker_start, kworker_end, cpu_start, cpu_end;
+	long long i;
+	char name[64];
+	int counters, kind, pick;
+
+	memset(&flood, 0, sizeof(flood));
+	flood.last_page = -1;
+	flood.probe_fd = open_lcd_page(device);
+	if (flood.probe_fd < 0)
+		fprintf(stderr, "No lcd_page attribute, not measuring latency\n");
+
+	counters = !hid_device_name(device, name, sizeof(name)) &&
+		!read_flood_counters(name, &unknown_start, &drops_start);
+	if (!counters)
+		fprintf(stderr, "No debugfs counters, not counting drops\n");
+
+	getrusage(RUSAGE_SELF, &usage);
+	cpu_start = usage.ru_utime.tv_sec * 1000000LL + usage.ru_utime.tv_usec +
+		usage.ru_stime.tv_sec * 1000000LL + usage.ru_stime.tv_usec;
+	kworker_start = kworker_ticks();
+
+	start = now_us();
+	end = start + seconds * 1000000LL;
+
+	for (i = 0; running; i++) {
+		due = start + i * 1000000 / rate;
+		if (due >= end)
+			break;
+
+		now = now_us();
+		if (due > now) {
+			due_ts.tv_sec = due / 1000000;
+			due_ts.tv_nsec = (due % 1000000) * 1000;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&due_ts, NULL);
+			now = due;
+		}
+
+		pick = rand() % 100;
+		kind = pick < mix[0] ? 0 : pick < mix[0] + mix[1] ? 1 : 2;
+
+		switch (kind) {
+		case 0:
+			report[2] = EMU_ACTION_LCD_PAGE;
+			report[3] = 0x00;
+			report[4] = flood.sent[0] & 0xff;
+			flood.sent_at[report[4]] = now_us();
+			function->lcd_page = report[4];
+			break;
+		case 1:
+			report[2] = EMU_ACTION_GET;
+			report[3] = 0x0d;
+			report[4] = function->battery;
+			break;
+		default:
+			report[2] = EMU_ACTION_GET;
+			report[3] = EMU_FLOOD_UNKNOWN_REGISTER;
+			report[4] = 0x00;
+			break;
+		}
+
+		send_report(device, report, sizeof(report));
+		flood.sent[kind]++;
+
+		if (now - last_probe >= EMU_FLOOD_PROBE_US) {
+			flood_probe(&flood);
+			flood_service();
+			last_probe = now;
+		}
+	}
+
+	end = now_us();
+
+	/* Let the driver catch up before the last samples */
+	for (i = 0; i < 100; i++) {
+		flood_probe(&flood);
+		flood_service();
+		usleep(EMU_FLOOD_PROBE_US);
+	}
+
+	kworker_end = kworker_ticks();
+	getrusage(RUSAGE_SELF, &usage);
+	cpu_end = usage.ru_utime.tv_sec * 1000000LL + usage.ru_utime.tv_usec +
+		usage.ru_stime.tv_sec * 1000000LL + usage.ru_stime.tv_usec;
+
+	if (counters)
+		counters = !read_flood_counters(name, &unknown_end, &drops_end);
+
+	sent = flood.sent[0] + flood.sent[1] + flood.sent[2];
+	qsort(flood.latencies, flood.latency_count, sizeof(long long),
+	      compare_latency);
+
+	fprintf(stderr, "flood rate=%d seconds=%d sent=%lu notifications=%lu "
+		"replies=%lu unknown=%lu achieved_rate=%.0f ",
+		rate, seconds, sent, flood.sent[0], flood.sent[1],
+		flood.sent[2], sent * 1000000.0 / (end - start));
+	/* The unknown total is a u32 in the driver, it may have wrapped */
+	if (counters)
+		fprintf(stderr, "dropped=%ld handled=%ld unhandled=%ld ",
+			drops_end - drops_start,
+			(long)sent - (drops_end - drops_start) -
+				(long)(__u32)(unknown_end - unknown_start),
+			(long)(__u32)(unknown_end - unknown_start));
+	else
+		fprintf(stderr, "dropped=-1 handled=-1 unhandled=-1 ");
+	fprintf(stderr, "kworker_cpu_ms=%lld emulator_cpu_ms=%lld "
+		"latency_samples=%zu p50_us=%lld p99_us=%lld max_us=%lld\n",
+		kworker_start >= 0 ? (kworker_end - kworker_start) * 1000 /
+			sysconf(_SC_CLK_TCK) : -1,
+		(cpu_end - cpu_start) / 1000, flood.latency_count,
+		flood.latency_count ?
+			flood.latencies[flood.latency_count / 2] : 0,
+		flood.latency_count ? flood.latencies[
+			(flood.latency_count - 1) * 99 / 100] : 0,
+		flood.latency_count ?
+			flood.latencies[flood.latency_count - 1] : 0);
+
+	free(flood.latencies);
+	if (flood.probe_fd >= 0)
+		close(flood.probe_fd);
+}
+
+long read_tainted(void)
+{
+	long tainted = -1;
+	FILE *f;
+
+	f = fopen("/proc/sys/kernel/tainted", "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%ld", &tainted) != 1)
+		tainted = -1;
+	fclose(f);
+
+	return tainted;
+}
+
+/* Counts the kernel problems logged since the last call */
+int kmsg_problems(int fd, unsigned long *problems)
+{
+	static const char *markers[] = { "BUG", "WARNING", "Oops",
+		"KASAN", "UBSAN", "general protection", NULL };
+	char record[1024];
+	ssize_t ret;
+	int lost = 0, i;
+
+	for (;;) {
+		ret = read(fd, record, sizeof(record) - 1);
+		if (ret < 0 && errno == EPIPE) {
+			lost = 1;
+			continue;
+		}
+		if (ret <= 0)
+			break;
+
+		record[ret] = '\0';
+		for (i = 0; markers[i]; i++) {
+			if (strstr(record, markers[i])) {
+				(*problems)++;
+				break;
+			}
+		}
+	}
+
+	return lost;
+}
+
+/* Mostly well formed reports, so the handlers are reached */
+size_t fuzz_report(__u8 *report, __u8 devnum)
+{
+	static const __u8 actions[] = { EMU_ACTION_SET, EMU_ACTION_GET,
+		EMU_ACTION_ERROR, EMU_ACTION_LOGOFF, EMU_ACTION_LOGON,
+		EMU_ACTION_LCD_PAGE };
+	static const __u8 registers[] = { 0x00, 0x02, 0x0d, 0x31, 0x32,
+		0x33, 0x56 };
+	size_t size;
+	int i;
+
+	report[0] = rand() % 2 ? EMU_REPORT_SHORT : EMU_REPORT_LONG;
+	size = report[0] == EMU_REPORT_SHORT ? EMU_REPORT_SHORT_SIZE :
+		EMU_REPORT_LONG_SIZE;
+	report[1] = rand() % 4 ? devnum : rand();
+	report[2] = rand() % 4 ? actions[rand() % sizeof(actions)] : rand();
+	report[3] = rand() % 4 ? registers[rand() % sizeof(registers)] : rand();
+	for (i = 4; i < size; i++)
+		report[i] = rand();
+
+	/* The hid core pads short reports, but not every transport does */
+	if (!(rand() % 8))
+		size = 1 + rand() % size;
+
+	return size;
+}
+
+void run_fuzz(struct emu_device *device, __u8 devnum, int seconds)
+{
+	__u8 report[EMU_REPORT_LONG_SIZE];
+	unsigned long sent = 0, problems = 0;
+	long long start, end;
+	long tainted_start, tainted_end;
+	int kmsg_fd, lost = 0;
+
+	kmsg_fd = open("/dev/kmsg", O_RDONLY | O_NONBLOCK);
+	if (kmsg_fd >= 0)
+		lseek(kmsg_fd, 0, SEEK_END);
+	tainted_start = read_tainted();
+
+	start = now_us();
+	end = start + seconds * 1000000LL;
+
+	while (running && now_us() < end) {
+		send_report(device, report, fuzz_report(report, devnum));
+		sent++;
+
+		/* Keep answering the requests of the drivers */
+		if (!(sent % EMU_FUZZ_SERVICE_REPORTS)) {
+			flood_service();
+			if (kmsg_fd >= 0)
+				lost |= kmsg_problems(kmsg_fd, &problems);
+		}
+	}
+
+	end = now_us();
+	usleep(100000);
+	flood_service();
+	tainted_end = read_tainted();
+
+	if (kmsg_fd >= 0) {
+		lost |= kmsg_problems(kmsg_fd, &problems);
+		close(kmsg_fd);
+	}
+
+	fprintf(stderr, "fuzz seconds=%d sent=%lu reports_per_sec=%.0f "
+		"tainted_before=%ld tainted_after=%ld ", seconds, sent,
+		sent * 1000000.0 / (end - start), tainted_start, tainted_end);
+	if (kmsg_fd >= 0)
+		fprintf(stderr, "problems=%lu kmsg_lost=%d\n", problems, lost);
+	else
+		fprintf(stderr, "problems=-1\n");
+}
+
+/* Returns the number of milliseconds to wait before the next command */
+int run_command(char *line)
+{
+	char cmd[32], arg1[32], arg2[32], arg3[32], arg4[32];
+	struct emu_device *device;
+	struct emu_function *function;
+	int mix[3] = { 60, 30, 10 };
+	__u8 devnum;
+	int count;
+
+	count = sscanf(line, "%31s %31s %31s %31s %31s", cmd, arg1, arg2,
+		       arg3, arg4);
+	if (count < 1 || cmd[0] == ';' || cmd[0] == '#')
+		return 0;
+
+	if (!strcmp(cmd, "quit")) {
+		running = 0;
+	} else if (!strcmp(cmd, "sleep") && count >= 2) {
+		return atoi(arg1);
+	} else if (!strcmp(cmd, "stats")) {
+		print_stats();
+	} else if (!strcmp(cmd, "latency") && count >= 2) {
+		latency_ms = atoi(arg1);
+		if (count >= 3)
+			jitter_ms = atoi(arg2);
+	} else if (!strcmp(cmd, "loss") && count >= 2) {
+		loss = atoi(arg1);
+	} else if (!strcmp(cmd, "reorder") && count >= 2) {
+		reorder = atoi(arg1);
+	} else if ((!strcmp(cmd, "logon") || !strcmp(cmd, "logoff") ||
+			!strcmp(cmd, "pair")) && count >= 2) {
+		function = find_target(arg1, &device, &devnum);
+		if (!function || device->kind != EMU_RECEIVER)
+			goto invalid;
+
+		if (!strcmp(cmd, "logon") && function->paired) {
+			send_logon(device, devnum, 0);
+		} else if (!strcmp(cmd, "logoff")) {
+			send_logoff(device, devnum);
+		} else if (!strcmp(cmd, "pair") && count >= 3) {
+			if (function->logged_on)
+				send_logoff(device, devnum);
+			if (!strcmp(arg2, "keyboard"))
+				init_function(function, EMU_KEYBOARD);
+			else if (!strcmp(arg2, "mouse"))
+				init_function(function, EMU_MOUSE);
+			else
+				goto invalid;
+			function->paired = 1;
+		} else {
+			goto invalid;
+		}
+	} else if (!strcmp(cmd, "battery") && count >= 3) {
+		function = find_target(arg1, &device, &devnum);
+		if (!function)
+			goto invalid;
+		function->battery = atoi(arg2);
+	} else if (!strcmp(cmd, "lcd") && count >= 3) {
+		__u8 report[EMU_REPORT_SHORT_SIZE] = { EMU_REPORT_SHORT, 0x00,
+			EMU_ACTION_LCD_PAGE, 0x00, 0x00, 0x00, 0x00 };
+
+		function = find_target(arg1, &device, &devnum);
+		if (!function || function->kind != EMU_KEYBOARD)
+			goto invalid;
+		function->lcd_page = atoi(arg2);
+		report[1] = devnum;
+		report[4] = function->lcd_page;
+		send_notification(device, report, sizeof(report));
+	} else if (!strcmp(cmd, "flood") && count >= 4) {
+		function = find_target(arg1, &device, &devnum);
+		if (!function || function->kind != EMU_KEYBOARD ||
+				atoi(arg2) <= 0 || atoi(arg3) <= 0)
+			goto invalid;
+		if (count >= 5 && (sscanf(arg4, "%d/%d/%d", &mix[0], &mix[1],
+				&mix[2]) != 3 || mix[0] < 0 || mix[1] < 0 ||
+				mix[2] < 0 || mix[0] + mix[1] + mix[2] != 100))
+			goto invalid;
+		run_flood(device, function, devnum, atoi(arg2), atoi(arg3),
+			  mix);
+	} else if (!strcmp(cmd, "fuzz") && count >= 3) {
+		function = find_target(arg1, &device, &devnum);
+		if (!function || atoi(arg2) <= 0)
+			goto invalid;
+		run_fuzz(device, devnum, atoi(arg2));
+	} else if (!strcmp(cmd, "asleep") && count >= 3) {
+		function = find_target(arg1, &device, &devnum);
+		if (!function)
+			goto invalid;
+		function->asleep = !strcmp(arg2, "on");
+	} else {
+		goto invalid;
+	}
+
+	return 0;
+invalid:
+	fprintf(stderr, "Invalid command: %s\n", line);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct pollfd fds[EMU_MAX_DEVICES + 1];
+	char script_buf[4096];
+	size_t script_len = 0;
+	char *newline;
+	int script_fd = STDIN_FILENO;
+	long long resume_at = 0;
+	long long next, now;
+	int timeout;
+	int opt, i, ret;
+
+	while ((opt = getopt(argc, argv, "l:j:d:r:s:")) != -1) {
+		switch (opt) {
+		case 'l':
+			latency_ms = atoi(optarg);
+			break;
+		case 'j':
+			jitter_ms = atoi(optarg);
+			break;
+		case 'd':
+			loss = atoi(optarg);
+			break;
+		case 'r':
+			reorder = atoi(optarg);
+			break;
+		case 's':
+			script_fd = open(optarg, O_RDONLY);
+			if (script_fd < 0) {
+				perror("Unable to open script");
+				return 1;
+			}
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-l latency] [-j jitter] "
+				"[-d loss] [-r reorder] [-s script] "
+				"device...\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for (i = optind; i < argc; i++) {
+		if (add_device(argv[i])) {
+			fprintf(stderr, "Unknown device %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (!device_count)
+		add_device("receiver");
+
+	for (i = 0; i < device_count; i++) {
+		if (create_device(&devices[i]))
+			goto out;
+	}
+
+	srand(time(NULL));
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	while (running) {
+		now = now_us();
+		next = flush_pending();
+
+		/* Run script commands until one asks to wait */
+		while (script_fd >= 0 && resume_at <= now && running &&
+				(newline = memchr(script_buf, '\n', script_len))) {
+			*newline = '\0';
+			ret = run_command(script_buf);
+			script_len -= newline + 1 - script_buf;
+			memmove(script_buf, newline + 1, script_len);
+			if (ret)
+				resume_at = now_us() + ret * 1000LL;
+		}
+
+		for (i = 0; i < device_count; i++) {
+			fds[i].fd = devices[i].fd;
+			fds[i].events = POLLIN;
+		}
+		fds[device_count].fd = resume_at <= now ? script_fd : -1;
+		fds[device_count].events = POLLIN;
+
+		timeout = -1;
+		if (next >= 0)
+			timeout = (next - now + 999) / 1000;
+		if (resume_at > now && (timeout < 0 ||
+				(resume_at - now) / 1000 < timeout))
+			timeout = (resume_at - now + 999) / 1000;
+
+		ret = poll(fds, device_count + 1, timeout);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+
+		for (i = 0; i < device_count; i++) {
+			if (fds[i].revents & POLLIN)
+				handle_uhid_event(&devices[i]);
+		}
+
+		if (fds[device_count].revents & (POLLIN | POLLHUP)) {
+			ret = read(script_fd, script_buf + script_len,
+				   sizeof(script_buf) - script_len - 1);
+			if (ret <= 0) {
+				/* Keep emulating after the end of the script */
+				if (script_len)
+					script_buf[script_len++] = '\n';
+				else
+					script_fd = -1;
+			} else {
+				script_len += ret;
+			}
+		}
+	}
+
+out:
+	print_stats();
+	for (i = 0; i < device_count; i++)
+		destroy_device(&devices[i]);
+	return 0;
+}
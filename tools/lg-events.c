@@ -0,0 +1,319 @@
+/* C */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+
+/* Unix */
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Linux */
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/hid-lg-extended.h>
+
+/*
+ * Prints the events of all devices, multicast by the driver on its generic
+ * netlink family.
+ *
+ * Usage: lg-events [-g group,...]
+ *
+ * The groups are slots (devices logging on and off a receiver) and state
+ * (battery, LCD page and scrollmode changes), by default both. Every event is
+ * printed as a line of key=value pairs.
+ */
+
+#define EVENTS_BUFFER_SIZE 16384
+
+struct events_group {
+	const char *name;
+	int wanted;
+	__u32 id;
+};
+
+struct events_group groups[] = {
+	{ LG_HIDPP_GENL_SLOTS_GROUP },
+	{ LG_HIDPP_GENL_STATE_GROUP },
+	{ }
+};
+
+const char *event_names[] = {
+	[LG_HIDPP_EVENT_LOGON] = "logon",
+	[LG_HIDPP_EVENT_LOGOFF] = "logoff",
+	[LG_HIDPP_EVENT_BATTERY] = "battery",
+	[LG_HIDPP_EVENT_LCD_PAGE] = "lcd_page",
+	[LG_HIDPP_EVENT_SCROLLMODE] = "scrollmode",
+	[LG_HIDPP_EVENT_UNKNOWN] = "unknown",
+};
+
+volatile sig_atomic_t running = 1;
+
+void stop(int sig)
+{
+	running = 0;
+}
+
+#define attr_data(nla) ((void *)((char *)(nla) + NLA_HDRLEN))
+#define attr_len(nla) ((int)(nla)->nla_len - NLA_HDRLEN)
+
+/* Fills the table with the attributes, by type, of the given buffer */
+void parse_attrs(struct nlattr **table, int max, void *data, int len)
+{
+	struct nlattr *nla = data;
+
+	memset(table, 0, (max + 1) * sizeof(*table));
+
+	while (len >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN &&
+			nla->nla_len <= len) {
+		if ((nla->nla_type & NLA_TYPE_MASK) <= max)
+			table[nla->nla_type & NLA_TYPE_MASK] = nla;
+
+		len -= NLA_ALIGN(nla->nla_len);
+		nla = (struct nlattr *)((char *)nla + NLA_ALIGN(nla->nla_len));
+	}
+}
+
+int add_attr(struct nlmsghdr *nlh, int type, const void *data, int len)
+{
+	struct nlattr *nla = (struct nlattr *)((char *)nlh +
+					       NLMSG_ALIGN(nlh->nlmsg_len));
+
+	nla->nla_type = type;
+	nla->nla_len = NLA_HDRLEN + len;
+	memcpy(attr_data(nla), data, len);
+	nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(nla->nla_len);
+	return 0;
+}
+
+/* Looks up the family and the ids of its groups through the controller */
+int resolve_family(int fd)
+{
+	static char buf[EVENTS_BUFFER_SIZE];
+	struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+	struct genlmsghdr *hdr;
+	struct nlattr *attrs[CTRL_ATTR_MAX + 1];
+	struct nlattr *group[CTRL_ATTR_MCAST_GRP_MAX + 1];
+	struct nlattr *nla;
+	struct events_group *entry;
+	int len, rest;
+
+	memset(buf, 0, NLMSG_SPACE(GENL_HDRLEN));
+	nlh->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+	nlh->nlmsg_type = GENL_ID_CTRL;
+	nlh->nlmsg_flags = NLM_F_REQUEST;
+	hdr = NLMSG_DATA(nlh);
+	hdr->cmd = CTRL_CMD_GETFAMILY;
+	hdr->version = 1;
+	add_attr(nlh, CTRL_ATTR_FAMILY_NAME, LG_HIDPP_GENL_NAME,
+		 sizeof(LG_HIDPP_GENL_NAME));
+
+	if (send(fd, buf, nlh->nlmsg_len, 0) < 0) {
+		perror("send");
+		return -1;
+	}
+
+	len = recv(fd, buf, sizeof(buf), 0);
+	if (len < 0) {
+		perror("recv");
+		return -1;
+	}
+
+	if (!NLMSG_OK(nlh, len) || nlh->nlmsg_type == NLMSG_ERROR) {
+		fprintf(stderr, "The driver isn't loaded, no %s family\n",
+			LG_HIDPP_GENL_NAME);
+		return -1;
+	}
+
+	parse_attrs(attrs, CTRL_ATTR_MAX,
+		    (char *)NLMSG_DATA(nlh) + GENL_HDRLEN,
+		    nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN));
+	if (!attrs[CTRL_ATTR_MCAST_GROUPS])
+		return -1;
+
+	nla = attr_data(attrs[CTRL_ATTR_MCAST_GROUPS]);
+	rest = attr_len(attrs[CTRL_ATTR_MCAST_GROUPS]);
+	while (rest >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN &&
+			nla->nla_len <= rest) {
+		parse_attrs(group, CTRL_ATTR_MCAST_GRP_MAX, attr_data(nla),
+			    attr_len(nla));
+		for (entry = groups; group[CTRL_ATTR_MCAST_GRP_NAME] &&
+				group[CTRL_ATTR_MCAST_GRP_ID] && entry->name;
+				entry++) {
+			if (!strcmp(entry->name,
+				    attr_data(group[CTRL_ATTR_MCAST_GRP_NAME])))
+				entry->id = *(__u32 *)attr_data(
+						group[CTRL_ATTR_MCAST_GRP_ID]);
+		}
+
+		rest -= NLA_ALIGN(nla->nla_len);
+		nla = (struct nlattr *)((char *)nla + NLA_ALIGN(nla->nla_len));
+	}
+
+	return 0;
+}
+
+void print_event(struct nlattr *event)
+{
+	struct nlattr *attrs[LG_HIDPP_ATTR_MAX + 1];
+	unsigned long long time_ns = 0;
+	__u16 type = 0;
+
+	parse_attrs(attrs, LG_HIDPP_ATTR_MAX, attr_data(event),
+		    attr_len(event));
+
+	if (attrs[LG_HIDPP_ATTR_TIME])
+		memcpy(&time_ns, attr_data(attrs[LG_HIDPP_ATTR_TIME]),
+		       sizeof(time_ns));
+	if (attrs[LG_HIDPP_ATTR_TYPE])
+		type = *(__u16 *)attr_data(attrs[LG_HIDPP_ATTR_TYPE]);
+
+	printf("time=%llu.%09llu device=%s bus=0x%04x vendor=0x%04x "
+	       "product=0x%04x devnum=%u event=%s value=%u\n",
+	       time_ns / 1000000000, time_ns % 1000000000,
+	       attrs[LG_HIDPP_ATTR_DEVICE] ?
+	       (char *)attr_data(attrs[LG_HIDPP_ATTR_DEVICE]) : "",
+	       attrs[LG_HIDPP_ATTR_BUS] ?
+	       *(__u16 *)attr_data(attrs[LG_HIDPP_ATTR_BUS]) : 0,
+	       attrs[LG_HIDPP_ATTR_VENDOR] ?
+	       *(__u16 *)attr_data(attrs[LG_HIDPP_ATTR_VENDOR]) : 0,
+	       attrs[LG_HIDPP_ATTR_PRODUCT] ?
+	       *(__u16 *)attr_data(attrs[LG_HIDPP_ATTR_PRODUCT]) : 0,
+	       attrs[LG_HIDPP_ATTR_DEVNUM] ?
+	       *(__u8 *)attr_data(attrs[LG_HIDPP_ATTR_DEVNUM]) : 0,
+	       type <= LG_HIDPP_EVENT_UNKNOWN && event_names[type] ?
+	       event_names[type] : "?",
+	       attrs[LG_HIDPP_ATTR_VALUE] ?
+	       *(__u32 *)attr_data(attrs[LG_HIDPP_ATTR_VALUE]) : 0);
+}
+
+/* Every LG_HIDPP_ATTR_EVENT of a message */
+void handle_message(struct nlmsghdr *nlh)
+{
+	struct nlattr *nla;
+	int rest;
+
+	nla = (struct nlattr *)((char *)NLMSG_DATA(nlh) + GENL_HDRLEN);
+	rest = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+	while (rest >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN &&
+			nla->nla_len <= rest) {
+		if ((nla->nla_type & NLA_TYPE_MASK) == LG_HIDPP_ATTR_EVENT)
+			print_event(nla);
+
+		rest -= NLA_ALIGN(nla->nla_len);
+		nla = (struct nlattr *)((char *)nla + NLA_ALIGN(nla->nla_len));
+	}
+}
+
+int parse_groups(char *list)
+{
+	struct events_group *entry;
+	char *item;
+
+	for (item = strtok(list, ","); item; item = strtok(NULL, ",")) {
+		for (entry = groups; entry->name; entry++) {
+			if (!strcmp(entry->name, item))
+				break;
+		}
+		if (!entry->name)
+			return -1;
+		entry->wanted = 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static char buf[EVENTS_BUFFER_SIZE];
+	struct sockaddr_nl addr = { .nl_family = AF_NETLINK };
+	struct events_group *entry;
+	struct nlmsghdr *nlh;
+	int fd, opt, len, selected = 0;
+
+	while ((opt = getopt(argc, argv, "g:")) != -1) {
+		switch (opt) {
+		case 'g':
+			selected = 1;
+			if (parse_groups(optarg))
+				goto err_usage;
+			break;
+		default:
+			goto err_usage;
+		}
+	}
+
+	if (optind != argc)
+		goto err_usage;
+
+	for (entry = groups; !selected && entry->name; entry++)
+		entry->wanted = 1;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+	if (fd < 0) {
+		perror("Unable to open a netlink socket");
+		return 1;
+	}
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		perror("bind");
+		goto err_close;
+	}
+
+	if (resolve_family(fd))
+		goto err_close;
+
+	for (entry = groups; entry->name; entry++) {
+		if (!entry->wanted)
+			continue;
+
+		if (!entry->id) {
+			fprintf(stderr, "No %s group\n", entry->name);
+			goto err_close;
+		}
+
+		if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+			       &entry->id, sizeof(entry->id))) {
+			perror("Unable to join the group");
+			goto err_close;
+		}
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	while (running) {
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			/* The socket overflowed, events were lost */
+			if (errno == ENOBUFS) {
+				fprintf(stderr, "Events were lost\n");
+				continue;
+			}
+			perror("recv");
+			break;
+		}
+
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+				nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_len >= NLMSG_LENGTH(GENL_HDRLEN) &&
+					((struct genlmsghdr *)NLMSG_DATA(nlh))->cmd ==
+					LG_HIDPP_CMD_EVENTS)
+				handle_message(nlh);
+		}
+
+		fflush(stdout);
+	}
+
+	close(fd);
+	return 0;
+err_close:
+	close(fd);
+	return 1;
+err_usage:
+	fprintf(stderr, "Usage: %s [-g group,...]\n", argv[0]);
+	return 1;
+}
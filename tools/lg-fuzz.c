@@ -0,0 +1,399 @@
+/* C */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+/* Unix */
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Drivers, built against the shim */
+#include <linux/hid.h>
+#include <linux/hid-lg-extended.h>
+
+#include "hid-lg-device.h"
+#include "hid-lg-mx5500.h"
+
+/*
+ * Fuzzes the receive handlers of the drivers, built in userspace on top of
+ * the kernel shim in shim/. Every input is a report from one of the devices,
+ * handled on the workqueue like the in_queue worker would do.
+ *
+ * The first byte of an input selects the device: the MX5500 receiver (with
+ * the keyboard and mouse logged on), the keyboard or mouse over bluetooth or
+ * the VX Revolution. The rest is the report.
+ *
+ * Built with -DLG_FUZZ_LIBFUZZER this is a libFuzzer target. Otherwise it
+ * has its own main:
+ *
+ * Usage: lg-fuzz [-d duration] [-s seed] [-c corpus] [file...]
+ *
+ * Files are replayed once each, to reproduce a crash. Without files random
+ * mutations of valid reports are run for duration seconds, and execs per
+ * second are printed as key=value pairs. With -c the valid reports are
+ * written to the corpus directory, as seeds for libFuzzer.
+ */
+
+#define FUZZ_MAX_REPORT 64
+
+struct fuzz_target {
+	const char *name;
+	u16 bus;
+	u32 product;
+	struct hid_device *hdev;
+	int respond;
+};
+
+struct fuzz_seed {
+	u8 target;
+	u8 data[20];
+	int size;
+};
+
+struct fuzz_work {
+	struct work_struct work;
+	struct fuzz_target *target;
+	u8 *data;
+	size_t size;
+};
+
+struct fuzz_target fuzz_targets[] = {
+	{ "receiver", BUS_USB, USB_DEVICE_ID_MX5500_RECEIVER },
+	{ "keyboard", BUS_BLUETOOTH, USB_DEVICE_ID_MX5500_KEYBOARD },
+	{ "mouse", BUS_BLUETOOTH, USB_DEVICE_ID_MX5500_MOUSE },
+	{ "vx", BUS_USB, 0xc521 },
+};
+
+struct fuzz_work fuzz_work;
+
+/* Valid reports of every target, the starting point of the mutations */
+const struct fuzz_seed fuzz_seeds[] = {
+	{ 0, { 0x10, 0xff, 0x81, 0x00, 0x00, 0x03 }, 7 },
+	{ 0, { 0x10, 0xff, 0x80, 0x00, 0x00, 0x03 }, 7 },
+	{ 0, { 0x10, 0xff, 0x80, 0x02 }, 7 },
+	{ 0, { 0x10, 0x01, 0x41, 0x04, 0x00, 0x0b, 0xb3 }, 7 },
+	{ 0, { 0x10, 0x02, 0x41, 0x04, 0x00, 0x07, 0xb0 }, 7 },
+	{ 0, { 0x10, 0x01, 0x40, 0x04, 0x00, 0x0b, 0xb3 }, 7 },
+	{ 0, { 0x10, 0x01, 0x81, 0x0d, 0x4b }, 7 },
+	{ 0, { 0x10, 0x02, 0x81, 0x56, 0x02 }, 7 },
+	{ 1, { 0x10, 0x01, 0x0b, 0x00, 0x02 }, 7 },
+	{ 1, { 0x10, 0x01, 0x81, 0x0d, 0x4b }, 7 },
+	{ 1, { 0x11, 0x01, 0x81, 0x31, 0x00, 0x0c, 0x22, 0x38 }, 20 },
+	{ 1, { 0x10, 0x01, 0x81, 0x32, 0x00, 0x0a, 0x13 }, 7 },
+	{ 1, { 0x10, 0x01, 0x81, 0x33, 0x1a }, 7 },
+	{ 2, { 0x10, 0x02, 0x81, 0x0d, 0x4b }, 7 },
+	{ 2, { 0x10, 0x02, 0x81, 0x56, 0x02 }, 7 },
+	{ 2, { 0x10, 0x02, 0x80, 0x56, 0x02 }, 7 },
+	{ 3, { 0x10, 0x01, 0x81, 0x0d, 0x4b }, 7 },
+	{ 3, { 0x10, 0x01, 0x8f, 0x81, 0x0d, 0x02 }, 7 },
+};
+
+/* Answers like the MX5500 receiver, only while the devices are probed */
+void fake_respond(struct hid_device *hdev, const u8 *buf, size_t len)
+{
+	u8 reply[7] = { 0x10, buf[1], buf[2], buf[3] };
+	u8 logon[7] = { 0x10, 0x01, 0x41, 0x04, 0x00, 0x0b, 0xb3 };
+
+	if (len < 7 || buf[0] != 0x10)
+		return;
+
+	if (buf[1] == 0xFF && buf[2] == LG_DEVICE_ACTION_GET && buf[3] == 0x00)
+		reply[5] = 0x03;
+	else
+		memcpy(&reply[4], &buf[4], 3);
+	shim_hid_input(hdev, reply, sizeof(reply));
+
+	if (buf[1] == 0xFF && buf[2] == LG_DEVICE_ACTION_SET && buf[3] == 0x02) {
+		shim_hid_input(hdev, logon, sizeof(logon));
+		logon[1] = 0x02;
+		logon[5] = 0x07;
+		logon[6] = 0xb0;
+		shim_hid_input(hdev, logon, sizeof(logon));
+	}
+}
+
+int fake_output_report(struct hid_device *hdev, u8 *buf, size_t len)
+{
+	struct fuzz_target *target = hdev->shim_data;
+
+	if (target->respond)
+		fake_respond(hdev, buf, len);
+
+	return len;
+}
+
+int fake_raw_request(struct hid_device *hdev, unsigned char reportnum,
+		     u8 *buf, size_t len, unsigned char rtype, int reqtype)
+{
+	return fake_output_report(hdev, buf, len);
+}
+
+struct hid_ll_driver fake_ll_driver = {
+	.raw_request = fake_raw_request,
+	.output_report = fake_output_report,
+};
+
+/*
+ * The report is handled from a work item, like the in_queue worker does, but
+ * from a copy of exactly its size so AddressSanitizer catches the handlers
+ * reading past the end of it.
+ */
+void fuzz_worker(struct work_struct *work)
+{
+	struct lg_device *device = hid_get_drvdata(fuzz_work.target->hdev);
+
+	device->driver->receive_handler(device, fuzz_work.data,
+					fuzz_work.size);
+}
+
+void fuzz_one(const u8 *data, size_t size)
+{
+	if (size < 2)
+		return;
+
+	fuzz_work.target = &fuzz_targets[data[0] % ARRAY_SIZE(fuzz_targets)];
+	fuzz_work.size = size - 1;
+	if (fuzz_work.size > FUZZ_MAX_REPORT)
+		fuzz_work.size = FUZZ_MAX_REPORT;
+
+	fuzz_work.data = malloc(fuzz_work.size);
+	if (!fuzz_work.data)
+		return;
+	memcpy(fuzz_work.data, &data[1], fuzz_work.size);
+
+	schedule_work(&fuzz_work.work);
+	flush_scheduled_work();
+	free(fuzz_work.data);
+}
+
+int fuzz_init(void)
+{
+	struct fuzz_target *target;
+	struct lg_receiver *receiver;
+	int i;
+
+	if (shim_modules_load())
+		return -1;
+
+	INIT_WORK(&fuzz_work.work, fuzz_worker);
+
+	for (i = 0; i < ARRAY_SIZE(fuzz_targets); i++) {
+		target = &fuzz_targets[i];
+		target->respond = 1;
+		target->hdev = shim_hid_create(target->bus,
+					       USB_VENDOR_ID_LOGITECH,
+					       target->product,
+					       &fake_ll_driver, target);
+		if (!target->hdev) {
+			fprintf(stderr, "Unable to probe %s\n", target->name);
+			return -1;
+		}
+	}
+
+	/* The keyboard and mouse log on to the receiver through the worker */
+	receiver = container_of(hid_get_drvdata(fuzz_targets[0].hdev),
+				struct lg_receiver, device);
+	for (i = 0; i < 1000; i++) {
+		flush_scheduled_work();
+		if (receiver->slots[0].device && receiver->slots[1].device)
+			break;
+		usleep(1000);
+	}
+
+	if (i == 1000) {
+		fprintf(stderr, "Devices didn't log on to the receiver\n");
+		return -1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(fuzz_targets); i++)
+		fuzz_targets[i].respond = 0;
+
+	return 0;
+}
+
+#ifdef LG_FUZZ_LIBFUZZER
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	if (fuzz_init())
+		abort();
+
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const u8 *data, size_t size)
+{
+	fuzz_one(data, size);
+	return 0;
+}
+
+#else
+
+long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Changes a few bytes, the size or the target of one of the seeds */
+size_t fuzz_mutate(u8 *data)
+{
+	const struct fuzz_seed *seed;
+	int i, mutations = 1 + rand() % 4;
+	size_t size;
+
+	seed = &fuzz_seeds[rand() % ARRAY_SIZE(fuzz_seeds)];
+	data[0] = seed->target;
+	memcpy(&data[1], seed->data, seed->size);
+	size = 1 + seed->size;
+
+	for (i = 0; i < mutations; i++) {
+		switch (rand() % 5) {
+		case 0:
+			data[1 + rand() % (size - 1)] = rand();
+			break;
+		case 1:
+			/* The header bytes select the handlers */
+			data[1 + rand() % (size < 5 ? size - 1 : 4)] = rand();
+			break;
+		case 2:
+			size = 2 + rand() % 8;
+			break;
+		case 3:
+			size = 2 + rand() % FUZZ_MAX_REPORT;
+			break;
+		case 4:
+			data[0] = rand();
+			break;
+		}
+	}
+
+	return size;
+}
+
+int fuzz_replay(const char *path)
+{
+	u8 data[1 + FUZZ_MAX_REPORT];
+	ssize_t size;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	size = read(fd, data, sizeof(data));
+	close(fd);
+	if (size < 0) {
+		perror(path);
+		return -1;
+	}
+
+	fuzz_one(data, size);
+	printf("replayed=%s size=%zd\n", path, size);
+	return 0;
+}
+
+int fuzz_write_corpus(const char *dir)
+{
+	char path[4096];
+	u8 data[21];
+	int i, fd;
+
+	if (mkdir(dir, 0755) && errno != EEXIST) {
+		perror(dir);
+		return -1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(fuzz_seeds); i++) {
+		snprintf(path, sizeof(path), "%s/seed-%02d", dir, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			perror(path);
+			return -1;
+		}
+
+		data[0] = fuzz_seeds[i].target;
+		memcpy(&data[1], fuzz_seeds[i].data, fuzz_seeds[i].size);
+		if (write(fd, data, 1 + fuzz_seeds[i].size) < 0)
+			perror(path);
+		close(fd);
+	}
+
+	return 0;
+}
+
+void usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [-d duration] [-s seed] [-c corpus] "
+		"[file...]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+	u8 data[1 + FUZZ_MAX_REPORT] = { 0 };
+	long long start, end, elapsed;
+	unsigned long execs = 0, messages;
+	unsigned int seed = time(NULL);
+	int duration = 10;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "d:s:c:")) != -1) {
+		switch (opt) {
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			return fuzz_write_corpus(optarg) ? 1 : 0;
+		default:
+			goto err_usage;
+		}
+	}
+
+	if (duration <= 0)
+		goto err_usage;
+
+	if (fuzz_init())
+		return 1;
+
+	if (optind < argc) {
+		for (i = optind; i < argc; i++) {
+			if (fuzz_replay(argv[i]))
+				return 1;
+		}
+		return 0;
+	}
+
+	srand(seed);
+	messages = shim_messages;
+	start = now_ns();
+	end = start + duration * 1000000000LL;
+	do {
+		/* Checking the time every exec would dominate */
+		for (i = 0; i < 1000; i++)
+			fuzz_one(data, fuzz_mutate(data));
+		execs += i;
+	} while (now_ns() < end);
+	elapsed = now_ns() - start;
+
+	printf("seed=%u execs=%lu duration_us=%lld execs_per_sec=%.0f "
+	       "ns_per_exec=%.1f messages=%lu\n", seed, execs, elapsed / 1000,
+	       execs * 1000000000.0 / elapsed, (double)elapsed / execs,
+	       shim_messages - messages);
+
+	return 0;
+err_usage:
+	usage(argv[0]);
+	return 1;
+}
+
+#endif
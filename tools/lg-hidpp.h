@@ -0,0 +1,209 @@
+#ifndef __LG_HIDPP
+#define __LG_HIDPP
+
+/*
+ * The parts of HID++ 1.0 spoken by the supported devices, and the capture
+ * format written by lg-debug and read by lg-decode and lg-replay. Shared by
+ * the tools, every tool is a single file so everything here is static.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#define LG_HIDPP_SHORT 0x10
+#define LG_HIDPP_LONG 0x11
+#define LG_HIDPP_SHORT_SIZE 7
+#define LG_HIDPP_LONG_SIZE 20
+
+#define LG_HIDPP_RECEIVER 0xFF
+
+struct lg_hidpp_name {
+	uint8_t value;
+	const char *name;
+};
+
+static const struct lg_hidpp_name lg_hidpp_actions[] = {
+	{ 0x0b, "lcd_page" },
+	{ 0x40, "logoff" },
+	{ 0x41, "logon" },
+	{ 0x80, "set" },
+	{ 0x81, "get" },
+	{ 0x83, "do" },
+	{ 0x8f, "error" },
+	{ }
+};
+
+static const struct lg_hidpp_name lg_hidpp_registers[] = {
+	{ 0x00, "devices" },
+	{ 0x02, "connection" },
+	{ 0x0d, "battery" },
+	{ 0x31, "time" },
+	{ 0x32, "date" },
+	{ 0x33, "year" },
+	{ 0x56, "scrollmode" },
+	{ }
+};
+
+static const struct lg_hidpp_name lg_hidpp_errors[] = {
+	{ 0x00, "success" },
+	{ 0x01, "invalid_subid" },
+	{ 0x02, "invalid_address" },
+	{ 0x03, "invalid_value" },
+	{ 0x04, "connect_fail" },
+	{ 0x05, "too_many_devices" },
+	{ 0x06, "already_exists" },
+	{ 0x07, "busy" },
+	{ 0x08, "unknown_device" },
+	{ 0x09, "resource_error" },
+	{ 0x0a, "request_unavailable" },
+	{ 0x0b, "invalid_param_value" },
+	{ 0x0c, "wrong_pin_code" },
+	{ }
+};
+
+static inline const char *lg_hidpp_name(const struct lg_hidpp_name *table,
+				 uint8_t value)
+{
+	for (; table->name; table++) {
+		if (table->value == value)
+			return table->name;
+	}
+
+	return NULL;
+}
+
+/* The name of a value, or the value in hex when it has no name */
+static inline const char *lg_hidpp_format(const struct lg_hidpp_name *table,
+					  uint8_t value, char *buf)
+{
+	const char *name = lg_hidpp_name(table, value);
+
+	if (name)
+		return name;
+
+	sprintf(buf, "0x%02x", value);
+	return buf;
+}
+
+/*
+ * Describes a report as "devnum action register", like "1 get battery", and
+ * an error as "devnum error action register error". Returns the length of
+ * the description, like snprintf.
+ */
+static inline int lg_hidpp_describe(const uint8_t *data, size_t size,
+				    char *buf, size_t len)
+{
+	char devnum[12], action[8], reg[8], error[8];
+
+	if (size < 4 || (data[0] != LG_HIDPP_SHORT && data[0] != LG_HIDPP_LONG))
+		return snprintf(buf, len, "-");
+
+	if (data[1] == LG_HIDPP_RECEIVER)
+		strcpy(devnum, "receiver");
+	else
+		sprintf(devnum, "%u", data[1]);
+
+	if (data[2] == 0x8f && size >= 6)
+		return snprintf(buf, len, "%s error %s %s %s", devnum,
+				lg_hidpp_format(lg_hidpp_actions, data[3],
+						action),
+				lg_hidpp_format(lg_hidpp_registers, data[4],
+						reg),
+				lg_hidpp_format(lg_hidpp_errors, data[5],
+						error));
+
+	return snprintf(buf, len, "%s %s %s", devnum,
+			lg_hidpp_format(lg_hidpp_actions, data[2], action),
+			lg_hidpp_format(lg_hidpp_registers, data[3], reg));
+}
+
+/*
+ * A capture starts with a header, followed by the report descriptor of the
+ * device and the records. Fields are in host byte order. A record is the
+ * time since the previous record in microseconds, the direction, the size
+ * and the report itself.
+ */
+
+#define LG_CAPTURE_MAGIC "LGCP"
+#define LG_CAPTURE_VERSION 1
+
+#define LG_CAPTURE_IN 0		/* From the device */
+#define LG_CAPTURE_OUT 1	/* To the device */
+
+struct lg_capture_header {
+	char magic[4];
+	uint8_t version;
+	uint8_t reserved;
+	uint16_t rdesc_size;
+	uint32_t bus;
+	uint16_t vendor;
+	uint16_t product;
+	uint64_t start_ns;
+	char name[128];
+} __attribute__((packed));
+
+struct lg_capture_record {
+	uint32_t delta_us;
+	uint8_t direction;
+	uint8_t size;
+} __attribute__((packed));
+
+static inline int lg_capture_write_header(FILE *f,
+				   const struct lg_capture_header *header,
+				   const uint8_t *rdesc)
+{
+	if (fwrite(header, sizeof(*header), 1, f) != 1)
+		return -1;
+	if (header->rdesc_size &&
+			fwrite(rdesc, header->rdesc_size, 1, f) != 1)
+		return -1;
+
+	return 0;
+}
+
+/* Reads the header and the report descriptor, of at most 4096 bytes */
+static inline int lg_capture_read_header(FILE *f, struct lg_capture_header *header,
+				  uint8_t *rdesc)
+{
+	if (fread(header, sizeof(*header), 1, f) != 1 ||
+			memcmp(header->magic, LG_CAPTURE_MAGIC, 4) ||
+			header->version != LG_CAPTURE_VERSION ||
+			header->rdesc_size > 4096)
+		return -1;
+
+	header->name[sizeof(header->name) - 1] = '\0';
+	if (header->rdesc_size &&
+			fread(rdesc, header->rdesc_size, 1, f) != 1)
+		return -1;
+
+	return 0;
+}
+
+static inline int lg_capture_write_record(FILE *f, uint32_t delta_us,
+				   uint8_t direction, const uint8_t *data,
+				   uint8_t size)
+{
+	struct lg_capture_record record = { delta_us, direction, size };
+
+	if (fwrite(&record, sizeof(record), 1, f) != 1 ||
+			fwrite(data, size, 1, f) != 1)
+		return -1;
+
+	return 0;
+}
+
+/* Returns 1 for a record, 0 at the end of the capture and -1 when truncated */
+static inline int lg_capture_read_record(FILE *f, struct lg_capture_record *record,
+				  uint8_t *data)
+{
+	if (fread(record, sizeof(*record), 1, f) != 1)
+		return feof(f) ? 0 : -1;
+
+	if (record->size && fread(data, record->size, 1, f) != 1)
+		return -1;
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,390 @@
+/* C */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+/* Unix */
+#include <sys/epoll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <libgen.h>
+#include <unistd.h>
+
+/* Linux */
+#include <linux/types.h>
+
+#include "lg-hidpp.h"
+
+/*
+ * Prints the HID++ traffic of many devices at once.
+ *
+ * Usage: lg-monitor [-d devnum,...] [-r register,...] [-i interval] [-a]
+ *                   [hidraw...]
+ *
+ * Without hidraw nodes every Logitech hidraw node is monitored. Every report
+ * is printed with the CLOCK_MONOTONIC time it was read, the node it came from
+ * and its description. Devnum and register restrict the reports printed to
+ * the given devices (numbers, or receiver) and registers (numbers or names).
+ * With -a the reports which aren't HID++ are printed too.
+ *
+ * Every interval seconds (default 5, 0 to disable) a line of key=value pairs
+ * is printed for every node, with the reports read since the previous one.
+ */
+
+#define MONITOR_MAX_DEVICES 64
+#define MONITOR_MAX_EVENTS 16
+#define MONITOR_BUFFER_SIZE (1 << 16)
+
+struct monitor_device {
+	int fd;
+	char node[32];
+	char name[128];
+
+	unsigned long reports;
+	unsigned long hidpp;
+	unsigned long shown;
+	unsigned long interval_reports;
+};
+
+struct monitor_device devices[MONITOR_MAX_DEVICES];
+int device_count;
+int open_count;
+
+/* Empty filters pass everything */
+unsigned char devnum_filter[256];
+int devnum_filtered;
+unsigned char register_filter[256];
+int register_filtered;
+int show_all;
+
+const struct lg_hidpp_name devnum_names[] = {
+	{ LG_HIDPP_RECEIVER, "receiver" },
+	{ }
+};
+
+const char hex[] = "0123456789abcdef";
+
+volatile sig_atomic_t running = 1;
+
+long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void stop(int sig)
+{
+	running = 0;
+}
+
+/* The name and ids of a hidraw node, from the uevent of its HID device */
+int read_uevent(const char *node, char *name, size_t size,
+		unsigned int *vendor)
+{
+	char path[128], line[256];
+	unsigned int bus, product;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/class/hidraw/%s/device/uevent",
+		 node);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+
+	*vendor = 0;
+	name[0] = '\0';
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = '\0';
+		if (!strncmp(line, "HID_NAME=", 9))
+			snprintf(name, size, "%s", line + 9);
+		else
+			sscanf(line, "HID_ID=%x:%x:%x", &bus, vendor, &product);
+	}
+
+	fclose(f);
+	return 0;
+}
+
+int add_device(const char *path, int epfd)
+{
+	struct monitor_device *device;
+	struct epoll_event ev;
+	char copy[128];
+	unsigned int vendor;
+
+	if (device_count == MONITOR_MAX_DEVICES) {
+		fprintf(stderr, "Too many devices, skipping %s\n", path);
+		return -1;
+	}
+
+	device = &devices[device_count];
+	memset(device, 0, sizeof(*device));
+	snprintf(copy, sizeof(copy), "%s", path);
+	snprintf(device->node, sizeof(device->node), "%s", basename(copy));
+	if (read_uevent(device->node, device->name, sizeof(device->name),
+			&vendor))
+		strcpy(device->name, "unknown");
+
+	device->fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (device->fd < 0) {
+		fprintf(stderr, "Unable to open %s: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.u32 = device_count;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, device->fd, &ev)) {
+		perror("epoll_ctl");
+		close(device->fd);
+		return -1;
+	}
+
+	fprintf(stderr, "Monitoring %s (%s)\n", device->node, device->name);
+	device_count++;
+	open_count++;
+	return 0;
+}
+
+/* Every hidraw node of a Logitech device */
+void discover_devices(int epfd)
+{
+	char name[128], path[64];
+	unsigned int vendor;
+	glob_t nodes;
+	size_t i;
+
+	if (glob("/sys/class/hidraw/hidraw*", 0, NULL, &nodes))
+		return;
+
+	for (i = 0; i < nodes.gl_pathc; i++) {
+		const char *node = strrchr(nodes.gl_pathv[i], '/') + 1;
+
+		if (read_uevent(node, name, sizeof(name), &vendor) ||
+				vendor != 0x046d)
+			continue;
+
+		snprintf(path, sizeof(path), "/dev/%s", node);
+		add_device(path, epfd);
+	}
+
+	globfree(&nodes);
+}
+
+void remove_device(struct monitor_device *device)
+{
+	fprintf(stderr, "%s is gone\n", device->node);
+	close(device->fd);
+	device->fd = -1;
+	open_count--;
+}
+
+/* Parses a comma separated list of numbers or names into a filter */
+int parse_filter(char *list, unsigned char *filter,
+		 const struct lg_hidpp_name *names)
+{
+	const struct lg_hidpp_name *entry;
+	unsigned long value;
+	char *item, *end;
+
+	for (item = strtok(list, ","); item; item = strtok(NULL, ",")) {
+		value = strtoul(item, &end, 0);
+		if (end != item && !*end && value <= 0xff) {
+			filter[value] = 1;
+			continue;
+		}
+
+		for (entry = names; entry->name; entry++) {
+			if (!strcmp(entry->name, item))
+				break;
+		}
+		if (!entry->name)
+			return -1;
+		filter[entry->value] = 1;
+	}
+
+	return 0;
+}
+
+int filtered(const __u8 *data, size_t size)
+{
+	int reg;
+
+	if (devnum_filtered && !devnum_filter[data[1]])
+		return 1;
+
+	/* Errors are shown for the register of the failed request */
+	reg = data[2] == 0x8f && size >= 5 ? data[4] : data[3];
+	if (register_filtered && !register_filter[reg])
+		return 1;
+
+	return 0;
+}
+
+void print_report(long long time_us, const struct monitor_device *device,
+		  const __u8 *data, size_t size)
+{
+	char line[1024], *p = line;
+	size_t i;
+
+	p += sprintf(p, "%lld.%06lld %s ", time_us / 1000000,
+		     time_us % 1000000, device->node);
+
+	for (i = 0; i < size; i++) {
+		*p++ = hex[data[i] >> 4];
+		*p++ = hex[data[i] & 0xf];
+		*p++ = ' ';
+	}
+
+	*p++ = ' ';
+	*p++ = '(';
+	p += lg_hidpp_describe(data, size, p, 64);
+	*p++ = ')';
+	*p++ = '\n';
+
+	fwrite(line, p - line, 1, stdout);
+}
+
+void handle_device(struct monitor_device *device)
+{
+	__u8 buf[256];
+	ssize_t res;
+	long long now;
+	int hidpp;
+
+	while ((res = read(device->fd, buf, sizeof(buf))) > 0) {
+		now = now_us();
+		device->reports++;
+		device->interval_reports++;
+
+		hidpp = res >= 4 && (buf[0] == LG_HIDPP_SHORT ||
+				     buf[0] == LG_HIDPP_LONG);
+		if (hidpp)
+			device->hidpp++;
+
+		if (hidpp ? filtered(buf, res) : !show_all)
+			continue;
+
+		device->shown++;
+		print_report(now, device, buf, res);
+	}
+
+	if (!res || (res < 0 && errno != EAGAIN))
+		remove_device(device);
+}
+
+void print_rates(long long elapsed_us)
+{
+	struct monitor_device *device;
+	int i;
+
+	for (i = 0; i < device_count; i++) {
+		device = &devices[i];
+		printf("device=%s name=\"%s\" reports=%lu hidpp=%lu shown=%lu "
+		       "reports_per_sec=%.1f%s\n", device->node, device->name,
+		       device->reports, device->hidpp, device->shown,
+		       device->interval_reports * 1000000.0 / elapsed_us,
+		       device->fd < 0 ? " gone=1" : "");
+		device->interval_reports = 0;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct epoll_event events[MONITOR_MAX_EVENTS];
+	long long last, now, next;
+	int interval = 5;
+	int epfd, opt, res, i;
+
+	while ((opt = getopt(argc, argv, "d:r:i:a")) != -1) {
+		switch (opt) {
+		case 'd':
+			devnum_filtered = 1;
+			if (parse_filter(optarg, devnum_filter, devnum_names))
+				goto err_usage;
+			break;
+		case 'r':
+			register_filtered = 1;
+			if (parse_filter(optarg, register_filter,
+					 lg_hidpp_registers))
+				goto err_usage;
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 'a':
+			show_all = 1;
+			break;
+		default:
+			goto err_usage;
+		}
+	}
+
+	if (interval < 0)
+		goto err_usage;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		return 1;
+	}
+
+	if (optind < argc) {
+		for (i = optind; i < argc; i++)
+			add_device(argv[i], epfd);
+	} else {
+		discover_devices(epfd);
+	}
+
+	if (!open_count) {
+		fprintf(stderr, "No devices to monitor\n");
+		return 1;
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	setvbuf(stdout, NULL, _IOFBF, MONITOR_BUFFER_SIZE);
+
+	last = now_us();
+	next = last + interval * 1000000LL;
+	while (running && open_count) {
+		now = now_us();
+		res = epoll_wait(epfd, events, MONITOR_MAX_EVENTS,
+				 !interval ? -1 : now < next ?
+				 (next - now + 999) / 1000 : 0);
+		if (res < 0 && errno != EINTR) {
+			perror("epoll_wait");
+			break;
+		}
+
+		for (i = 0; i < res; i++)
+			handle_device(&devices[events[i].data.u32]);
+
+		now = now_us();
+		if (interval && now >= next) {
+			print_rates(now - last);
+			last = now;
+			next = now + interval * 1000000LL;
+		}
+
+		/* Lines are only buffered while there is more to read */
+		fflush(stdout);
+	}
+
+	now = now_us();
+	if (now > last)
+		print_rates(now - last);
+	close(epfd);
+	return 0;
+err_usage:
+	fprintf(stderr, "Usage: %s [-d devnum,...] [-r register,...] "
+		"[-i interval] [-a] [hidraw...]\n", argv[0]);
+	return 1;
+}
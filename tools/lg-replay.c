@@ -0,0 +1,338 @@
+/* C */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+/* Unix */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+/* Linux */
+#include <linux/types.h>
+#include <linux/uhid.h>
+
+#include "lg-hidpp.h"
+
+/*
+ * Plays a capture of lg-debug back through /dev/uhid, as a device with the
+ * name, ids and report descriptor of the captured one.
+ *
+ * Usage: lg-replay [-s speed] [-w wait] capture
+ *
+ * The reports from the device are sent with their original timing divided by
+ * the speed (default 1), a speed of 0 sends them as fast as possible. The
+ * reports the driver sends to the device are compared to the ones in the
+ * capture, in order. After the last report the driver gets wait seconds
+ * (default 1) to send the rest.
+ *
+ * Prints one line of key=value pairs, lateness is how long after its time a
+ * report was sent in microseconds.
+ */
+
+struct replay_record {
+	long long time_us;
+	__u8 direction;
+	__u8 size;
+	__u8 data[256];
+};
+
+struct replay_record *records;
+size_t record_count;
+size_t next_out;
+
+unsigned long out_received;
+unsigned long out_matched;
+
+volatile sig_atomic_t running = 1;
+
+long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void stop(int sig)
+{
+	running = 0;
+}
+
+int uhid_write(int fd, struct uhid_event *ev)
+{
+	ssize_t ret;
+
+	ret = write(fd, ev, sizeof(*ev));
+	if (ret < 0) {
+		perror("uhid write");
+		return -1;
+	}
+
+	return 0;
+}
+
+int read_capture(const char *path, struct lg_capture_header *header,
+		 __u8 *rdesc)
+{
+	struct lg_capture_record record;
+	struct replay_record *entry;
+	size_t size = 0;
+	long long time_us = 0;
+	int res;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror("Unable to open capture");
+		return -1;
+	}
+
+	if (lg_capture_read_header(f, header, rdesc)) {
+		fprintf(stderr, "Not a capture\n");
+		goto err;
+	}
+
+	for (;;) {
+		if (record_count == size) {
+			size = size ? size * 2 : 1024;
+			entry = realloc(records, size * sizeof(*records));
+			if (!entry) {
+				perror("Unable to read capture");
+				goto err;
+			}
+			records = entry;
+		}
+
+		entry = &records[record_count];
+		res = lg_capture_read_record(f, &record, entry->data);
+		if (res <= 0)
+			break;
+
+		time_us += record.delta_us;
+		entry->time_us = time_us;
+		entry->direction = record.direction;
+		entry->size = record.size;
+		record_count++;
+	}
+
+	if (res < 0)
+		fprintf(stderr, "The capture is truncated, replaying %zu records\n",
+			record_count);
+
+	fclose(f);
+	return 0;
+err:
+	fclose(f);
+	return -1;
+}
+
+int create_device(const struct lg_capture_header *header, const __u8 *rdesc)
+{
+	struct uhid_event ev;
+	int fd;
+
+	if (header->rdesc_size > sizeof(ev.u.create2.rd_data)) {
+		fprintf(stderr, "The report descriptor is too big\n");
+		return -1;
+	}
+
+	fd = open("/dev/uhid", O_RDWR | O_CLOEXEC | O_NONBLOCK);
+	if (fd < 0) {
+		perror("Unable to open /dev/uhid");
+		return -1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_CREATE2;
+	snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name), "%s",
+		 header->name);
+	ev.u.create2.rd_size = header->rdesc_size;
+	ev.u.create2.bus = header->bus;
+	ev.u.create2.vendor = header->vendor;
+	ev.u.create2.product = header->product;
+	memcpy(ev.u.create2.rd_data, rdesc, header->rdesc_size);
+
+	if (uhid_write(fd, &ev)) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+void destroy_device(int fd)
+{
+	struct uhid_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_DESTROY;
+	uhid_write(fd, &ev);
+	close(fd);
+}
+
+/* Compares a report of the driver to the next one in the capture */
+void handle_output(const __u8 *data, size_t size)
+{
+	struct replay_record *record;
+
+	out_received++;
+
+	while (next_out < record_count &&
+			records[next_out].direction != LG_CAPTURE_OUT)
+		next_out++;
+	if (next_out == record_count)
+		return;
+
+	record = &records[next_out++];
+	if (record->size == size && !memcmp(record->data, data, size))
+		out_matched++;
+}
+
+void handle_uhid_event(int fd)
+{
+	struct uhid_event ev;
+	ssize_t ret;
+
+	ret = read(fd, &ev, sizeof(ev));
+	if (ret <= 0)
+		return;
+
+	switch (ev.type) {
+	case UHID_OUTPUT:
+		handle_output(ev.u.output.data, ev.u.output.size);
+		break;
+	case UHID_SET_REPORT:
+		handle_output(ev.u.set_report.data, ev.u.set_report.size);
+		ev.u.set_report_reply.err = 0;
+		ev.type = UHID_SET_REPORT_REPLY;
+		uhid_write(fd, &ev);
+		break;
+	case UHID_GET_REPORT:
+		ev.type = UHID_GET_REPORT_REPLY;
+		ev.u.get_report_reply.err = EIO;
+		ev.u.get_report_reply.size = 0;
+		uhid_write(fd, &ev);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Handles the reports of the driver until the given time, at least the ones
+ * already waiting when the time has passed.
+ */
+void wait_until(int fd, long long due)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	struct timespec ts;
+	long long now;
+
+	while (running) {
+		now = now_us();
+		if (poll(&pfd, 1, now < due ? (due - now) / 1000 : 0) > 0) {
+			handle_uhid_event(fd);
+			continue;
+		}
+
+		now = now_us();
+		if (now >= due)
+			break;
+
+		/* Poll only sleeps whole milliseconds */
+		ts.tv_sec = (due - now) / 1000000;
+		ts.tv_nsec = (due - now) % 1000000 * 1000;
+		nanosleep(&ts, NULL);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct lg_capture_header header;
+	static __u8 rdesc[4096];
+	struct replay_record *record;
+	struct uhid_event ev;
+	double speed = 1;
+	int wait = 1;
+	unsigned long in_sent = 0, out_expected = 0;
+	long long start, due, lateness, lateness_sum = 0, lateness_max = 0;
+	size_t i;
+	int opt, fd;
+
+	while ((opt = getopt(argc, argv, "s:w:")) != -1) {
+		switch (opt) {
+		case 's':
+			speed = atof(optarg);
+			break;
+		case 'w':
+			wait = atoi(optarg);
+			break;
+		default:
+			goto err_usage;
+		}
+	}
+
+	if (optind != argc - 1 || speed < 0 || wait < 0)
+		goto err_usage;
+
+	if (read_capture(argv[optind], &header, rdesc))
+		return 1;
+
+	fd = create_device(&header, rdesc);
+	if (fd < 0)
+		return 1;
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	/* Give the driver time to bind */
+	wait_until(fd, now_us() + 1000000);
+
+	start = now_us();
+	for (i = 0; i < record_count && running; i++) {
+		record = &records[i];
+		if (record->direction == LG_CAPTURE_OUT) {
+			out_expected++;
+			continue;
+		}
+
+		due = speed > 0 ? start + record->time_us / speed : now_us();
+		wait_until(fd, due);
+
+		memset(&ev, 0, sizeof(ev));
+		ev.type = UHID_INPUT2;
+		ev.u.input2.size = record->size;
+		memcpy(ev.u.input2.data, record->data, record->size);
+		if (uhid_write(fd, &ev))
+			break;
+
+		in_sent++;
+		lateness = now_us() - due;
+		lateness_sum += lateness;
+		if (lateness > lateness_max)
+			lateness_max = lateness;
+	}
+
+	due = now_us();
+	wait_until(fd, due + wait * 1000000LL);
+	destroy_device(fd);
+
+	printf("records=%zu in_sent=%lu out_expected=%lu out_received=%lu "
+	       "out_matched=%lu duration_us=%lld lateness_avg_us=%lld "
+	       "lateness_max_us=%lld\n",
+	       record_count, in_sent, out_expected, out_received, out_matched,
+	       due - start, in_sent ? lateness_sum / (long long)in_sent : 0,
+	       lateness_max);
+
+	free(records);
+	return 0;
+err_usage:
+	fprintf(stderr, "Usage: %s [-s speed] [-w wait] capture\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1 @@
+#include "../../lg-shim.h"
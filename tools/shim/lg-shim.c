@@ -0,0 +1,1207 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdarg.h>
+#include <time.h>
+
+#include "lg-shim.h"
+
+#define SHIM_MAX_MODULES 16
+#define SHIM_MAX_GROUPS 64
+
+struct workqueue_struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_cond_t idle;
+	pthread_once_t once;
+	pthread_t thread;
+	struct list_head works;
+	struct list_head timers;
+	struct work_struct *running;
+};
+
+struct shim_module {
+	int (*init)(void);
+	void (*exit)(void);
+};
+
+enum shim_debugfs_type {
+	SHIM_DEBUGFS_DIR,
+	SHIM_DEBUGFS_U32,
+	SHIM_DEBUGFS_BOOL,
+	SHIM_DEBUGFS_ATOMIC,
+	SHIM_DEBUGFS_FILE,
+};
+
+struct shim_debugfs_file {
+	struct list_head entry;
+	struct dentry dentry;
+	enum shim_debugfs_type type;
+	void *value;
+	const struct file_operations *fops;
+};
+
+struct shim_group {
+	struct kobject *kobj;
+	const struct attribute_group *grp;
+	const struct attribute **attrs;
+};
+
+static struct workqueue_struct shim_wq = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.idle = PTHREAD_COND_INITIALIZER,
+	.once = PTHREAD_ONCE_INIT,
+	.works = { &shim_wq.works, &shim_wq.works },
+	.timers = { &shim_wq.timers, &shim_wq.timers },
+};
+
+struct workqueue_struct *system_wq = &shim_wq;
+
+static struct shim_module modules[SHIM_MAX_MODULES];
+static int module_count;
+static int modules_loaded;
+
+static pthread_mutex_t sysfs_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head kobjects = { &kobjects, &kobjects };
+static struct shim_group groups[SHIM_MAX_GROUPS];
+
+static pthread_mutex_t debugfs_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head debugfs_files = { &debugfs_files, &debugfs_files };
+
+static pthread_mutex_t misc_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head misc_devices = { &misc_devices, &misc_devices };
+
+static pthread_mutex_t drivers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head drivers = { &drivers, &drivers };
+
+static struct kobj_type device_ktype;
+
+int shim_genl_listeners;
+void (*shim_genl_receive)(const struct genl_family *family, unsigned int group,
+			  const void *data, size_t len);
+struct net init_net;
+static int genl_next_id = 0x20;
+static int hid_next_id;
+
+int shim_verbose;
+unsigned long shim_messages;
+unsigned long shim_sysfs_notifications;
+
+/* Modules */
+
+void shim_module_add(int (*init)(void), void (*exit)(void))
+{
+	int i;
+
+	/* The init and exit constructors of a file run one after another */
+	if (exit && module_count && !modules[module_count - 1].exit) {
+		modules[module_count - 1].exit = exit;
+		return;
+	}
+
+	if (module_count == SHIM_MAX_MODULES)
+		abort();
+
+	i = module_count++;
+	modules[i].init = init;
+	modules[i].exit = exit;
+}
+
+int shim_modules_load(void)
+{
+	int ret;
+
+	for (; modules_loaded < module_count; modules_loaded++) {
+		if (!modules[modules_loaded].init)
+			continue;
+
+		ret = modules[modules_loaded].init();
+		if (ret) {
+			shim_modules_unload();
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+void shim_modules_unload(void)
+{
+	while (modules_loaded > 0) {
+		modules_loaded--;
+		if (modules[modules_loaded].exit)
+			modules[modules_loaded].exit();
+	}
+}
+
+/* Logging */
+
+void shim_log(const char *level, const char *fmt, ...)
+{
+	va_list args;
+
+	__atomic_add_fetch(&shim_messages, 1, __ATOMIC_RELAXED);
+	if (!shim_verbose)
+		return;
+
+	fprintf(stderr, "%s: ", level);
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	if (fmt[strlen(fmt) - 1] != '\n')
+		fputc('\n', stderr);
+}
+
+int shim_ratelimit(struct shim_ratelimit *state)
+{
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	int ret = 1;
+
+	pthread_mutex_lock(&lock);
+	if (!state->begin || time_after(jiffies, state->begin + 5000)) {
+		state->begin = jiffies;
+		state->printed = 0;
+	}
+	if (state->printed < 10)
+		state->printed++;
+	else
+		ret = 0;
+	pthread_mutex_unlock(&lock);
+
+	return ret;
+}
+
+/* Time */
+
+unsigned long shim_jiffies(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+u64 ktime_get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Work */
+
+static void *shim_worker(void *data)
+{
+	struct workqueue_struct *wq = data;
+	struct delayed_work *dwork;
+	struct work_struct *work;
+	struct list_head *pos, *n;
+	struct timespec until;
+	unsigned long now, next;
+
+	pthread_mutex_lock(&wq->lock);
+
+	for (;;) {
+		now = shim_jiffies();
+		next = 0;
+
+		list_for_each_safe(pos, n, &wq->timers) {
+			dwork = list_entry(pos, struct delayed_work, timer);
+			if (time_before(now, dwork->expires)) {
+				if (!next || time_before(dwork->expires, next))
+					next = dwork->expires;
+				continue;
+			}
+
+			list_del_init(&dwork->timer);
+			dwork->timer_pending = 0;
+			list_add_tail(&dwork->work.entry, &wq->works);
+		}
+
+		if (list_empty(&wq->works)) {
+			pthread_cond_broadcast(&wq->idle);
+
+			if (!next) {
+				pthread_cond_wait(&wq->cond, &wq->lock);
+				continue;
+			}
+
+			clock_gettime(CLOCK_MONOTONIC, &until);
+			until.tv_sec += (next - now) / 1000;
+			until.tv_nsec += ((next - now) % 1000) * 1000000;
+			if (until.tv_nsec >= 1000000000) {
+				until.tv_sec++;
+				until.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&wq->cond, &wq->lock, &until);
+			continue;
+		}
+
+		work = list_first_entry(&wq->works, struct work_struct, entry);
+		list_del_init(&work->entry);
+		work->pending = 0;
+		wq->running = work;
+
+		pthread_mutex_unlock(&wq->lock);
+		work->func(work);
+		pthread_mutex_lock(&wq->lock);
+
+		wq->running = NULL;
+		pthread_cond_broadcast(&wq->idle);
+	}
+
+	return NULL;
+}
+
+static void shim_worker_start(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&shim_wq.cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if (pthread_create(&shim_wq.thread, NULL, shim_worker, &shim_wq))
+		abort();
+	pthread_detach(shim_wq.thread);
+}
+
+static bool __queue_work(struct workqueue_struct *wq, struct work_struct *work)
+{
+	if (work->pending || work->canceling)
+		return false;
+
+	work->pending = 1;
+	list_add_tail(&work->entry, &wq->works);
+	pthread_cond_signal(&wq->cond);
+	return true;
+}
+
+bool schedule_work(struct work_struct *work)
+{
+	bool ret;
+
+	pthread_once(&shim_wq.once, shim_worker_start);
+
+	pthread_mutex_lock(&shim_wq.lock);
+	ret = __queue_work(&shim_wq, work);
+	pthread_mutex_unlock(&shim_wq.lock);
+
+	return ret;
+}
+
+static bool __queue_delayed_work(struct workqueue_struct *wq,
+				 struct delayed_work *dwork,
+				 unsigned long delay)
+{
+	if (dwork->work.pending || dwork->timer_pending ||
+			dwork->work.canceling)
+		return false;
+
+	if (!delay)
+		return __queue_work(wq, &dwork->work);
+
+	dwork->timer_pending = 1;
+	dwork->expires = shim_jiffies() + delay;
+	list_add_tail(&dwork->timer, &wq->timers);
+	pthread_cond_signal(&wq->cond);
+	return true;
+}
+
+/* Takes the work off the queue, returns whether it was pending */
+static bool __grab_delayed_work(struct delayed_work *dwork)
+{
+	bool pending = false;
+
+	if (dwork->timer_pending) {
+		list_del_init(&dwork->timer);
+		dwork->timer_pending = 0;
+		pending = true;
+	}
+
+	if (dwork->work.pending) {
+		list_del_init(&dwork->work.entry);
+		dwork->work.pending = 0;
+		pending = true;
+	}
+
+	return pending;
+}
+
+bool schedule_delayed_work(struct delayed_work *dwork, unsigned long delay)
+{
+	bool ret;
+
+	pthread_once(&shim_wq.once, shim_worker_start);
+
+	pthread_mutex_lock(&shim_wq.lock);
+	ret = __queue_delayed_work(&shim_wq, dwork, delay);
+	pthread_mutex_unlock(&shim_wq.lock);
+
+	return ret;
+}
+
+bool mod_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+		      unsigned long delay)
+{
+	bool ret;
+
+	pthread_once(&wq->once, shim_worker_start);
+
+	pthread_mutex_lock(&wq->lock);
+	ret = __grab_delayed_work(dwork);
+	__queue_delayed_work(wq, dwork, delay);
+	pthread_mutex_unlock(&wq->lock);
+
+	return ret;
+}
+
+static bool __cancel_work_sync(struct work_struct *work,
+			       struct delayed_work *dwork)
+{
+	bool ret;
+
+	pthread_mutex_lock(&shim_wq.lock);
+
+	/* Like the kernel, the work can't requeue itself while canceling */
+	work->canceling = 1;
+	if (dwork) {
+		ret = __grab_delayed_work(dwork);
+	} else {
+		ret = work->pending;
+		if (ret) {
+			list_del_init(&work->entry);
+			work->pending = 0;
+		}
+	}
+
+	while (shim_wq.running == work)
+		pthread_cond_wait(&shim_wq.idle, &shim_wq.lock);
+	work->canceling = 0;
+
+	pthread_mutex_unlock(&shim_wq.lock);
+
+	return ret;
+}
+
+bool cancel_work_sync(struct work_struct *work)
+{
+	return __cancel_work_sync(work, NULL);
+}
+
+bool cancel_delayed_work_sync(struct delayed_work *dwork)
+{
+	return __cancel_work_sync(&dwork->work, dwork);
+}
+
+/* Waits until no work is queued or running, timers are left alone */
+void flush_scheduled_work(void)
+{
+	pthread_mutex_lock(&shim_wq.lock);
+	while (!list_empty(&shim_wq.works) || shim_wq.running)
+		pthread_cond_wait(&shim_wq.idle, &shim_wq.lock);
+	pthread_mutex_unlock(&shim_wq.lock);
+}
+
+/* Kobjects and sysfs */
+
+int kobject_init_and_add(struct kobject *kobj, struct kobj_type *ktype,
+			 struct kobject *parent, const char *fmt, ...)
+{
+	va_list args;
+	int ret;
+
+	/* Like the kernel, kobject_put releases it even when adding failed */
+	kobj->ktype = ktype;
+
+	va_start(args, fmt);
+	ret = vasprintf(&kobj->name, fmt, args);
+	va_end(args);
+	if (ret < 0)
+		return -ENOMEM;
+
+	kobj->parent = parent;
+	kobj->state_initialized = 1;
+
+	pthread_mutex_lock(&sysfs_lock);
+	list_add_tail(&kobj->entry, &kobjects);
+	pthread_mutex_unlock(&sysfs_lock);
+
+	return 0;
+}
+
+void kobject_del(struct kobject *kobj)
+{
+	pthread_mutex_lock(&sysfs_lock);
+	if (kobj->entry.next)
+		list_del_init(&kobj->entry);
+	pthread_mutex_unlock(&sysfs_lock);
+}
+
+void kobject_put(struct kobject *kobj)
+{
+	kobject_del(kobj);
+
+	free(kobj->name);
+	kobj->name = NULL;
+	kobj->state_initialized = 0;
+
+	if (kobj->ktype && kobj->ktype->release)
+		kobj->ktype->release(kobj);
+}
+
+int kobject_uevent_env(struct kobject *kobj, enum kobject_action action,
+		       char *envp[])
+{
+	return 0;
+}
+
+static int shim_sysfs_add(struct kobject *kobj,
+			  const struct attribute_group *grp,
+			  const struct attribute **attrs)
+{
+	int i;
+
+	pthread_mutex_lock(&sysfs_lock);
+	for (i = 0; i < SHIM_MAX_GROUPS; i++) {
+		if (!groups[i].kobj) {
+			groups[i].kobj = kobj;
+			groups[i].grp = grp;
+			groups[i].attrs = attrs;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sysfs_lock);
+
+	return i == SHIM_MAX_GROUPS ? -ENOMEM : 0;
+}
+
+static void shim_sysfs_del(struct kobject *kobj,
+			   const struct attribute_group *grp,
+			   const struct attribute **attrs)
+{
+	int i;
+
+	pthread_mutex_lock(&sysfs_lock);
+	for (i = 0; i < SHIM_MAX_GROUPS; i++) {
+		if (groups[i].kobj == kobj && groups[i].grp == grp &&
+				groups[i].attrs == attrs)
+			memset(&groups[i], 0, sizeof(groups[i]));
+	}
+	pthread_mutex_unlock(&sysfs_lock);
+}
+
+int sysfs_create_group(struct kobject *kobj,
+		       const struct attribute_group *grp)
+{
+	return shim_sysfs_add(kobj, grp, NULL);
+}
+
+void sysfs_remove_group(struct kobject *kobj,
+			const struct attribute_group *grp)
+{
+	shim_sysfs_del(kobj, grp, NULL);
+}
+
+int sysfs_create_files(struct kobject *kobj, const struct attribute **attrs)
+{
+	return shim_sysfs_add(kobj, NULL, attrs);
+}
+
+void sysfs_remove_files(struct kobject *kobj, const struct attribute **attrs)
+{
+	shim_sysfs_del(kobj, NULL, attrs);
+}
+
+void sysfs_notify(struct kobject *kobj, const char *dir, const char *attr)
+{
+	__atomic_add_fetch(&shim_sysfs_notifications, 1, __ATOMIC_RELAXED);
+}
+
+struct kobject *shim_kobject_find(struct kobject *parent, const char *name)
+{
+	struct kobject *kobj, *found = NULL;
+
+	pthread_mutex_lock(&sysfs_lock);
+	list_for_each_entry(kobj, &kobjects, entry) {
+		if (kobj->parent == parent && !strcmp(kobj->name, name)) {
+			found = kobj;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sysfs_lock);
+
+	return found;
+}
+
+static struct attribute *shim_sysfs_find(struct kobject *kobj,
+					 const char *name)
+{
+	struct attribute *const *attrs;
+	struct attribute *found = NULL;
+	int i, j;
+
+	pthread_mutex_lock(&sysfs_lock);
+	for (i = 0; i < SHIM_MAX_GROUPS && !found; i++) {
+		if (groups[i].kobj != kobj)
+			continue;
+
+		attrs = groups[i].grp ? groups[i].grp->attrs :
+			(struct attribute *const *)groups[i].attrs;
+		for (j = 0; attrs[j]; j++) {
+			if (!strcmp(attrs[j]->name, name)) {
+				found = attrs[j];
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&sysfs_lock);
+
+	return found;
+}
+
+ssize_t shim_sysfs_show(struct kobject *kobj, const char *name, char *buf)
+{
+	struct attribute *attr = shim_sysfs_find(kobj, name);
+
+	if (!attr)
+		return -ENOENT;
+	if (!kobj->ktype->sysfs_ops->show)
+		return -EIO;
+
+	return kobj->ktype->sysfs_ops->show(kobj, attr, buf);
+}
+
+ssize_t shim_sysfs_store(struct kobject *kobj, const char *name,
+			 const char *buf, size_t count)
+{
+	struct attribute *attr = shim_sysfs_find(kobj, name);
+
+	if (!attr)
+		return -ENOENT;
+	if (!kobj->ktype->sysfs_ops->store)
+		return -EIO;
+
+	return kobj->ktype->sysfs_ops->store(kobj, attr, buf, count);
+}
+
+/* Debugfs */
+
+static struct dentry *shim_debugfs_add(const char *name, struct dentry *parent,
+				       enum shim_debugfs_type type,
+				       void *value,
+				       const struct file_operations *fops)
+{
+	struct shim_debugfs_file *file;
+	int ret;
+
+	file = calloc(1, sizeof(*file));
+	if (!file)
+		return NULL;
+
+	if (parent)
+		ret = asprintf(&file->dentry.path, "%s/%s", parent->path, name);
+	else
+		ret = asprintf(&file->dentry.path, "%s", name);
+	if (ret < 0) {
+		free(file);
+		return NULL;
+	}
+
+	file->type = type;
+	file->value = value;
+	file->fops = fops;
+
+	pthread_mutex_lock(&debugfs_lock);
+	list_add_tail(&file->entry, &debugfs_files);
+	pthread_mutex_unlock(&debugfs_lock);
+
+	return &file->dentry;
+}
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent)
+{
+	return shim_debugfs_add(name, parent, SHIM_DEBUGFS_DIR, NULL, NULL);
+}
+
+void debugfs_create_u32(const char *name, umode_t mode,
+			struct dentry *parent, u32 *value)
+{
+	shim_debugfs_add(name, parent, SHIM_DEBUGFS_U32, value, NULL);
+}
+
+void debugfs_create_bool(const char *name, umode_t mode,
+			 struct dentry *parent, bool *value)
+{
+	shim_debugfs_add(name, parent, SHIM_DEBUGFS_BOOL, value, NULL);
+}
+
+void debugfs_create_atomic_t(const char *name, umode_t mode,
+			     struct dentry *parent, atomic_t *value)
+{
+	shim_debugfs_add(name, parent, SHIM_DEBUGFS_ATOMIC, value, NULL);
+}
+
+struct dentry *debugfs_create_file(const char *name, umode_t mode,
+				   struct dentry *parent, void *data,
+				   const struct file_operations *fops)
+{
+	return shim_debugfs_add(name, parent, SHIM_DEBUGFS_FILE, data, fops);
+}
+
+void debugfs_remove_recursive(struct dentry *dentry)
+{
+	struct shim_debugfs_file *file;
+	struct list_head *cur, *next;
+	char *path;
+	size_t len;
+
+	if (!dentry)
+		return;
+
+	path = strdup(dentry->path);
+	if (!path)
+		return;
+	len = strlen(path);
+
+	pthread_mutex_lock(&debugfs_lock);
+	list_for_each_safe(cur, next, &debugfs_files) {
+		file = list_entry(cur, struct shim_debugfs_file, entry);
+		if (strncmp(file->dentry.path, path, len) ||
+		    (file->dentry.path[len] && file->dentry.path[len] != '/'))
+			continue;
+
+		list_del(&file->entry);
+		free(file->dentry.path);
+		free(file);
+	}
+	pthread_mutex_unlock(&debugfs_lock);
+
+	free(path);
+}
+
+static struct shim_debugfs_file *shim_debugfs_find(const char *path)
+{
+	struct shim_debugfs_file *file;
+
+	list_for_each_entry(file, &debugfs_files, entry) {
+		if (file->type != SHIM_DEBUGFS_DIR &&
+		    !strcmp(file->dentry.path, path))
+			return file;
+	}
+
+	return NULL;
+}
+
+int shim_debugfs_read(const char *path, unsigned long *value)
+{
+	struct shim_debugfs_file *file;
+	int ret = 0;
+
+	pthread_mutex_lock(&debugfs_lock);
+	file = shim_debugfs_find(path);
+	if (!file)
+		ret = -ENOENT;
+	else if (file->type == SHIM_DEBUGFS_U32)
+		*value = *(u32 *)file->value;
+	else if (file->type == SHIM_DEBUGFS_BOOL)
+		*value = *(bool *)file->value;
+	else if (file->type == SHIM_DEBUGFS_ATOMIC)
+		*value = atomic_read((atomic_t *)file->value);
+	else
+		ret = -EINVAL;
+	pthread_mutex_unlock(&debugfs_lock);
+
+	return ret;
+}
+
+int shim_debugfs_write(const char *path, unsigned long value)
+{
+	struct shim_debugfs_file *file;
+	int ret = 0;
+
+	pthread_mutex_lock(&debugfs_lock);
+	file = shim_debugfs_find(path);
+	if (!file)
+		ret = -ENOENT;
+	else if (file->type == SHIM_DEBUGFS_U32)
+		*(u32 *)file->value = value;
+	else if (file->type == SHIM_DEBUGFS_BOOL)
+		*(bool *)file->value = value;
+	else
+		ret = -EACCES;
+	pthread_mutex_unlock(&debugfs_lock);
+
+	return ret;
+}
+
+ssize_t shim_debugfs_show(const char *path, char *buf, size_t size)
+{
+	struct shim_debugfs_file *file;
+	struct seq_file s = { .buf = buf, .size = size };
+	ssize_t ret;
+
+	pthread_mutex_lock(&debugfs_lock);
+	file = shim_debugfs_find(path);
+	if (!file)
+		ret = -ENOENT;
+	else if (file->type != SHIM_DEBUGFS_FILE || !file->fops->shim_show)
+		ret = -EINVAL;
+	else {
+		s.private = file->value;
+		ret = file->fops->shim_show(&s, NULL);
+		if (!ret)
+			ret = s.count;
+	}
+	pthread_mutex_unlock(&debugfs_lock);
+
+	return ret;
+}
+
+void seq_printf(struct seq_file *s, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(s->buf + s->count, s->size - s->count, fmt, args);
+	va_end(args);
+
+	if (len > 0)
+		s->count = min(s->count + len, s->size);
+}
+
+/* Ids */
+
+int ida_alloc(struct ida *ida, gfp_t gfp)
+{
+	int id;
+
+	pthread_mutex_lock(&ida->lock);
+	for (id = 0; id < 64 && (ida->used & (1ULL << id)); id++)
+		;
+	if (id < 64)
+		ida->used |= 1ULL << id;
+	pthread_mutex_unlock(&ida->lock);
+
+	return id < 64 ? id : -ENOSPC;
+}
+
+void ida_free(struct ida *ida, unsigned int id)
+{
+	pthread_mutex_lock(&ida->lock);
+	ida->used &= ~(1ULL << id);
+	pthread_mutex_unlock(&ida->lock);
+}
+
+/* Misc devices */
+
+int misc_register(struct miscdevice *misc)
+{
+	pthread_mutex_lock(&misc_lock);
+	list_add_tail(&misc->shim_entry, &misc_devices);
+	pthread_mutex_unlock(&misc_lock);
+
+	return 0;
+}
+
+void misc_deregister(struct miscdevice *misc)
+{
+	pthread_mutex_lock(&misc_lock);
+	list_del(&misc->shim_entry);
+	pthread_mutex_unlock(&misc_lock);
+}
+
+/* Like misc_open, the open runs with the lock held so it can't race removal */
+struct file *shim_misc_open(const char *name)
+{
+	struct miscdevice *misc;
+	struct file *file = NULL;
+
+	pthread_mutex_lock(&misc_lock);
+	list_for_each_entry(misc, &misc_devices, shim_entry) {
+		if (strcmp(misc->name, name))
+			continue;
+
+		file = calloc(1, sizeof(*file));
+		if (!file)
+			break;
+
+		file->f_op = misc->fops;
+		file->private_data = misc;
+		if (file->f_op->open && file->f_op->open(NULL, file)) {
+			free(file);
+			file = NULL;
+		}
+		break;
+	}
+	pthread_mutex_unlock(&misc_lock);
+
+	return file;
+}
+
+ssize_t shim_misc_read(struct file *file, void *buf, size_t count)
+{
+	loff_t pos = 0;
+
+	if (!file->f_op->read)
+		return -EINVAL;
+
+	return file->f_op->read(file, buf, count, &pos);
+}
+
+ssize_t shim_misc_write(struct file *file, const void *buf, size_t count)
+{
+	loff_t pos = 0;
+
+	if (!file->f_op->write)
+		return -EINVAL;
+
+	return file->f_op->write(file, buf, count, &pos);
+}
+
+long shim_misc_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	if (!file->f_op->unlocked_ioctl)
+		return -ENOTTY;
+
+	return file->f_op->unlocked_ioctl(file, cmd, arg);
+}
+
+/* Returns the memory the device maps, or NULL */
+void *shim_misc_mmap(struct file *file, size_t size)
+{
+	struct vm_area_struct vma = { .vm_end = PAGE_ALIGN(size) };
+
+	if (!file->f_op->mmap || file->f_op->mmap(file, &vma))
+		return NULL;
+
+	return (void *)vma.vm_start;
+}
+
+__poll_t shim_misc_poll(struct file *file)
+{
+	if (!file->f_op->poll)
+		return 0;
+
+	return file->f_op->poll(file, NULL);
+}
+
+void shim_misc_release(struct file *file)
+{
+	if (file->f_op->release)
+		file->f_op->release(NULL, file);
+	free(file);
+}
+
+/* Generic netlink */
+
+int genl_register_family(struct genl_family *family)
+{
+	family->id = __atomic_fetch_add(&genl_next_id, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+int genl_unregister_family(const struct genl_family *family)
+{
+	return 0;
+}
+
+bool genl_has_listeners(const struct genl_family *family, struct net *net,
+			unsigned int group)
+{
+	return __atomic_load_n(&shim_genl_listeners, __ATOMIC_RELAXED) &&
+		group < family->n_mcgrps;
+}
+
+struct sk_buff *genlmsg_new(size_t payload, gfp_t flags)
+{
+	struct sk_buff *skb;
+
+	skb = calloc(1, sizeof(*skb));
+	if (!skb)
+		return NULL;
+
+	skb->size = NLA_ALIGN(sizeof(struct nlmsghdr)) +
+		NLA_ALIGN(sizeof(struct genlmsghdr)) + payload;
+	skb->data = calloc(1, skb->size);
+	if (!skb->data) {
+		free(skb);
+		return NULL;
+	}
+
+	return skb;
+}
+
+void nlmsg_free(struct sk_buff *skb)
+{
+	free(skb->data);
+	free(skb);
+}
+
+static void *shim_skb_put(struct sk_buff *skb, unsigned int len)
+{
+	void *start = skb->data + skb->len;
+
+	if (skb->len + NLA_ALIGN(len) > skb->size)
+		return NULL;
+
+	memset(start, 0, NLA_ALIGN(len));
+	skb->len += NLA_ALIGN(len);
+	return start;
+}
+
+void *genlmsg_put(struct sk_buff *skb, u32 portid, u32 seq,
+		  const struct genl_family *family, int flags, u8 cmd)
+{
+	struct nlmsghdr *nlh;
+	struct genlmsghdr *hdr;
+
+	nlh = shim_skb_put(skb, sizeof(*nlh));
+	hdr = shim_skb_put(skb, sizeof(*hdr));
+	if (!nlh || !hdr)
+		return NULL;
+
+	nlh->nlmsg_type = family->id;
+	nlh->nlmsg_flags = flags;
+	nlh->nlmsg_seq = seq;
+	nlh->nlmsg_pid = portid;
+	hdr->cmd = cmd;
+	hdr->version = family->version;
+
+	return hdr;
+}
+
+void genlmsg_end(struct sk_buff *skb, void *hdr)
+{
+	struct nlmsghdr *nlh = (struct nlmsghdr *)skb->data;
+
+	nlh->nlmsg_len = skb->len;
+}
+
+int genlmsg_multicast(const struct genl_family *family, struct sk_buff *skb,
+		      u32 portid, unsigned int group, gfp_t flags)
+{
+	int ret = -ESRCH;
+
+	if (shim_genl_receive && genl_has_listeners(family, &init_net, group)) {
+		shim_genl_receive(family, group, skb->data, skb->len);
+		ret = 0;
+	}
+
+	nlmsg_free(skb);
+	return ret;
+}
+
+int nla_put(struct sk_buff *skb, int attrtype, int attrlen, const void *data)
+{
+	struct nlattr *nla;
+
+	nla = shim_skb_put(skb, NLA_HDRLEN + attrlen);
+	if (!nla)
+		return -EMSGSIZE;
+
+	nla->nla_len = NLA_HDRLEN + attrlen;
+	nla->nla_type = attrtype;
+	if (attrlen)
+		memcpy((unsigned char *)nla + NLA_HDRLEN, data, attrlen);
+	return 0;
+}
+
+struct nlattr *nla_nest_start(struct sk_buff *skb, int attrtype)
+{
+	struct nlattr *start = (struct nlattr *)(skb->data + skb->len);
+
+	if (nla_put(skb, attrtype | NLA_F_NESTED, 0, NULL))
+		return NULL;
+
+	return start;
+}
+
+int nla_nest_end(struct sk_buff *skb, struct nlattr *start)
+{
+	start->nla_len = skb->data + skb->len - (unsigned char *)start;
+	return skb->len;
+}
+
+void nla_nest_cancel(struct sk_buff *skb, struct nlattr *start)
+{
+	skb->len = (unsigned char *)start - skb->data;
+}
+
+/* Devices */
+
+static ssize_t device_attr_show(struct kobject *kobj, struct attribute *attr,
+				char *buf)
+{
+	struct device_attribute *dev_attr = container_of(attr,
+					struct device_attribute, attr);
+	struct device *dev = container_of(kobj, struct device, kobj);
+
+	if (!dev_attr->show)
+		return -EIO;
+
+	return dev_attr->show(dev, dev_attr, buf);
+}
+
+static ssize_t device_attr_store(struct kobject *kobj, struct attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct device_attribute *dev_attr = container_of(attr,
+					struct device_attribute, attr);
+	struct device *dev = container_of(kobj, struct device, kobj);
+
+	if (!dev_attr->store)
+		return -EIO;
+
+	return dev_attr->store(dev, dev_attr, buf, count);
+}
+
+static const struct sysfs_ops device_sysfs_ops = {
+	.show = device_attr_show,
+	.store = device_attr_store,
+};
+
+static struct kobj_type device_ktype = {
+	.sysfs_ops = &device_sysfs_ops,
+};
+
+/* Fake devices are probed directly, there is no bus to walk */
+int bus_for_each_dev(struct bus_type *bus, struct device *start, void *data,
+		     int (*fn)(struct device *dev, void *data))
+{
+	return 0;
+}
+
+void device_release_driver(struct device *dev)
+{
+}
+
+int driver_attach(struct device_driver *drv)
+{
+	return 0;
+}
+
+/* HID */
+
+int hid_hw_output_report(struct hid_device *hdev, u8 *buf, size_t len)
+{
+	if (!hdev->ll_driver->output_report)
+		return -ENOSYS;
+
+	return hdev->ll_driver->output_report(hdev, buf, len);
+}
+
+int hid_hw_raw_request(struct hid_device *hdev, unsigned char reportnum,
+		       u8 *buf, size_t len, unsigned char rtype, int reqtype)
+{
+	if (!hdev->ll_driver->raw_request)
+		return -ENOSYS;
+
+	return hdev->ll_driver->raw_request(hdev, reportnum, buf, len, rtype,
+					    reqtype);
+}
+
+int hid_register_driver(struct hid_driver *hdrv)
+{
+	pthread_mutex_lock(&drivers_lock);
+	list_add_tail(&hdrv->shim_entry, &drivers);
+	pthread_mutex_unlock(&drivers_lock);
+
+	return 0;
+}
+
+void hid_unregister_driver(struct hid_driver *hdrv)
+{
+	pthread_mutex_lock(&drivers_lock);
+	list_del(&hdrv->shim_entry);
+	pthread_mutex_unlock(&drivers_lock);
+}
+
+static const struct hid_device_id *shim_hid_match(struct hid_driver *hdrv,
+						  struct hid_device *hdev)
+{
+	const struct hid_device_id *id;
+
+	for (id = hdrv->id_table; id->bus; id++) {
+		if (id->bus == hdev->bus && id->vendor == hdev->vendor &&
+				id->product == hdev->product)
+			return id;
+	}
+
+	return NULL;
+}
+
+struct hid_device *shim_hid_create(u16 bus, u32 vendor, u32 product,
+				   struct hid_ll_driver *ll_driver,
+				   void *data)
+{
+	const struct hid_device_id *id = NULL;
+	struct hid_driver *hdrv;
+	struct hid_device *hdev;
+
+	hdev = calloc(1, sizeof(*hdev));
+	if (!hdev)
+		return NULL;
+
+	hdev->bus = bus;
+	hdev->vendor = vendor;
+	hdev->product = product;
+	hdev->ll_driver = ll_driver;
+	hdev->shim_data = data;
+	hdev->dev.kobj.ktype = &device_ktype;
+	if (asprintf(&hdev->dev.kobj.name, "%04X:%04X:%04X.%04X", bus, vendor,
+		     product, __atomic_add_fetch(&hid_next_id, 1,
+						 __ATOMIC_SEQ_CST)) < 0)
+		goto err_free;
+
+	pthread_mutex_lock(&drivers_lock);
+	list_for_each_entry(hdrv, &drivers, shim_entry) {
+		id = shim_hid_match(hdrv, hdev);
+		if (id)
+			break;
+	}
+	pthread_mutex_unlock(&drivers_lock);
+
+	if (!id)
+		goto err_free;
+
+	hdev->driver = hdrv;
+	hdev->dev.driver = &hdrv->driver;
+	if (hdrv->probe(hdev, id))
+		goto err_free;
+
+	return hdev;
+err_free:
+	free(hdev->dev.kobj.name);
+	free(hdev);
+	return NULL;
+}
+
+void shim_hid_destroy(struct hid_device *hdev)
+{
+	if (hdev->driver->remove)
+		hdev->driver->remove(hdev);
+	free(hdev->dev.kobj.name);
+	free(hdev);
+}
+
+int shim_hid_input(struct hid_device *hdev, const u8 *data, int size)
+{
+	struct hid_report report = { .id = data[0] };
+	u8 buf[HID_MAX_BUFFER_SIZE];
+
+	/* raw_event may modify the buffer, like the one of the transport */
+	memcpy(buf, data, size);
+
+	return hdev->driver->raw_event(hdev, &report, buf, size);
+}
@@ -0,0 +1,895 @@
+#ifndef __LG_SHIM
+#define __LG_SHIM
+
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+/*
+ * The kernel API used by the drivers, implemented on top of pthreads so the
+ * drivers can be built and benchmarked in userspace. Only the parts which
+ * are used are provided. There is a single workqueue with one thread, like
+ * an ordered workqueue, the spinlocks are mutexes and jiffies are
+ * milliseconds.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/types.h>
+#include <asm-generic/ioctl.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef u8 __u8;
+typedef u16 __u16;
+typedef u32 __u32;
+typedef u64 __u64;
+typedef s32 __s32;
+typedef unsigned long kernel_ulong_t;
+typedef unsigned int gfp_t;
+typedef unsigned short umode_t;
+
+/* The optional kernel features the shim provides */
+#define CONFIG_DEBUG_FS 1
+#define CONFIG_NET 1
+
+#define GFP_KERNEL 0
+#define GFP_ATOMIC 1
+
+#define __init
+#define __exit
+#define __user
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE 4096
+#define PAGE_ALIGN(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+#define READ_ONCE(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, v) __atomic_store_n(&(x), v, __ATOMIC_RELAXED)
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max_t(t, a, b) ((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define min_t(t, a, b) ((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+
+/* Modules */
+
+#define EXPORT_SYMBOL_GPL(x)
+#define EXPORT_SYMBOL(x)
+#define MODULE_LICENSE(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_VERSION(x)
+#define MODULE_DEVICE_TABLE(type, table) \
+	static const void *shim_device_table_##table \
+		__attribute__((unused)) = table;
+#define MODULE_PARM_DESC(name, desc)
+#define module_param(name, type, perm)
+
+void shim_module_add(int (*init)(void), void (*exit)(void));
+
+#define module_init(fn) \
+	static void __attribute__((constructor)) shim_module_init_##fn(void) \
+	{ shim_module_add(fn, NULL); }
+#define module_exit(fn) \
+	static void __attribute__((constructor)) shim_module_exit_##fn(void) \
+	{ shim_module_add(NULL, fn); }
+
+int shim_modules_load(void);
+void shim_modules_unload(void);
+
+/* Logging, messages are counted and only printed when shim_verbose is set */
+
+extern int shim_verbose;
+extern unsigned long shim_messages;
+
+void shim_log(const char *level, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+#define pr_err(fmt, ...) shim_log("err", fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...) shim_log("warn", fmt, ##__VA_ARGS__)
+#define pr_info(fmt, ...) shim_log("info", fmt, ##__VA_ARGS__)
+#define hid_err(hdev, fmt, ...) shim_log("err", fmt, ##__VA_ARGS__)
+#define hid_warn(hdev, fmt, ...) shim_log("warn", fmt, ##__VA_ARGS__)
+#define hid_info(hdev, fmt, ...) shim_log("info", fmt, ##__VA_ARGS__)
+#define hid_dbg(hdev, fmt, ...) do { } while (0)
+/* Like the defaults of the kernel, 10 messages every 5 seconds per call */
+struct shim_ratelimit {
+	unsigned long begin;
+	int printed;
+};
+
+int shim_ratelimit(struct shim_ratelimit *state);
+
+#define dev_warn_ratelimited(dev, fmt, ...) \
+	do { \
+		static struct shim_ratelimit shim_state; \
+		if (shim_ratelimit(&shim_state)) \
+			shim_log("warn", fmt, ##__VA_ARGS__); \
+	} while (0)
+
+#define scnprintf snprintf
+
+static inline ssize_t strscpy(char *dest, const char *src, size_t count)
+{
+	size_t len = strnlen(src, count);
+
+	if (len == count) {
+		memcpy(dest, src, count - 1);
+		dest[count - 1] = '\0';
+		return -E2BIG;
+	}
+
+	memcpy(dest, src, len + 1);
+	return len;
+}
+
+/* Memory */
+
+#define kzalloc(size, gfp) calloc(1, size)
+#define kmalloc(size, gfp) malloc(size)
+#define kcalloc(n, size, gfp) calloc(n, size)
+
+static inline void kfree(const void *p)
+{
+	free((void *)p);
+}
+
+static inline void *kmemdup(const void *src, size_t len, gfp_t gfp)
+{
+	void *p = malloc(len);
+
+	if (p)
+		memcpy(p, src, len);
+	return p;
+}
+
+/* Lists */
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+#define LIST_HEAD(name) struct list_head name = LIST_HEAD_INIT(name)
+#define INIT_LIST_HEAD(l) do { (l)->next = (l); (l)->prev = (l); } while (0)
+
+static inline void list_add(struct list_head *n, struct list_head *h)
+{
+	n->next = h->next;
+	n->prev = h;
+	h->next->prev = n;
+	h->next = n;
+}
+
+static inline void list_add_tail(struct list_head *n, struct list_head *h)
+{
+	n->prev = h->prev;
+	n->next = h;
+	h->prev->next = n;
+	h->prev = n;
+}
+
+static inline void list_del(struct list_head *e)
+{
+	e->prev->next = e->next;
+	e->next->prev = e->prev;
+}
+
+static inline void list_del_init(struct list_head *e)
+{
+	list_del(e);
+	INIT_LIST_HEAD(e);
+}
+
+static inline int list_empty(const struct list_head *h)
+{
+	return h->next == h;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_first_entry(head, type, member) list_entry((head)->next, type, member)
+#define list_for_each_entry(pos, head, member) \
+	for (pos = list_entry((head)->next, __typeof__(*pos), member); \
+	     &pos->member != (head); \
+	     pos = list_entry(pos->member.next, __typeof__(*pos), member))
+#define list_for_each_safe(pos, n, head) \
+	for (pos = (head)->next, n = pos->next; pos != (head); \
+	     pos = n, n = pos->next)
+
+/* Locking */
+
+typedef struct {
+	pthread_mutex_t m;
+} spinlock_t;
+
+#define DEFINE_SPINLOCK(name) spinlock_t name = { PTHREAD_MUTEX_INITIALIZER }
+#define spin_lock_init(l) pthread_mutex_init(&(l)->m, NULL)
+#define spin_lock_irqsave(l, f) \
+	do { (void)(f); pthread_mutex_lock(&(l)->m); } while (0)
+#define spin_unlock_irqrestore(l, f) pthread_mutex_unlock(&(l)->m)
+#define spin_lock(l) pthread_mutex_lock(&(l)->m)
+#define spin_unlock(l) pthread_mutex_unlock(&(l)->m)
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+#define ATOMIC_INIT(i) { (i) }
+#define atomic_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_SEQ_CST)
+#define atomic_set(v, i) __atomic_store_n(&(v)->counter, i, __ATOMIC_SEQ_CST)
+#define atomic_inc(v) ((void)__atomic_add_fetch(&(v)->counter, 1, \
+						__ATOMIC_SEQ_CST))
+#define atomic_dec(v) ((void)__atomic_sub_fetch(&(v)->counter, 1, \
+						__ATOMIC_SEQ_CST))
+#define atomic_inc_return(v) __atomic_add_fetch(&(v)->counter, 1, \
+						__ATOMIC_SEQ_CST)
+#define atomic_add_return(i, v) __atomic_add_fetch(&(v)->counter, i, \
+						   __ATOMIC_SEQ_CST)
+
+typedef struct {
+	long counter;
+} atomic_long_t;
+
+#define atomic_long_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic_long_inc(v) ((void)__atomic_add_fetch(&(v)->counter, 1, \
+						     __ATOMIC_RELAXED))
+#define atomic_long_add(i, v) ((void)__atomic_add_fetch(&(v)->counter, i, \
+							__ATOMIC_RELAXED))
+
+struct kref {
+	int refcount;
+};
+
+static inline void kref_init(struct kref *k)
+{
+	__atomic_store_n(&k->refcount, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void kref_get(struct kref *k)
+{
+	__atomic_add_fetch(&k->refcount, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline int kref_put(struct kref *k, void (*release)(struct kref *k))
+{
+	if (__atomic_sub_fetch(&k->refcount, 1, __ATOMIC_SEQ_CST))
+		return 0;
+
+	release(k);
+	return 1;
+}
+
+/* Time, jiffies are milliseconds */
+
+#define HZ 1000
+
+unsigned long shim_jiffies(void);
+
+#define jiffies shim_jiffies()
+#define time_before(a, b) ((long)((a) - (b)) < 0)
+#define time_after(a, b) time_before(b, a)
+#define msecs_to_jiffies(m) ((unsigned long)(m))
+#define jiffies_to_msecs(j) ((unsigned int)(j))
+
+#define NSEC_PER_SEC 1000000000ULL
+
+u64 ktime_get_ns(void);
+
+/* Work */
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+struct work_struct {
+	work_func_t func;
+	struct list_head entry;
+	int pending;
+	int canceling;
+};
+
+struct delayed_work {
+	struct work_struct work;
+	struct list_head timer;
+	unsigned long expires;
+	int timer_pending;
+};
+
+struct workqueue_struct;
+extern struct workqueue_struct *system_wq;
+
+#define INIT_WORK(w, f) \
+	do { \
+		(w)->func = (f); \
+		INIT_LIST_HEAD(&(w)->entry); \
+		(w)->pending = 0; \
+		(w)->canceling = 0; \
+	} while (0)
+#define INIT_DELAYED_WORK(w, f) \
+	do { \
+		INIT_WORK(&(w)->work, f); \
+		INIT_LIST_HEAD(&(w)->timer); \
+		(w)->timer_pending = 0; \
+	} while (0)
+#define DECLARE_DELAYED_WORK(n, f) \
+	struct delayed_work n = { \
+		.work = { .func = (f), .entry = LIST_HEAD_INIT(n.work.entry) }, \
+		.timer = LIST_HEAD_INIT(n.timer), \
+	}
+#define to_delayed_work(w) container_of(w, struct delayed_work, work)
+
+bool schedule_work(struct work_struct *work);
+bool cancel_work_sync(struct work_struct *work);
+bool schedule_delayed_work(struct delayed_work *dwork, unsigned long delay);
+bool mod_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+		      unsigned long delay);
+bool cancel_delayed_work_sync(struct delayed_work *dwork);
+void flush_scheduled_work(void);
+
+/* Wait queues, waiters can't be interrupted */
+
+typedef struct wait_queue_head {
+	pthread_mutex_t m;
+	pthread_cond_t c;
+} wait_queue_head_t;
+
+#define init_waitqueue_head(w) \
+	do { \
+		pthread_mutex_init(&(w)->m, NULL); \
+		pthread_cond_init(&(w)->c, NULL); \
+	} while (0)
+#define wake_up_interruptible(w) \
+	do { \
+		pthread_mutex_lock(&(w)->m); \
+		pthread_cond_broadcast(&(w)->c); \
+		pthread_mutex_unlock(&(w)->m); \
+	} while (0)
+#define wake_up wake_up_interruptible
+#define wait_event_interruptible(w, cond) ({ \
+	pthread_mutex_lock(&(w).m); \
+	while (!(cond)) \
+		pthread_cond_wait(&(w).c, &(w).m); \
+	pthread_mutex_unlock(&(w).m); \
+	0; })
+
+/* Returns the jiffies left when the condition is met, 0 on the timeout */
+#define wait_event_interruptible_timeout(w, cond, timeout) ({ \
+	unsigned long __end = jiffies + (timeout); \
+	struct timespec __ts; \
+	long __ret = 0; \
+	clock_gettime(CLOCK_REALTIME, &__ts); \
+	__ts.tv_sec += (timeout) / 1000; \
+	__ts.tv_nsec += (timeout) % 1000 * 1000000; \
+	if (__ts.tv_nsec >= 1000000000) { \
+		__ts.tv_sec++; \
+		__ts.tv_nsec -= 1000000000; \
+	} \
+	pthread_mutex_lock(&(w).m); \
+	while (!(cond)) { \
+		if (pthread_cond_timedwait(&(w).c, &(w).m, &__ts)) \
+			break; \
+	} \
+	if (cond) \
+		__ret = max(1L, (long)(__end - jiffies)); \
+	pthread_mutex_unlock(&(w).m); \
+	__ret; })
+
+/* Mutexes, can't be interrupted either */
+
+struct mutex {
+	pthread_mutex_t m;
+};
+
+#define DEFINE_MUTEX(name) struct mutex name = { PTHREAD_MUTEX_INITIALIZER }
+#define mutex_init(l) pthread_mutex_init(&(l)->m, NULL)
+#define mutex_lock(l) pthread_mutex_lock(&(l)->m)
+#define mutex_lock_interruptible(l) (pthread_mutex_lock(&(l)->m), 0)
+#define mutex_unlock(l) pthread_mutex_unlock(&(l)->m)
+
+/* Ids, at most 64 of them */
+
+struct ida {
+	pthread_mutex_t lock;
+	u64 used;
+};
+
+#define DEFINE_IDA(name) struct ida name = { PTHREAD_MUTEX_INITIALIZER, 0 }
+
+int ida_alloc(struct ida *ida, gfp_t gfp);
+void ida_free(struct ida *ida, unsigned int id);
+
+/* Kobjects and sysfs */
+
+struct kobject;
+struct attribute {
+	const char *name;
+	unsigned short mode;
+};
+
+struct attribute_group {
+	const char *name;
+	struct attribute **attrs;
+};
+
+struct sysfs_ops {
+	ssize_t (*show)(struct kobject *kobj, struct attribute *attr,
+			char *buf);
+	ssize_t (*store)(struct kobject *kobj, struct attribute *attr,
+			 const char *buf, size_t count);
+};
+
+struct kobj_type {
+	void (*release)(struct kobject *kobj);
+	const struct sysfs_ops *sysfs_ops;
+};
+
+struct kobject {
+	char *name;
+	struct kobject *parent;
+	struct kobj_type *ktype;
+	struct list_head entry;
+	unsigned int state_initialized:1;
+};
+
+enum kobject_action {
+	KOBJ_ADD,
+	KOBJ_REMOVE,
+	KOBJ_CHANGE,
+};
+
+static inline const char *kobject_name(const struct kobject *kobj)
+{
+	return kobj->name;
+}
+
+int kobject_init_and_add(struct kobject *kobj, struct kobj_type *ktype,
+			 struct kobject *parent, const char *fmt, ...);
+void kobject_del(struct kobject *kobj);
+void kobject_put(struct kobject *kobj);
+int kobject_uevent_env(struct kobject *kobj, enum kobject_action action,
+		       char *envp[]);
+
+int sysfs_create_group(struct kobject *kobj,
+		       const struct attribute_group *grp);
+void sysfs_remove_group(struct kobject *kobj,
+			const struct attribute_group *grp);
+int sysfs_create_files(struct kobject *kobj, const struct attribute **attrs);
+void sysfs_remove_files(struct kobject *kobj, const struct attribute **attrs);
+
+/* Only counted, nothing polls the attributes of the shim */
+extern unsigned long shim_sysfs_notifications;
+void sysfs_notify(struct kobject *kobj, const char *dir, const char *attr);
+
+/* Looks up a child kobject or an attribute, and reads or writes it */
+struct kobject *shim_kobject_find(struct kobject *parent, const char *name);
+ssize_t shim_sysfs_show(struct kobject *kobj, const char *name, char *buf);
+ssize_t shim_sysfs_store(struct kobject *kobj, const char *name,
+			 const char *buf, size_t count);
+
+/* Debugfs, the files can be read and written by their path */
+
+struct dentry {
+	char *path;
+};
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent);
+void debugfs_create_u32(const char *name, umode_t mode,
+			struct dentry *parent, u32 *value);
+void debugfs_create_bool(const char *name, umode_t mode,
+			 struct dentry *parent, bool *value);
+void debugfs_create_atomic_t(const char *name, umode_t mode,
+			     struct dentry *parent, atomic_t *value);
+void debugfs_remove_recursive(struct dentry *dentry);
+#define debugfs_remove debugfs_remove_recursive
+
+struct file_operations;
+struct dentry *debugfs_create_file(const char *name, umode_t mode,
+				   struct dentry *parent, void *data,
+				   const struct file_operations *fops);
+
+/* Paths are relative to the root of debugfs, like hid-logitech/fault */
+int shim_debugfs_read(const char *path, unsigned long *value);
+int shim_debugfs_write(const char *path, unsigned long value);
+/* The output of a file made by DEFINE_SHOW_ATTRIBUTE, cut at size */
+ssize_t shim_debugfs_show(const char *path, char *buf, size_t size);
+
+/* Sequence files, everything is printed into one buffer */
+
+struct seq_file {
+	char *buf;
+	size_t size;
+	size_t count;
+	void *private;
+};
+
+void seq_printf(struct seq_file *s, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static inline void seq_putc(struct seq_file *s, char c)
+{
+	if (s->count < s->size)
+		s->buf[s->count++] = c;
+}
+
+/* Files and misc devices, user memory is ordinary memory */
+
+struct module;
+#define THIS_MODULE ((struct module *)NULL)
+
+struct inode;
+struct file;
+
+struct vm_area_struct {
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned long vm_pgoff;
+};
+
+#define vma_pages(vma) (((vma)->vm_end - (vma)->vm_start) >> PAGE_SHIFT)
+
+/* Maps by pointing vm_start at the memory itself */
+static inline int remap_vmalloc_range(struct vm_area_struct *vma, void *addr,
+				      unsigned long pgoff)
+{
+	vma->vm_start = (unsigned long)addr + (pgoff << PAGE_SHIFT);
+	return 0;
+}
+
+#define vmalloc_user(size) calloc(1, size)
+#define vfree(p) free(p)
+
+/* Nothing sleeps in poll, shim_misc_poll only returns the mask */
+typedef unsigned int __poll_t;
+typedef struct poll_table_struct poll_table;
+
+static inline void poll_wait(struct file *file, wait_queue_head_t *w,
+			     poll_table *p)
+{
+}
+
+struct file {
+	const struct file_operations *f_op;
+	unsigned int f_flags;
+	void *private_data;
+};
+
+struct file_operations {
+	struct module *owner;
+	int (*open)(struct inode *inode, struct file *file);
+	int (*release)(struct inode *inode, struct file *file);
+	ssize_t (*read)(struct file *file, char __user *buf, size_t count,
+			loff_t *ppos);
+	ssize_t (*write)(struct file *file, const char __user *buf,
+			 size_t count, loff_t *ppos);
+	long (*unlocked_ioctl)(struct file *file, unsigned int cmd,
+			       unsigned long arg);
+	long (*compat_ioctl)(struct file *file, unsigned int cmd,
+			     unsigned long arg);
+	int (*mmap)(struct file *file, struct vm_area_struct *vma);
+	__poll_t (*poll)(struct file *file, poll_table *wait);
+
+	/* Only of the shim, the show of DEFINE_SHOW_ATTRIBUTE */
+	int (*shim_show)(struct seq_file *s, void *unused);
+};
+
+#define DEFINE_SHOW_ATTRIBUTE(name) \
+	static const struct file_operations name##_fops = { \
+		.owner = THIS_MODULE, \
+		.shim_show = name##_show, \
+	}
+
+#define compat_ptr_ioctl NULL
+
+#define copy_from_user(to, from, n) (memcpy(to, from, n), 0UL)
+#define copy_to_user(to, from, n) (memcpy(to, from, n), 0UL)
+#define u64_to_user_ptr(x) ((void __user *)(uintptr_t)(x))
+
+#define MISC_DYNAMIC_MINOR 255
+
+struct miscdevice {
+	int minor;
+	const char *name;
+	const struct file_operations *fops;
+	struct device *parent;
+
+	struct list_head shim_entry;
+};
+
+int misc_register(struct miscdevice *misc);
+void misc_deregister(struct miscdevice *misc);
+
+/* Opens a misc device by its name, and calls the file operations of it */
+struct file *shim_misc_open(const char *name);
+ssize_t shim_misc_read(struct file *file, void *buf, size_t count);
+ssize_t shim_misc_write(struct file *file, const void *buf, size_t count);
+long shim_misc_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+void *shim_misc_mmap(struct file *file, size_t size);
+__poll_t shim_misc_poll(struct file *file);
+void shim_misc_release(struct file *file);
+
+/*
+ * Generic netlink, messages are built with the real attribute layout and
+ * multicast to shim_genl_receive. Groups only have listeners while
+ * shim_genl_listeners is set.
+ */
+
+#define NLMSG_GOODSIZE 8192
+#define NLA_F_NESTED (1 << 15)
+#define NLA_ALIGN(len) (((len) + 3) & ~3)
+#define NLA_HDRLEN ((int)NLA_ALIGN(sizeof(struct nlattr)))
+
+struct net {
+	int unused;
+};
+
+extern struct net init_net;
+
+struct sk_buff {
+	unsigned char *data;
+	unsigned int len;
+	unsigned int size;
+};
+
+struct nlmsghdr {
+	u32 nlmsg_len;
+	u16 nlmsg_type;
+	u16 nlmsg_flags;
+	u32 nlmsg_seq;
+	u32 nlmsg_pid;
+};
+
+struct genlmsghdr {
+	u8 cmd;
+	u8 version;
+	u16 reserved;
+};
+
+struct nlattr {
+	u16 nla_len;
+	u16 nla_type;
+};
+
+struct genl_multicast_group {
+	char name[16];
+};
+
+struct genl_family {
+	int id;
+	char name[16];
+	unsigned int version;
+	unsigned int maxattr;
+	struct module *module;
+	const struct genl_multicast_group *mcgrps;
+	unsigned int n_mcgrps;
+};
+
+extern int shim_genl_listeners;
+extern void (*shim_genl_receive)(const struct genl_family *family,
+				 unsigned int group, const void *data,
+				 size_t len);
+
+int genl_register_family(struct genl_family *family);
+int genl_unregister_family(const struct genl_family *family);
+bool genl_has_listeners(const struct genl_family *family, struct net *net,
+			unsigned int group);
+struct sk_buff *genlmsg_new(size_t payload, gfp_t flags);
+void nlmsg_free(struct sk_buff *skb);
+void *genlmsg_put(struct sk_buff *skb, u32 portid, u32 seq,
+		  const struct genl_family *family, int flags, u8 cmd);
+void genlmsg_end(struct sk_buff *skb, void *hdr);
+int genlmsg_multicast(const struct genl_family *family, struct sk_buff *skb,
+		      u32 portid, unsigned int group, gfp_t flags);
+
+int nla_put(struct sk_buff *skb, int attrtype, int attrlen, const void *data);
+struct nlattr *nla_nest_start(struct sk_buff *skb, int attrtype);
+int nla_nest_end(struct sk_buff *skb, struct nlattr *start);
+void nla_nest_cancel(struct sk_buff *skb, struct nlattr *start);
+
+static inline int nla_put_u8(struct sk_buff *skb, int attrtype, u8 value)
+{
+	return nla_put(skb, attrtype, sizeof(value), &value);
+}
+
+static inline int nla_put_u16(struct sk_buff *skb, int attrtype, u16 value)
+{
+	return nla_put(skb, attrtype, sizeof(value), &value);
+}
+
+static inline int nla_put_u32(struct sk_buff *skb, int attrtype, u32 value)
+{
+	return nla_put(skb, attrtype, sizeof(value), &value);
+}
+
+/* The attributes are always aligned to 4 bytes, no padding is needed */
+static inline int nla_put_u64_64bit(struct sk_buff *skb, int attrtype,
+				    u64 value, int padattr)
+{
+	return nla_put(skb, attrtype, sizeof(value), &value);
+}
+
+static inline int nla_put_string(struct sk_buff *skb, int attrtype,
+				 const char *str)
+{
+	return nla_put(skb, attrtype, strlen(str) + 1, str);
+}
+
+/* Devices */
+
+struct bus_type;
+struct device_driver {
+	const char *name;
+	struct bus_type *bus;
+};
+
+struct device {
+	struct kobject kobj;
+	void *driver_data;
+	struct device_driver *driver;
+};
+
+struct device_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct device *dev, struct device_attribute *attr,
+			char *buf);
+	ssize_t (*store)(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count);
+};
+
+#define __ATTR(_name, _mode, _show, _store) { \
+	.attr = { .name = #_name, .mode = _mode }, \
+	.show = _show, \
+	.store = _store, \
+}
+#define DEVICE_ATTR(_name, _mode, _show, _store) \
+	struct device_attribute dev_attr_##_name = \
+		__ATTR(_name, _mode, _show, _store)
+
+static inline const char *dev_name(const struct device *dev)
+{
+	return dev->kobj.name;
+}
+
+static inline void *dev_get_drvdata(const struct device *dev)
+{
+	return dev->driver_data;
+}
+
+int bus_for_each_dev(struct bus_type *bus, struct device *start, void *data,
+		     int (*fn)(struct device *dev, void *data));
+void device_release_driver(struct device *dev);
+int driver_attach(struct device_driver *drv);
+
+/* HID */
+
+#define BUS_USB 0x03
+#define BUS_BLUETOOTH 0x05
+
+#define HID_MAX_BUFFER_SIZE 16384
+#define HID_CONNECT_DEFAULT 0x3f
+#define HID_OUTPUT_REPORT 1
+#define HID_REQ_SET_REPORT 0x09
+#define HID_GROUP_ANY 0
+#define HID_TYPE_USBMOUSE 1
+
+#define HID_DEVICE(b, g, ven, prod) \
+	.bus = (b), .group = (g), .vendor = (ven), .product = (prod)
+#define HID_USB_DEVICE(ven, prod) \
+	.bus = BUS_USB, .vendor = (ven), .product = (prod)
+#define HID_BLUETOOTH_DEVICE(ven, prod) \
+	.bus = BUS_BLUETOOTH, .vendor = (ven), .product = (prod)
+
+struct hid_device;
+
+struct hid_ll_driver {
+	int (*raw_request)(struct hid_device *hdev, unsigned char reportnum,
+			   u8 *buf, size_t len, unsigned char rtype,
+			   int reqtype);
+	int (*output_report)(struct hid_device *hdev, u8 *buf, size_t len);
+};
+
+struct hid_device_id {
+	u16 bus;
+	u16 group;
+	u32 vendor;
+	u32 product;
+	kernel_ulong_t driver_data;
+};
+
+struct hid_report {
+	unsigned int id;
+};
+
+struct hid_device {
+	u16 bus;
+	u32 vendor;
+	u32 product;
+	int type;
+	struct device dev;
+	struct hid_ll_driver *ll_driver;
+	struct hid_driver *driver;
+
+	/* Private to the owner of the fake device */
+	void *shim_data;
+};
+
+struct hid_driver {
+	char *name;
+	const struct hid_device_id *id_table;
+	int (*probe)(struct hid_device *dev, const struct hid_device_id *id);
+	void (*remove)(struct hid_device *dev);
+	int (*raw_event)(struct hid_device *hdev, struct hid_report *report,
+			 u8 *data, int size);
+	struct device_driver driver;
+
+	struct list_head shim_entry;
+};
+
+static inline void hid_set_drvdata(struct hid_device *hdev, void *data)
+{
+	hdev->dev.driver_data = data;
+}
+
+static inline void *hid_get_drvdata(struct hid_device *hdev)
+{
+	return hdev->dev.driver_data;
+}
+
+static inline int hid_parse(struct hid_device *hdev)
+{
+	return 0;
+}
+
+static inline int hid_hw_start(struct hid_device *hdev,
+			       unsigned int connect_mask)
+{
+	return 0;
+}
+
+static inline void hid_hw_stop(struct hid_device *hdev)
+{
+}
+
+int hid_hw_output_report(struct hid_device *hdev, u8 *buf, size_t len);
+int hid_hw_raw_request(struct hid_device *hdev, unsigned char reportnum,
+		       u8 *buf, size_t len, unsigned char rtype, int reqtype);
+int hid_register_driver(struct hid_driver *hdrv);
+void hid_unregister_driver(struct hid_driver *hdrv);
+
+/*
+ * Creates a device and probes it with the first registered driver which
+ * matches, reports are fed to the driver with shim_hid_input.
+ */
+struct hid_device *shim_hid_create(u16 bus, u32 vendor, u32 product,
+				   struct hid_ll_driver *ll_driver,
+				   void *data);
+void shim_hid_destroy(struct hid_device *hdev);
+int shim_hid_input(struct hid_device *hdev, const u8 *data, int size);
+
+#endif